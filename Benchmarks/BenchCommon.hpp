@@ -0,0 +1,252 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <R2/VK.hpp>
+
+// Shared by the benchmark executables. Everything here is header-only since
+// each executable is a single translation unit.
+namespace R2::Bench
+{
+    class StderrOutputReceiver : public VK::IDebugOutputReceiver
+    {
+    public:
+        void DebugMessage(const char* message) override
+        {
+            fprintf(stderr, "%s\n", message);
+        }
+    };
+
+    inline double GetTimeNs()
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    }
+
+    // Nearest-rank percentile; sorts the samples in place
+    inline double Percentile(std::vector<double>& samples, double percentile)
+    {
+        if (samples.empty())
+            return 0.0;
+
+        std::sort(samples.begin(), samples.end());
+        size_t rank = (size_t)(percentile / 100.0 * (double)(samples.size() - 1) + 0.5);
+        return samples[std::min(rank, samples.size() - 1)];
+    }
+
+    inline double Mean(const std::vector<double>& samples)
+    {
+        if (samples.empty())
+            return 0.0;
+
+        double total = 0.0;
+        for (double s : samples)
+            total += s;
+
+        return total / (double)samples.size();
+    }
+
+    inline void WriteJSONString(FILE* f, const char* str)
+    {
+        fputc('"', f);
+        for (const char* c = str; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+                fprintf(f, "\\%c", *c);
+            else if ((unsigned char)*c < 0x20)
+                fprintf(f, "\\u%04x", *c);
+            else
+                fputc(*c, f);
+        }
+        fputc('"', f);
+    }
+
+    // Writes the counters that changed between two snapshots, and the gauges
+    // as of the second one, as a JSON object
+    inline void WriteMetricsJSON(FILE* f, const VK::MetricsSnapshot& before, const VK::MetricsSnapshot& after)
+    {
+        fputc('{', f);
+        bool first = true;
+
+        for (uint32_t i = 0; i < (uint32_t)VK::Metric::Count; i++)
+        {
+            VK::Metric metric = (VK::Metric)i;
+            uint64_t value = VK::MetricsSnapshot::IsGauge(metric)
+                ? after.Get(metric)
+                : after.Get(metric) - before.Get(metric);
+
+            if (value == 0)
+                continue;
+
+            if (!first)
+                fputc(',', f);
+            first = false;
+
+            WriteJSONString(f, VK::MetricsSnapshot::GetName(metric));
+            fprintf(f, ":%llu", (unsigned long long)value);
+        }
+
+        fputc('}', f);
+    }
+
+    // Hand-assembled SPIR-V, so the benchmarks don't depend on a shader compiler.
+    //
+    // A compute shader with an empty main, local size 1x1x1, and a
+    // specialization constant at ID 0 that can be varied to get distinct pipelines.
+    inline const uint32_t EmptyComputeSpirv[] =
+    {
+        0x07230203, 0x00010000, 0x00000000, 7, 0,
+        0x00020011, 1,                          // OpCapability Shader
+        0x0003000E, 0, 1,                       // OpMemoryModel Logical GLSL450
+        0x0005000F, 5, 1, 0x6E69616D, 0,        // OpEntryPoint GLCompute %1 "main"
+        0x00060010, 1, 17, 1, 1, 1,             // OpExecutionMode %1 LocalSize 1 1 1
+        0x00040047, 6, 1, 0,                    // OpDecorate %6 SpecId 0
+        0x00020013, 2,                          // %2 = OpTypeVoid
+        0x00030021, 3, 2,                       // %3 = OpTypeFunction %2
+        0x00040015, 5, 32, 0,                   // %5 = OpTypeInt 32 0
+        0x00040032, 5, 6, 0,                    // %6 = OpSpecConstant %5 0
+        0x00050036, 2, 1, 0, 3,                 // %1 = OpFunction %2 None %3
+        0x000200F8, 4,                          // %4 = OpLabel
+        0x000100FD,                             // OpReturn
+        0x00010038                              // OpFunctionEnd
+    };
+
+    // For R2Stress. The vertex shader places a shared triangle at a per-draw
+    // offset and scale read from a storage buffer at set 1, binding 0,
+    // indexed by the first push constant. The fragment shader samples the
+    // bindless texture selected by the second push constant, using the
+    // BindlessTextureManager layout at set 0.
+    inline const uint32_t StressVertexSpirv[] =
+    {
+        0x07230203, 0x00010000, 0x00000000, 39, 0,
+        0x00020011, 1,                              // OpCapability Shader
+        0x0003000E, 0, 1,                           // OpMemoryModel Logical GLSL450
+        0x0008000F, 0, 1, 0x6E69616D, 0, 9, 11, 13, // OpEntryPoint Vertex %1 "main" %9 %11 %13
+        0x00040047, 9, 30, 0,                       // OpDecorate %9 Location 0
+        0x00040047, 11, 30, 0,                      // OpDecorate %11 Location 0
+        0x00040047, 13, 11, 0,                      // OpDecorate %13 BuiltIn Position
+        0x00030047, 14, 2,                          // OpDecorate %14 Block
+        0x00050048, 14, 0, 35, 0,                   // OpMemberDecorate %14 0 Offset 0
+        0x00050048, 14, 1, 35, 4,                   // OpMemberDecorate %14 1 Offset 4
+        0x00040047, 18, 6, 16,                      // OpDecorate %18 ArrayStride 16
+        0x00030047, 19, 3,                          // OpDecorate %19 BufferBlock
+        0x00040048, 19, 0, 24,                      // OpMemberDecorate %19 0 NonWritable
+        0x00050048, 19, 0, 35, 0,                   // OpMemberDecorate %19 0 Offset 0
+        0x00040047, 21, 34, 1,                      // OpDecorate %21 DescriptorSet 1
+        0x00040047, 21, 33, 0,                      // OpDecorate %21 Binding 0
+        0x00020013, 2,                              // %2 = OpTypeVoid
+        0x00030021, 3, 2,                           // %3 = OpTypeFunction %2
+        0x00030016, 4, 32,                          // %4 = OpTypeFloat 32
+        0x00040017, 5, 4, 2,                        // %5 = OpTypeVector %4 2
+        0x00040017, 6, 4, 4,                        // %6 = OpTypeVector %4 4
+        0x00040015, 7, 32, 0,                       // %7 = OpTypeInt 32 0
+        0x00040020, 8, 1, 5,                        // %8 = OpTypePointer Input %5
+        0x0004003B, 8, 9, 1,                        // %9 = OpVariable %8 Input
+        0x00040020, 10, 3, 5,                       // %10 = OpTypePointer Output %5
+        0x0004003B, 10, 11, 3,                      // %11 = OpVariable %10 Output
+        0x00040020, 12, 3, 6,                       // %12 = OpTypePointer Output %6
+        0x0004003B, 12, 13, 3,                      // %13 = OpVariable %12 Output
+        0x0004001E, 14, 7, 7,                       // %14 = OpTypeStruct %7 %7
+        0x00040020, 15, 9, 14,                      // %15 = OpTypePointer PushConstant %14
+        0x0004003B, 15, 16, 9,                      // %16 = OpVariable %15 PushConstant
+        0x00040020, 17, 9, 7,                       // %17 = OpTypePointer PushConstant %7
+        0x0003001D, 18, 6,                          // %18 = OpTypeRuntimeArray %6
+        0x0003001E, 19, 18,                         // %19 = OpTypeStruct %18
+        0x00040020, 20, 2, 19,                      // %20 = OpTypePointer Uniform %19
+        0x0004003B, 20, 21, 2,                      // %21 = OpVariable %20 Uniform
+        0x00040020, 22, 2, 6,                       // %22 = OpTypePointer Uniform %6
+        0x0004002B, 7, 23, 0,                       // %23 = OpConstant %7 0
+        0x0004002B, 4, 24, 0,                       // %24 = OpConstant %4 0.0
+        0x0004002B, 4, 25, 0x3F800000,              // %25 = OpConstant %4 1.0
+        0x00050036, 2, 1, 0, 3,                     // %1 = OpFunction %2 None %3
+        0x000200F8, 26,                             // %26 = OpLabel
+        0x00050041, 17, 27, 16, 23,                 // %27 = OpAccessChain %17 %16 %23
+        0x0004003D, 7, 28, 27,                      // %28 = OpLoad %7 %27
+        0x00060041, 22, 29, 21, 23, 28,             // %29 = OpAccessChain %22 %21 %23 %28
+        0x0004003D, 6, 30, 29,                      // %30 = OpLoad %6 %29
+        0x0004003D, 5, 31, 9,                       // %31 = OpLoad %5 %9
+        0x00050051, 4, 32, 30, 2,                   // %32 = OpCompositeExtract %4 %30 2
+        0x0005008E, 5, 33, 31, 32,                  // %33 = OpVectorTimesScalar %5 %31 %32
+        0x0007004F, 5, 34, 30, 30, 0, 1,            // %34 = OpVectorShuffle %5 %30 %30 0 1
+        0x00050081, 5, 35, 33, 34,                  // %35 = OpFAdd %5 %33 %34
+        0x00050051, 4, 36, 35, 0,                   // %36 = OpCompositeExtract %4 %35 0
+        0x00050051, 4, 37, 35, 1,                   // %37 = OpCompositeExtract %4 %35 1
+        0x00070050, 6, 38, 36, 37, 24, 25,          // %38 = OpCompositeConstruct %6 %36 %37 %24 %25
+        0x0003003E, 13, 38,                         // OpStore %13 %38
+        0x0003003E, 11, 31,                         // OpStore %11 %31
+        0x000100FD,                                 // OpReturn
+        0x00010038                                  // OpFunctionEnd
+    };
+
+    inline const uint32_t StressFragmentSpirv[] =
+    {
+        0x07230203, 0x00010000, 0x00000000, 41, 0,
+        0x00020011, 1,                           // OpCapability Shader
+        0x00020011, 5301,                        // OpCapability ShaderNonUniformEXT
+        0x00020011, 5307,                        // OpCapability SampledImageArrayNonUniformIndexingEXT
+        // OpExtension "SPV_EXT_descriptor_indexing"
+        0x0008000A, 0x5F565053, 0x5F545845, 0x63736564, 0x74706972, 0x695F726F, 0x7865646E, 0x00676E69,
+        0x0003000E, 0, 1,                        // OpMemoryModel Logical GLSL450
+        0x0007000F, 4, 1, 0x6E69616D, 0, 28, 30, // OpEntryPoint Fragment %1 "main" %28 %30
+        0x00030010, 1, 7,                        // OpExecutionMode %1 OriginUpperLeft
+        0x00040047, 15, 34, 0,                   // OpDecorate %15 DescriptorSet 0
+        0x00040047, 15, 33, 1,                   // OpDecorate %15 Binding 1
+        0x00040047, 20, 34, 0,                   // OpDecorate %20 DescriptorSet 0
+        0x00040047, 20, 33, 0,                   // OpDecorate %20 Binding 0
+        0x00030047, 23, 2,                       // OpDecorate %23 Block
+        0x00050048, 23, 0, 35, 0,                // OpMemberDecorate %23 0 Offset 0
+        0x00050048, 23, 1, 35, 4,                // OpMemberDecorate %23 1 Offset 4
+        0x00040047, 28, 30, 0,                   // OpDecorate %28 Location 0
+        0x00040047, 30, 30, 0,                   // OpDecorate %30 Location 0
+        0x00030047, 33, 5300,                    // OpDecorate %33 NonUniformEXT
+        0x00030047, 34, 5300,                    // OpDecorate %34 NonUniformEXT
+        0x00030047, 35, 5300,                    // OpDecorate %35 NonUniformEXT
+        0x00030047, 38, 5300,                    // OpDecorate %38 NonUniformEXT
+        0x00020013, 2,                           // %2 = OpTypeVoid
+        0x00030021, 3, 2,                        // %3 = OpTypeFunction %2
+        0x00030016, 4, 32,                       // %4 = OpTypeFloat 32
+        0x00040017, 5, 4, 2,                     // %5 = OpTypeVector %4 2
+        0x00040017, 6, 4, 4,                     // %6 = OpTypeVector %4 4
+        0x00040015, 7, 32, 0,                    // %7 = OpTypeInt 32 0
+        0x0004002B, 7, 8, 0,                     // %8 = OpConstant %7 0
+        0x0004002B, 7, 9, 1,                     // %9 = OpConstant %7 1
+        0x0004002B, 7, 10, 16,                   // %10 = OpConstant %7 16
+        0x0004002B, 7, 11, 1024,                 // %11 = OpConstant %7 1024
+        0x00090019, 12, 4, 1, 0, 0, 0, 1, 0,     // %12 = OpTypeImage %4 2D 0 0 0 1 Unknown
+        0x0004001C, 13, 12, 11,                  // %13 = OpTypeArray %12 %11
+        0x00040020, 14, 0, 13,                   // %14 = OpTypePointer UniformConstant %13
+        0x0004003B, 14, 15, 0,                   // %15 = OpVariable %14 UniformConstant
+        0x00040020, 16, 0, 12,                   // %16 = OpTypePointer UniformConstant %12
+        0x0002001A, 17,                          // %17 = OpTypeSampler
+        0x0004001C, 18, 17, 10,                  // %18 = OpTypeArray %17 %10
+        0x00040020, 19, 0, 18,                   // %19 = OpTypePointer UniformConstant %18
+        0x0004003B, 19, 20, 0,                   // %20 = OpVariable %19 UniformConstant
+        0x00040020, 21, 0, 17,                   // %21 = OpTypePointer UniformConstant %17
+        0x0003001B, 22, 12,                      // %22 = OpTypeSampledImage %12
+        0x0004001E, 23, 7, 7,                    // %23 = OpTypeStruct %7 %7
+        0x00040020, 24, 9, 23,                   // %24 = OpTypePointer PushConstant %23
+        0x0004003B, 24, 25, 9,                   // %25 = OpVariable %24 PushConstant
+        0x00040020, 26, 9, 7,                    // %26 = OpTypePointer PushConstant %7
+        0x00040020, 27, 1, 5,                    // %27 = OpTypePointer Input %5
+        0x0004003B, 27, 28, 1,                   // %28 = OpVariable %27 Input
+        0x00040020, 29, 3, 6,                    // %29 = OpTypePointer Output %6
+        0x0004003B, 29, 30, 3,                   // %30 = OpVariable %29 Output
+        0x00050036, 2, 1, 0, 3,                  // %1 = OpFunction %2 None %3
+        0x000200F8, 31,                          // %31 = OpLabel
+        0x00050041, 26, 32, 25, 9,               // %32 = OpAccessChain %26 %25 %9
+        0x0004003D, 7, 33, 32,                   // %33 = OpLoad %7 %32
+        0x00050041, 16, 34, 15, 33,              // %34 = OpAccessChain %16 %15 %33
+        0x0004003D, 12, 35, 34,                  // %35 = OpLoad %12 %34
+        0x00050041, 21, 36, 20, 8,               // %36 = OpAccessChain %21 %20 %8
+        0x0004003D, 17, 37, 36,                  // %37 = OpLoad %17 %36
+        0x00050056, 22, 38, 35, 37,              // %38 = OpSampledImage %22 %35 %37
+        0x0004003D, 5, 39, 28,                   // %39 = OpLoad %5 %28
+        0x00050057, 6, 40, 38, 39,               // %40 = OpImageSampleImplicitLod %6 %38 %39
+        0x0003003E, 30, 40,                      // OpStore %30 %40
+        0x000100FD,                              // OpReturn
+        0x00010038                               // OpFunctionEnd
+    };
+}
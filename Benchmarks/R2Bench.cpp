@@ -0,0 +1,549 @@
+// Micro-benchmarks for the CPU-side cost of R2's hot paths. Runs the Core in
+// headless mode, so it works on a machine without a display, e.g. with lavapipe
+// selected through VK_ICD_FILENAMES.
+//
+// Usage: R2Bench [--filter <substring>] [--output <path>] [--validation]
+//
+// Writes a single JSON object to stdout (or the output path) with one entry
+// per benchmark and parameter. Times are per operation. Each entry also has
+// the runtime metric counters that changed while it ran.
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <volk.h>
+#include <R2/BindlessTextureManager.hpp>
+#include <R2/VK.hpp>
+#include <RenderPassCache.hpp>
+#include "BenchCommon.hpp"
+
+using namespace R2;
+
+namespace
+{
+    class BenchRunner
+    {
+    public:
+        BenchRunner(VK::Core* core, FILE* out, const char* filter)
+            : core(core)
+            , out(out)
+            , filter(filter)
+        {
+            fprintf(out, "{\"device\":");
+            Bench::WriteJSONString(out, core->GetDeviceInfo().Name);
+            fprintf(out, ",\"dynamic_rendering\":%s,\"results\":[",
+                core->GetSupportedFeatures().DynamicRendering ? "true" : "false");
+        }
+
+        bool ShouldRun(const char* name)
+        {
+            return filter == nullptr || strstr(name, filter) != nullptr;
+        }
+
+        // Calls fn once per iteration. fn returns the number of operations it
+        // did, which the iteration's time is divided by. bytesPerOp is only
+        // used to report throughput and can be zero.
+        template <typename F>
+        void Run(const char* name, const std::string& parameter, int iterations, uint64_t bytesPerOp, F&& fn)
+        {
+            std::vector<double> samples;
+            samples.reserve(iterations);
+            uint64_t totalOps = 0;
+
+            VK::MetricsSnapshot before = core->GetTotalMetrics();
+
+            for (int i = 0; i < iterations; i++)
+            {
+                double start = Bench::GetTimeNs();
+                uint64_t ops = fn();
+                double end = Bench::GetTimeNs();
+
+                samples.push_back((end - start) / (double)ops);
+                totalOps += ops;
+            }
+
+            VK::MetricsSnapshot after = core->GetTotalMetrics();
+
+            double mean = Bench::Mean(samples);
+            double min = Bench::Percentile(samples, 0.0);
+            double median = Bench::Percentile(samples, 50.0);
+            double p99 = Bench::Percentile(samples, 99.0);
+
+            fprintf(out, "%s\n{\"benchmark\":", numResults > 0 ? "," : "");
+            Bench::WriteJSONString(out, name);
+            fprintf(out, ",\"parameter\":");
+            Bench::WriteJSONString(out, parameter.c_str());
+            fprintf(out, ",\"iterations\":%d,\"operations\":%llu,\"mean_ns\":%.1f,\"median_ns\":%.1f,\"min_ns\":%.1f,\"p99_ns\":%.1f",
+                iterations, (unsigned long long)totalOps, mean, median, min, p99);
+
+            if (bytesPerOp > 0)
+            {
+                fprintf(out, ",\"bytes_per_second\":%.0f", (double)bytesPerOp / (median * 1e-9));
+            }
+
+            fprintf(out, ",\"metrics\":");
+            Bench::WriteMetricsJSON(out, before, after);
+            fprintf(out, "}");
+            fflush(out);
+
+            numResults++;
+        }
+
+        void Finish()
+        {
+            fprintf(out, "\n]}\n");
+        }
+
+    private:
+        VK::Core* core;
+        FILE* out;
+        const char* filter;
+        uint32_t numResults = 0;
+    };
+
+    // Submits a frame and waits for it, so each iteration includes the GPU
+    // side of whatever was queued
+    void submitFrameAndWait(VK::Core* core)
+    {
+        core->EndFrame();
+        core->WaitIdle();
+    }
+
+    void benchEmptyFrame(BenchRunner& runner, VK::Core* core)
+    {
+        if (!runner.ShouldRun("empty_frame"))
+            return;
+
+        // Baseline for the upload benchmarks, which pay for a frame each
+        runner.Run("empty_frame", "", 64, 0, [&]()
+        {
+            core->BeginFrame();
+            submitFrameAndWait(core);
+            return 1;
+        });
+    }
+
+    int iterationsForSize(uint64_t size)
+    {
+        return (int)std::clamp<uint64_t>((256ull << 20) / size, 4, 64);
+    }
+
+    void benchBufferUpload(BenchRunner& runner, VK::Core* core)
+    {
+        if (!runner.ShouldRun("buffer_upload"))
+            return;
+
+        // The last size doesn't fit in the staging buffer, so it takes the
+        // oversized path that waits for the GPU
+        const uint64_t sizes[] = { 1ull << 10, 16ull << 10, 256ull << 10, 4ull << 20, 32ull << 20, 96ull << 20 };
+
+        for (uint64_t size : sizes)
+        {
+            VK::Buffer* buffer = core->CreateBuffer(VK::BufferCreateInfo{ VK::BufferUsage::Storage, size, false });
+            std::vector<uint8_t> data(size, 0xAB);
+
+            runner.Run("buffer_upload", "bytes=" + std::to_string(size), iterationsForSize(size), size, [&]()
+            {
+                core->BeginFrame();
+                core->QueueBufferUpload(buffer, data.data(), size, 0);
+                submitFrameAndWait(core);
+                return 1;
+            });
+
+            delete buffer;
+        }
+    }
+
+    void benchTextureUpload(BenchRunner& runner, VK::Core* core)
+    {
+        if (!runner.ShouldRun("texture_upload"))
+            return;
+
+        const int dimensions[] = { 64, 256, 1024, 2048 };
+
+        for (int dim : dimensions)
+        {
+            VK::Texture* texture = core->CreateTexture(
+                VK::TextureCreateInfo::Texture2D(VK::TextureFormat::R8G8B8A8_UNORM, dim, dim));
+            uint64_t size = (uint64_t)dim * dim * 4;
+            std::vector<uint8_t> data(size, 0xAB);
+
+            std::string parameter = std::to_string(dim) + "x" + std::to_string(dim) + " rgba8";
+            runner.Run("texture_upload", parameter, iterationsForSize(size), size, [&]()
+            {
+                core->BeginFrame();
+                core->QueueTextureUpload(texture, data.data(), size, 1);
+                submitFrameAndWait(core);
+                return 1;
+            });
+
+            delete texture;
+        }
+    }
+
+    void benchDescriptorUpdates(BenchRunner& runner, VK::Core* core)
+    {
+        if (!runner.ShouldRun("descriptor_update"))
+            return;
+
+        const uint32_t NUM_TEXTURES = 16;
+        const uint64_t UPDATES_PER_ITERATION = 256;
+
+        VK::DescriptorSetLayout* dsl = VK::DescriptorSetLayoutBuilder(core)
+            .Binding(0, VK::DescriptorType::UniformBuffer, 1, VK::ShaderStage::AllRaster)
+            .Binding(1, VK::DescriptorType::CombinedImageSampler, NUM_TEXTURES, VK::ShaderStage::Fragment)
+            .Build();
+        VK::DescriptorSet* ds = core->CreateDescriptorSet(dsl);
+
+        VK::Buffer* uniformBuffer = core->CreateBuffer(VK::BufferCreateInfo{ VK::BufferUsage::Uniform, 256, false });
+        VK::Sampler* sampler = VK::SamplerBuilder(core).Build();
+        std::vector<VK::Texture*> textures;
+        for (uint32_t i = 0; i < NUM_TEXTURES; i++)
+        {
+            textures.push_back(core->CreateTexture(
+                VK::TextureCreateInfo::Texture2D(VK::TextureFormat::R8G8B8A8_UNORM, 4, 4)));
+        }
+
+        runner.Run("descriptor_update", "writes=1", 64, 0, [&]()
+        {
+            for (uint64_t i = 0; i < UPDATES_PER_ITERATION; i++)
+            {
+                VK::DescriptorSetUpdater(core, ds, 1)
+                    .AddBuffer(0, 0, VK::DescriptorType::UniformBuffer, uniformBuffer)
+                    .Update();
+            }
+            return UPDATES_PER_ITERATION;
+        });
+
+        runner.Run("descriptor_update", "writes=" + std::to_string(NUM_TEXTURES + 1), 64, 0, [&]()
+        {
+            for (uint64_t i = 0; i < UPDATES_PER_ITERATION; i++)
+            {
+                VK::DescriptorSetUpdater dsu{ core, ds, (int)NUM_TEXTURES + 1 };
+                dsu.AddBuffer(0, 0, VK::DescriptorType::UniformBuffer, uniformBuffer);
+
+                for (uint32_t j = 0; j < NUM_TEXTURES; j++)
+                {
+                    dsu.AddTexture(1, j, VK::DescriptorType::CombinedImageSampler, textures[j], sampler);
+                }
+
+                dsu.Update();
+            }
+            return UPDATES_PER_ITERATION;
+        });
+
+        for (VK::Texture* texture : textures)
+            delete texture;
+        delete sampler;
+        delete uniformBuffer;
+        delete ds;
+        delete dsl;
+    }
+
+    void benchPipelineCreation(BenchRunner& runner, VK::Core* core)
+    {
+        if (!runner.ShouldRun("pipeline_create"))
+            return;
+
+        const int NUM_PIPELINES = 32;
+
+        VK::ShaderModule module{ core->GetHandles(), Bench::EmptyComputeSpirv, sizeof(Bench::EmptyComputeSpirv) };
+        VK::PipelineLayout* layout = VK::PipelineLayoutBuilder(core).Build();
+
+        // Every cold pipeline gets a specialization constant value that hasn't
+        // been used before, including by previous runs, so that neither the
+        // driver's in-memory nor on-disk shader cache can serve it
+        uint32_t salt = std::random_device{}();
+        uint32_t coldIndex = 0;
+
+        auto build = [&](uint32_t specValue)
+        {
+            VK::Pipeline* pipeline = VK::ComputePipelineBuilder(core)
+                .SetShader(module)
+                .Layout(layout)
+                .Specialize(0, specValue)
+                .Build();
+            delete pipeline;
+        };
+
+        runner.Run("pipeline_create", "compute cold", NUM_PIPELINES, 0, [&]()
+        {
+            build(salt + coldIndex++);
+            return 1;
+        });
+
+        // The same pipeline as the first cold one, so driver-side caches are warm
+        runner.Run("pipeline_create", "compute warm", NUM_PIPELINES, 0, [&]()
+        {
+            build(salt);
+            return 1;
+        });
+
+        delete layout;
+    }
+
+    void benchBarriers(BenchRunner& runner, VK::Core* core)
+    {
+        if (!runner.ShouldRun("barrier"))
+            return;
+
+        const uint64_t BARRIERS_PER_ITERATION = 1024;
+
+        VK::Texture* texture = core->CreateTexture(
+            VK::TextureCreateInfo::Texture2D(VK::TextureFormat::R8G8B8A8_UNORM, 256, 256));
+        VK::Buffer* buffer = core->CreateBuffer(VK::BufferCreateInfo{ VK::BufferUsage::Storage, 65536, false });
+
+        // Only the recording is timed; the frame is submitted afterwards
+        core->BeginFrame();
+        VK::CommandBuffer cb = core->GetFrameCommandBuffer();
+
+        runner.Run("barrier", "texture", 32, 0, [&]()
+        {
+            for (uint64_t i = 0; i < BARRIERS_PER_ITERATION; i += 2)
+            {
+                texture->Acquire(cb, VK::ImageLayout::TransferDstOptimal,
+                    VK::AccessFlags::TransferWrite, VK::PipelineStageFlags::Transfer);
+                texture->Acquire(cb, VK::ImageLayout::ShaderReadOnlyOptimal,
+                    VK::AccessFlags::ShaderRead, VK::PipelineStageFlags::FragmentShader);
+            }
+            return BARRIERS_PER_ITERATION;
+        });
+
+        runner.Run("barrier", "buffer", 32, 0, [&]()
+        {
+            for (uint64_t i = 0; i < BARRIERS_PER_ITERATION; i += 2)
+            {
+                buffer->Acquire(cb, VK::AccessFlags::TransferWrite, VK::PipelineStageFlags::Transfer);
+                buffer->Acquire(cb, VK::AccessFlags::ShaderRead, VK::PipelineStageFlags::ComputeShader);
+            }
+            return BARRIERS_PER_ITERATION;
+        });
+
+        submitFrameAndWait(core);
+
+        delete buffer;
+        delete texture;
+    }
+
+    VK::RenderPassKey makeRenderPassKey(uint32_t variant)
+    {
+        const VkFormat formats[] = { VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_B8G8R8A8_UNORM,
+                                     VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R32_SFLOAT };
+        const VkAttachmentLoadOp loadOps[] = { VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_LOAD_OP_LOAD,
+                                               VK_ATTACHMENT_LOAD_OP_DONT_CARE };
+
+        VK::RenderPassKey key{};
+        key.numColorAttachments = 1 + variant % VK::MAX_RENDER_PASS_COLOR_ATTACHMENTS;
+        variant /= VK::MAX_RENDER_PASS_COLOR_ATTACHMENTS;
+
+        VkFormat format = formats[variant % 4];
+        VkAttachmentLoadOp loadOp = loadOps[(variant / 4) % 3];
+
+        for (uint32_t i = 0; i < key.numColorAttachments; i++)
+        {
+            key.colorAttachments[i] = VK::RenderPassAttachment{ format, loadOp, VK_ATTACHMENT_STORE_OP_STORE, VK_SAMPLE_COUNT_1_BIT };
+        }
+
+        return key;
+    }
+
+    void benchRenderPassCache(BenchRunner& runner, VK::Core* core)
+    {
+        if (!runner.ShouldRun("render_pass_cache"))
+            return;
+
+        const uint32_t NUM_VARIANTS = 48;
+        const uint64_t LOOKUPS_PER_ITERATION = 4096;
+
+        // A cache of our own, so this works whether or not the device has
+        // dynamic rendering and doesn't disturb the global one
+        VK::RenderPassCache cache{ core };
+
+        uint32_t variant = 0;
+        runner.Run("render_pass_cache", "pass miss", NUM_VARIANTS, 0, [&]()
+        {
+            cache.GetPass(makeRenderPassKey(variant++));
+            return 1;
+        });
+
+        std::vector<VK::RenderPassKey> keys;
+        for (uint32_t i = 0; i < NUM_VARIANTS; i++)
+        {
+            keys.push_back(makeRenderPassKey(i));
+        }
+
+        runner.Run("render_pass_cache", "pass hit", 64, 0, [&]()
+        {
+            for (uint64_t i = 0; i < LOOKUPS_PER_ITERATION; i++)
+            {
+                cache.GetPass(keys[i % NUM_VARIANTS]);
+            }
+            return LOOKUPS_PER_ITERATION;
+        });
+
+        VK::FramebufferKey fbKey{};
+        fbKey.renderPass = cache.GetPass(keys[0]);
+        fbKey.height = 1080;
+        fbKey.numTextures = 1;
+        fbKey.layerCount = 1;
+        fbKey.textureFormats[0] = VK_FORMAT_R8G8B8A8_UNORM;
+        fbKey.textureUsages[0] = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+        // Differing widths, as with dynamic resolution. Stays under the cache's
+        // framebuffer limit, which is only enforced when evicting anyway.
+        uint32_t width = 1920;
+        runner.Run("render_pass_cache", "framebuffer miss", NUM_VARIANTS, 0, [&]()
+        {
+            fbKey.width = width--;
+            cache.GetFramebuffer(fbKey);
+            return 1;
+        });
+
+        runner.Run("render_pass_cache", "framebuffer hit", 64, 0, [&]()
+        {
+            for (uint64_t i = 0; i < LOOKUPS_PER_ITERATION; i++)
+            {
+                fbKey.width = 1920 - (uint32_t)(i % NUM_VARIANTS);
+                cache.GetFramebuffer(fbKey);
+            }
+            return LOOKUPS_PER_ITERATION;
+        });
+    }
+
+    void benchBindlessChurn(BenchRunner& runner, VK::Core* core)
+    {
+        if (!runner.ShouldRun("bindless"))
+            return;
+
+        const uint32_t NUM_TEXTURES = 64;
+        const uint32_t HANDLES_PER_ITERATION = 512;
+
+        BindlessTextureManager manager{ core };
+        std::vector<VK::Texture*> textures;
+        for (uint32_t i = 0; i < NUM_TEXTURES; i++)
+        {
+            textures.push_back(core->CreateTexture(
+                VK::TextureCreateInfo::Texture2D(VK::TextureFormat::R8G8B8A8_UNORM, 4, 4)));
+        }
+
+        // Keep some handles alive so the free slot search doesn't always
+        // succeed on the first slot
+        std::vector<uint32_t> residentHandles;
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            residentHandles.push_back(manager.AllocateTextureHandle(textures[i % NUM_TEXTURES]));
+        }
+        manager.UpdateDescriptorsIfNecessary();
+
+        std::vector<uint32_t> handles(HANDLES_PER_ITERATION);
+
+        runner.Run("bindless", "allocate+free", 64, 0, [&]()
+        {
+            for (uint32_t i = 0; i < HANDLES_PER_ITERATION; i++)
+            {
+                handles[i] = manager.AllocateTextureHandle(textures[i % NUM_TEXTURES]);
+            }
+
+            for (uint32_t i = 0; i < HANDLES_PER_ITERATION; i++)
+            {
+                manager.FreeTextureHandle(handles[i]);
+            }
+            return HANDLES_PER_ITERATION;
+        });
+
+        // What a frame pays after a burst of streaming changes
+        runner.Run("bindless", "update after churn", 64, 0, [&]()
+        {
+            for (uint32_t i = 0; i < HANDLES_PER_ITERATION; i++)
+            {
+                handles[i] = manager.AllocateTextureHandle(textures[i % NUM_TEXTURES]);
+            }
+
+            manager.UpdateDescriptorsIfNecessary();
+
+            for (uint32_t i = 0; i < HANDLES_PER_ITERATION; i++)
+            {
+                manager.FreeTextureHandle(handles[i]);
+            }
+            return 1;
+        });
+
+        for (uint32_t handle : residentHandles)
+        {
+            manager.FreeTextureHandle(handle);
+        }
+
+        core->WaitIdle();
+
+        for (VK::Texture* texture : textures)
+            delete texture;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* filter = nullptr;
+    const char* outputPath = nullptr;
+    bool validation = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--validation") == 0)
+        {
+            validation = true;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--filter <substring>] [--output <path>] [--validation]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    FILE* out = stdout;
+    if (outputPath)
+    {
+        out = fopen(outputPath, "w");
+        if (!out)
+        {
+            fprintf(stderr, "Couldn't open %s\n", outputPath);
+            return 1;
+        }
+    }
+
+    Bench::StderrOutputReceiver receiver;
+    VK::CoreCreateInfo coreCreateInfo{};
+    coreCreateInfo.DebugOutputReceiver = &receiver;
+    coreCreateInfo.EnableValidation = validation;
+    coreCreateInfo.Headless = true;
+    VK::Core* core = new VK::Core(coreCreateInfo);
+
+    {
+        BenchRunner runner{ core, out, filter };
+        benchEmptyFrame(runner, core);
+        benchBufferUpload(runner, core);
+        benchTextureUpload(runner, core);
+        benchDescriptorUpdates(runner, core);
+        benchPipelineCreation(runner, core);
+        benchBarriers(runner, core);
+        benchRenderPassCache(runner, core);
+        benchBindlessChurn(runner, core);
+        runner.Finish();
+    }
+
+    core->WaitIdle();
+    delete core;
+
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,432 @@
+// End-to-end load generator. Renders a synthetic scene of many small textured
+// draws through RenderPass, PipelineBuilder and BindlessTextureManager, with
+// per-frame constant uploads, bindless descriptor churn and dynamic
+// resolution. The Core runs headless and renders into a pooled offscreen target.
+//
+// Usage: R2Stress [--draws N] [--textures N] [--churn N] [--frames N] [--warmup N]
+//                 [--size WxH] [--target-ms T] [--cycle-scale] [--capture <pattern>]
+//                 [--output <path>] [--validation]
+//
+// Writes a JSON object with CPU frame time and GPU time percentiles, the
+// dynamic resolution scale range, and the runtime metric totals over the
+// measured frames. With --capture, every measured frame is also written to
+// a PNG through FrameCapture, e.g. --capture "frames/%05u.png".
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <R2/BindlessTextureManager.hpp>
+#include <R2/DynamicResolution.hpp>
+#include <R2/FrameCapture.hpp>
+#include <R2/VK.hpp>
+#include "BenchCommon.hpp"
+
+using namespace R2;
+
+namespace
+{
+    struct StressOptions
+    {
+        uint32_t NumDraws = 5000;
+        uint32_t NumTextures = 1000;
+        // Bindless handles repointed at a different texture every frame
+        uint32_t TexturesChurnedPerFrame = 32;
+        uint32_t NumFrames = 600;
+        uint32_t NumWarmupFrames = 60;
+        uint32_t Width = 1920;
+        uint32_t Height = 1080;
+        float TargetFrameTimeMs = 16.0f;
+        // Sweep the scale every frame instead of letting the controller pick it
+        bool CycleScale = false;
+        bool Validation = false;
+        const char* OutputPath = nullptr;
+        const char* CapturePattern = nullptr;
+    };
+
+    // Matches the push constant block in Bench::StressVertexSpirv and StressFragmentSpirv
+    struct DrawConstants
+    {
+        uint32_t DrawIndex;
+        uint32_t TextureHandle;
+    };
+
+    // x and y offset in clip space, then the scale
+    struct DrawData
+    {
+        float X, Y, Scale, Padding;
+    };
+
+    static_assert(BindlessTextureManager::NUM_TEXTURES == 1024,
+        "The texture array size in StressFragmentSpirv has to match");
+
+    bool parseOptions(int argc, char** argv, StressOptions& options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const char* arg = argv[i];
+            const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+            if (strcmp(arg, "--cycle-scale") == 0)
+            {
+                options.CycleScale = true;
+                continue;
+            }
+            else if (strcmp(arg, "--validation") == 0)
+            {
+                options.Validation = true;
+                continue;
+            }
+
+            if (value == nullptr)
+                return false;
+            i++;
+
+            if (strcmp(arg, "--draws") == 0)
+                options.NumDraws = (uint32_t)atoi(value);
+            else if (strcmp(arg, "--textures") == 0)
+                options.NumTextures = (uint32_t)atoi(value);
+            else if (strcmp(arg, "--churn") == 0)
+                options.TexturesChurnedPerFrame = (uint32_t)atoi(value);
+            else if (strcmp(arg, "--frames") == 0)
+                options.NumFrames = (uint32_t)atoi(value);
+            else if (strcmp(arg, "--warmup") == 0)
+                options.NumWarmupFrames = (uint32_t)atoi(value);
+            else if (strcmp(arg, "--target-ms") == 0)
+                options.TargetFrameTimeMs = (float)atof(value);
+            else if (strcmp(arg, "--output") == 0)
+                options.OutputPath = value;
+            else if (strcmp(arg, "--capture") == 0)
+                options.CapturePattern = value;
+            else if (strcmp(arg, "--size") == 0)
+            {
+                if (sscanf(value, "%ux%u", &options.Width, &options.Height) != 2)
+                    return false;
+            }
+            else
+                return false;
+        }
+
+        return options.NumDraws > 0 && options.NumTextures > 0 && options.NumFrames > 0;
+    }
+
+    void writePercentiles(FILE* f, const char* name, std::vector<double>& samples)
+    {
+        fprintf(f, "\"%s\":{\"samples\":%zu,\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+            name, samples.size(), Bench::Mean(samples), Bench::Percentile(samples, 50.0),
+            Bench::Percentile(samples, 90.0), Bench::Percentile(samples, 99.0), Bench::Percentile(samples, 100.0));
+    }
+
+    void runStress(VK::Core* core, const StressOptions& options, FILE* out)
+    {
+        // Scene setup
+        // ===========
+        BindlessTextureManager* bindless = new BindlessTextureManager(core);
+
+        VK::DescriptorSetLayout* drawSetLayout = VK::DescriptorSetLayoutBuilder(core)
+            .Binding(0, VK::DescriptorType::StorageBuffer, 1, VK::ShaderStage::Vertex)
+            .Build();
+        VK::PipelineLayout* pipelineLayout = VK::PipelineLayoutBuilder(core)
+            .DescriptorSet(&bindless->GetTextureDescriptorSetLayout())
+            .DescriptorSet(drawSetLayout)
+            .PushConstants(VK::ShaderStage::AllRaster, 0, sizeof(DrawConstants))
+            .Build();
+
+        VK::ShaderModule vertexShader{ core->GetHandles(), Bench::StressVertexSpirv, sizeof(Bench::StressVertexSpirv) };
+        VK::ShaderModule fragmentShader{ core->GetHandles(), Bench::StressFragmentSpirv, sizeof(Bench::StressFragmentSpirv) };
+
+        VK::VertexBinding vertexBinding{ 0, sizeof(float) * 2 };
+        vertexBinding.Attributes.emplace_back(0, VK::TextureFormat::R32G32_SFLOAT, 0);
+
+        const VK::TextureFormat targetFormat = VK::TextureFormat::R8G8B8A8_UNORM;
+        VK::Pipeline* pipeline = VK::PipelineBuilder(core)
+            .AddShader(VK::ShaderStage::Vertex, vertexShader)
+            .AddShader(VK::ShaderStage::Fragment, fragmentShader)
+            .ColorAttachmentFormat(targetFormat)
+            .AddVertexBinding(vertexBinding)
+            .CullMode(VK::CullMode::None)
+            .Layout(pipelineLayout)
+            .Build();
+
+        const float triangle[] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f };
+        VK::Buffer* vertexBuffer = core->CreateBuffer(
+            VK::BufferCreateInfo{ VK::BufferUsage::Vertex, sizeof(triangle), false }, (void*)triangle, sizeof(triangle));
+
+        uint64_t drawDataSize = sizeof(DrawData) * options.NumDraws;
+        VK::Buffer* drawBuffer = core->CreateBuffer(VK::BufferCreateInfo{ VK::BufferUsage::Storage, drawDataSize, false });
+        VK::DescriptorSet* drawSet = core->CreateDescriptorSet(drawSetLayout);
+        VK::DescriptorSetUpdater(core, drawSet)
+            .AddBuffer(0, 0, VK::DescriptorType::StorageBuffer, drawBuffer)
+            .Update();
+
+        DynamicResolutionSettings drsSettings{};
+        drsSettings.TargetFrameTimeMs = options.TargetFrameTimeMs;
+        DynamicResolutionController drs{ core, options.Width, options.Height, drsSettings };
+        VK::RenderTargetPool targetPool{ core };
+        VK::Texture* target = targetPool.Acquire(drs.MaxRenderTargetInfo(targetFormat));
+
+        VK::GPUProfiler profiler{ core, 4 };
+
+        FrameCapture* capture = nullptr;
+        if (options.CapturePattern)
+        {
+            FrameCaptureCreateInfo captureCreateInfo{};
+            captureCreateInfo.PathPattern = options.CapturePattern;
+            capture = new FrameCapture(core, captureCreateInfo);
+        }
+
+        // Small distinctly colored textures, all uploaded in the first frame
+        const int TEXTURE_SIZE = 8;
+        std::vector<VK::Texture*> textures;
+        std::vector<uint32_t> textureHandles;
+        std::vector<uint8_t> texels(TEXTURE_SIZE * TEXTURE_SIZE * 4);
+
+        core->BeginFrame();
+        for (uint32_t i = 0; i < options.NumTextures; i++)
+        {
+            VK::Texture* texture = core->CreateTexture(
+                VK::TextureCreateInfo::Texture2D(VK::TextureFormat::R8G8B8A8_UNORM, TEXTURE_SIZE, TEXTURE_SIZE));
+
+            for (size_t j = 0; j < texels.size(); j += 4)
+            {
+                texels[j + 0] = (uint8_t)(i * 37);
+                texels[j + 1] = (uint8_t)(i * 91);
+                texels[j + 2] = (uint8_t)(i * 13);
+                texels[j + 3] = 255;
+            }
+
+            core->QueueTextureUpload(texture, texels.data(), texels.size(), 1);
+            textures.push_back(texture);
+            textureHandles.push_back(bindless->AllocateTextureHandle(texture));
+        }
+        core->EndFrame();
+
+        std::vector<DrawData> drawData(options.NumDraws);
+        uint32_t gridSize = (uint32_t)ceil(sqrt((double)options.NumDraws));
+        float cellSize = 2.0f / (float)gridSize;
+
+        // Frame loop
+        // ==========
+        std::vector<double> frameTimes;
+        std::vector<double> recordTimes;
+        std::vector<double> gpuTimes;
+        float minScale = 1.0f;
+        float maxScale = 0.0f;
+        double scaleTotal = 0.0;
+        uint32_t resolutionChanges = 0;
+        uint32_t lastRenderWidth = 0;
+        uint64_t lastGPUResultsFrame = 0;
+        uint64_t firstMeasuredFrame = ~0ull;
+        uint32_t churnCursor = 0;
+        VK::MetricsSnapshot metricsBefore{};
+
+        for (uint32_t frame = 0; frame < options.NumWarmupFrames + options.NumFrames; frame++)
+        {
+            bool measuring = frame >= options.NumWarmupFrames;
+            if (frame == options.NumWarmupFrames)
+            {
+                metricsBefore = core->GetTotalMetrics();
+            }
+
+            double frameStart = Bench::GetTimeNs();
+            core->BeginFrame();
+            double recordStart = Bench::GetTimeNs();
+
+            if (frame == options.NumWarmupFrames)
+            {
+                firstMeasuredFrame = core->GetFrameNumber();
+            }
+
+            VK::CommandBuffer cb = core->GetFrameCommandBuffer();
+
+            if (options.CycleScale)
+            {
+                // Triangle wave between the minimum and maximum scale over 60 frames
+                float t = fabsf((float)(frame % 60) / 30.0f - 1.0f);
+                drs.ForceScale(drsSettings.MinScale + (drsSettings.MaxScale - drsSettings.MinScale) * t);
+            }
+
+            drs.BeginFrame(cb);
+            profiler.BeginFrame(cb);
+
+            if (profiler.GetResultsFrameNumber() != lastGPUResultsFrame)
+            {
+                lastGPUResultsFrame = profiler.GetResultsFrameNumber();
+                const auto& zones = profiler.GetResults();
+
+                if (lastGPUResultsFrame >= firstMeasuredFrame && !zones.empty())
+                {
+                    gpuTimes.push_back(zones[0].DurationMs);
+                }
+            }
+
+            profiler.BeginZone(cb, "Scene");
+
+            for (uint32_t i = 0; i < options.TexturesChurnedPerFrame; i++)
+            {
+                uint32_t slot = churnCursor++ % options.NumTextures;
+                bindless->SetTextureAt(textureHandles[slot], textures[(slot + frame) % options.NumTextures]);
+            }
+            bindless->UpdateDescriptorsIfNecessary();
+
+            float time = (float)frame / 60.0f;
+            for (uint32_t i = 0; i < options.NumDraws; i++)
+            {
+                float wobble = sinf(time + (float)i * 0.1f) * cellSize * 0.1f;
+                drawData[i].X = -1.0f + (float)(i % gridSize) * cellSize + wobble;
+                drawData[i].Y = -1.0f + (float)(i / gridSize) * cellSize;
+                drawData[i].Scale = cellSize;
+            }
+
+            core->QueueBufferUpload(drawBuffer, drawData.data(), drawDataSize, 0);
+            drawBuffer->Acquire(cb, VK::AccessFlags::ShaderRead, VK::PipelineStageFlags::VertexShader);
+
+            VK::RenderPass rp;
+            rp.ColorAttachment(target, VK::LoadOp::Clear, VK::StoreOp::Store);
+            drs.ApplyRenderArea(rp);
+            rp.Begin(cb);
+
+            cb.SetViewport(drs.GetViewport());
+            cb.SetScissor(drs.GetScissor());
+            cb.BindPipeline(pipeline);
+            cb.BindGraphicsDescriptorSet(pipelineLayout, &bindless->GetTextureDescriptorSet(), 0);
+            cb.BindGraphicsDescriptorSet(pipelineLayout, drawSet, 1);
+            cb.BindVertexBuffer(0, vertexBuffer, 0);
+
+            for (uint32_t i = 0; i < options.NumDraws; i++)
+            {
+                DrawConstants dc{ i, textureHandles[i % options.NumTextures] };
+                cb.PushConstants(dc, VK::ShaderStage::AllRaster, pipelineLayout);
+                cb.Draw(3, 1, 0, 0);
+            }
+
+            rp.End(cb);
+
+            if (capture && measuring)
+            {
+                capture->Capture(target);
+            }
+
+            profiler.EndZone(cb);
+            drs.EndFrame(cb);
+            core->EndFrame();
+
+            double frameEnd = Bench::GetTimeNs();
+
+            if (measuring)
+            {
+                frameTimes.push_back((frameEnd - frameStart) * 1e-6);
+                recordTimes.push_back((frameEnd - recordStart) * 1e-6);
+
+                float scale = drs.GetScale();
+                minScale = std::min(minScale, scale);
+                maxScale = std::max(maxScale, scale);
+                scaleTotal += scale;
+
+                if (lastRenderWidth != 0 && drs.GetRenderWidth() != lastRenderWidth)
+                    resolutionChanges++;
+            }
+
+            lastRenderWidth = drs.GetRenderWidth();
+        }
+
+        if (capture)
+        {
+            capture->Flush();
+        }
+
+        core->WaitIdle();
+        VK::MetricsSnapshot metricsAfter = core->GetTotalMetrics();
+
+        // Report
+        // ======
+        fprintf(out, "{\"device\":");
+        Bench::WriteJSONString(out, core->GetDeviceInfo().Name);
+        fprintf(out, ",\"draws\":%u,\"textures\":%u,\"churn\":%u,\"frames\":%u,\"width\":%u,\"height\":%u,\n",
+            options.NumDraws, options.NumTextures, options.TexturesChurnedPerFrame, options.NumFrames,
+            options.Width, options.Height);
+        // Wall time per frame, including waiting for the frame in flight to retire
+        writePercentiles(out, "cpu_frame_ms", frameTimes);
+        fprintf(out, ",\n");
+        // Time from BeginFrame returning to EndFrame returning
+        writePercentiles(out, "cpu_record_ms", recordTimes);
+        fprintf(out, ",\n");
+        writePercentiles(out, "gpu_ms", gpuTimes);
+        fprintf(out, ",\n\"scale\":{\"min\":%.3f,\"mean\":%.3f,\"max\":%.3f,\"resolution_changes\":%u},\n",
+            minScale, scaleTotal / (double)options.NumFrames, maxScale, resolutionChanges);
+        if (capture)
+        {
+            fprintf(out, "\"capture\":{\"written\":%u,\"dropped\":%u,\"failed\":%u},\n",
+                capture->GetNumWritten(), capture->GetNumDropped(), capture->GetNumFailed());
+        }
+        fprintf(out, "\"metrics\":");
+        Bench::WriteMetricsJSON(out, metricsBefore, metricsAfter);
+        fprintf(out, "}\n");
+
+        // Teardown
+        // ========
+        for (uint32_t handle : textureHandles)
+        {
+            bindless->FreeTextureHandle(handle);
+        }
+
+        for (VK::Texture* texture : textures)
+            delete texture;
+
+        delete capture;
+        targetPool.Release(target);
+        delete bindless;
+        delete drawSet;
+        delete drawBuffer;
+        delete vertexBuffer;
+        delete pipeline;
+        delete pipelineLayout;
+        delete drawSetLayout;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    StressOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        fprintf(stderr, "Usage: %s [--draws N] [--textures N] [--churn N] [--frames N] [--warmup N]\n"
+                        "       [--size WxH] [--target-ms T] [--cycle-scale] [--capture <pattern>]\n"
+                        "       [--output <path>] [--validation]\n", argv[0]);
+        return 1;
+    }
+
+    if (options.NumTextures > BindlessTextureManager::NUM_TEXTURES)
+    {
+        fprintf(stderr, "Clamping --textures to the bindless capacity of %u\n", BindlessTextureManager::NUM_TEXTURES);
+        options.NumTextures = BindlessTextureManager::NUM_TEXTURES;
+    }
+    options.TexturesChurnedPerFrame = std::min(options.TexturesChurnedPerFrame, options.NumTextures);
+
+    FILE* out = stdout;
+    if (options.OutputPath)
+    {
+        out = fopen(options.OutputPath, "w");
+        if (!out)
+        {
+            fprintf(stderr, "Couldn't open %s\n", options.OutputPath);
+            return 1;
+        }
+    }
+
+    Bench::StderrOutputReceiver receiver;
+    VK::CoreCreateInfo coreCreateInfo{};
+    coreCreateInfo.DebugOutputReceiver = &receiver;
+    coreCreateInfo.EnableValidation = options.Validation;
+    coreCreateInfo.Headless = true;
+    VK::Core* core = new VK::Core(coreCreateInfo);
+
+    runStress(core, options, out);
+
+    delete core;
+
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <R2/VKMemoryReport.hpp>
+
+#define VK_DEFINE_HANDLE(object) typedef struct object##_T* object;
+VK_DEFINE_HANDLE(VmaAllocation)
+#undef VK_DEFINE_HANDLE
+
+namespace R2::VK
+{
+    // Live allocations are tracked here so BuildMemoryReport can find them.
+    // Registering an allocation again changes its category. Allocations have
+    // to be unregistered before they're freed.
+    void registerAllocation(VmaAllocation allocation, MemoryCategory category);
+    void unregisterAllocation(VmaAllocation allocation);
+
+    // VMA doesn't expose this, so it's defined alongside the implementation
+    bool isDedicatedAllocation(VmaAllocation allocation);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <volk.h>
+#include <RefCountedCache.hpp>
+
+namespace R2::VK
+{
+    struct Handles;
+
+    // Makes identical descriptor set layouts and pipeline layouts share one
+    // Vulkan object. The wrapper classes stay separate so they can still be
+    // deleted individually; the native handle goes away with the last one.
+    class LayoutCache
+    {
+    public:
+        LayoutCache(const Handles* handles);
+        ~LayoutCache();
+        VkDescriptorSetLayout AcquireDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& createInfo);
+        VkPipelineLayout AcquirePipelineLayout(const VkPipelineLayoutCreateInfo& createInfo);
+        void Release(VkDescriptorSetLayout layout);
+        void Release(VkPipelineLayout layout);
+    private:
+        const Handles* handles;
+        RefCountedCache<VkDescriptorSetLayout> setLayouts;
+        RefCountedCache<VkPipelineLayout> pipelineLayouts;
+    };
+
+    extern LayoutCache* g_layoutCache;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <stdint.h>
+#include <assert.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace R2::VK
+{
+    // Shares Vulkan objects between identical create infos. Keys are the raw
+    // bytes of a description rather than just its hash, so two different
+    // descriptions can never end up with the same object.
+    template <typename Handle>
+    class RefCountedCache
+    {
+    public:
+        // Returns the existing handle for the key, or calls create() to make one.
+        template <typename CreateFunc>
+        Handle Acquire(const std::string& key, CreateFunc create)
+        {
+            std::lock_guard lock{mutex};
+            auto it = entries.find(key);
+
+            if (it != entries.end())
+            {
+                it->second.RefCount++;
+                return it->second.Object;
+            }
+
+            Handle h = create();
+            entries.insert({ key, Entry{ h, 1 } });
+            keys.insert({ h, key });
+            return h;
+        }
+
+        // Returns true when the caller should destroy the handle, either because this
+        // was the last reference or because the cache never knew about it.
+        bool Release(Handle h)
+        {
+            std::lock_guard lock{mutex};
+            auto keyIt = keys.find(h);
+
+            if (keyIt == keys.end())
+                return true;
+
+            auto entryIt = entries.find(keyIt->second);
+            if (--entryIt->second.RefCount > 0)
+                return false;
+
+            entries.erase(entryIt);
+            keys.erase(keyIt);
+            return true;
+        }
+
+        // Adds a reference to a handle the cache already holds
+        void AddRef(Handle h)
+        {
+            std::lock_guard lock{mutex};
+            auto keyIt = keys.find(h);
+            assert(keyIt != keys.end());
+            entries.find(keyIt->second)->second.RefCount++;
+        }
+
+        // Gets the key a handle was created with. Returns false if the cache doesn't know about it.
+        bool GetKey(Handle h, std::string& key)
+        {
+            std::lock_guard lock{mutex};
+            auto keyIt = keys.find(h);
+
+            if (keyIt == keys.end())
+                return false;
+
+            key = keyIt->second;
+            return true;
+        }
+
+        template <typename DestroyFunc>
+        void Clear(DestroyFunc destroy)
+        {
+            std::lock_guard lock{mutex};
+            for (auto& pair : entries)
+            {
+                destroy(pair.second.Object);
+            }
+
+            entries.clear();
+            keys.clear();
+        }
+
+        size_t Size()
+        {
+            std::lock_guard lock{mutex};
+            return entries.size();
+        }
+    private:
+        struct Entry
+        {
+            Handle Object;
+            uint32_t RefCount;
+        };
+
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        std::unordered_map<Handle, std::string> keys;
+    };
+
+    template <typename T>
+    inline void appendCacheKey(std::string& key, const T& value)
+    {
+        key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+}
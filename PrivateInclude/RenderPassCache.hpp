@@ -1,151 +1,132 @@
 #pragma once
 #include <stdint.h>
+#include <string.h>
+#include <mutex>
+#include <atomic>
 #include <unordered_map>
 #include <volk.h>
+#include <R2/VKRenderPass.hpp>
 
 namespace R2::VK
 {
+    const uint32_t MAX_RENDER_PASS_COLOR_ATTACHMENTS = 4;
+    // Every color and depth attachment can have a resolve attachment
+    const uint32_t MAX_FRAMEBUFFER_ATTACHMENTS = (MAX_RENDER_PASS_COLOR_ATTACHMENTS + 1) * 2;
+
+    // The keys below are hashed and compared as raw bytes, so every member is
+    // 4 bytes wide (or explicitly padded) and they must be value-initialized.
     struct RenderPassAttachment
     {
         VkFormat format;
         VkAttachmentLoadOp loadOp;
         VkAttachmentStoreOp storeOp;
         VkSampleCountFlagBits samples;
-
-        bool operator==(const RenderPassAttachment& other) const
-        {
-            return
-                format == other.format &&
-                loadOp == other.loadOp &&
-                storeOp == other.storeOp &&
-                samples == other.samples;
-        }
     };
-    
+
     struct RenderPassKey
     {
         uint32_t viewMask;
-        bool useDepth : 1;
-        bool useColor : 1;
+        uint32_t useDepth;
+        uint32_t numColorAttachments;
+        // Bit i is set if color attachment i is resolved
+        uint32_t colorResolveMask;
+        // A VkResolveModeFlagBits, or 0 if depth isn't resolved
+        uint32_t depthResolveMode;
+        // 0 for a single subpass writing every color attachment. Otherwise
+        // the SubpassInfo masks for each subpass, with the rest zeroed.
+        uint32_t numSubpasses;
+        uint32_t subpassColorMasks[MAX_SUBPASSES];
+        uint32_t subpassInputMasks[MAX_SUBPASSES];
         RenderPassAttachment depthAttachment;
-        RenderPassAttachment colorAttachment;
-
-        bool operator==(const RenderPassKey& other) const
-        {
-            return
-                viewMask == other.viewMask &&
-                useDepth == other.useDepth &&
-                useColor == other.useColor &&
-                depthAttachment == other.depthAttachment &&
-                colorAttachment == other.colorAttachment;
-        }
+        RenderPassAttachment colorAttachments[MAX_RENDER_PASS_COLOR_ATTACHMENTS];
     };
 
     struct FramebufferKey
     {
-        uint32_t width, height;
         VkRenderPass renderPass;
-        VkFormat textureFormats[2];
-        VkImageUsageFlags textureUsages[2];
-        VkImageCreateFlags textureFlags[2];
-        uint8_t numTextures;
-        uint8_t layerCount;
-
-        bool operator==(const FramebufferKey& other) const
-        {
-            if (numTextures != other.numTextures) return false;
-            bool formatsMatch = true;
-            
-            for (int i = 0; i < numTextures; i++)
-            {
-                formatsMatch &= textureFormats[i] == other.textureFormats[i];
-                formatsMatch &= textureUsages[i] == other.textureUsages[i];
-                formatsMatch &= textureFlags[i] == other.textureFlags[i];
-            }
-            
-            return
-                formatsMatch &&
-                width == other.width &&
-                height == other.height &&
-                renderPass == other.renderPass &&
-                layerCount == other.layerCount;
-        }
+        uint32_t width, height;
+        VkFormat textureFormats[MAX_FRAMEBUFFER_ATTACHMENTS];
+        VkImageUsageFlags textureUsages[MAX_FRAMEBUFFER_ATTACHMENTS];
+        VkImageCreateFlags textureFlags[MAX_FRAMEBUFFER_ATTACHMENTS];
+        uint32_t numTextures;
+        uint32_t layerCount;
     };
-}
 
-template <class T>
-inline void hash_combine(std::size_t & s, const T & v)
-{
-    std::hash<T> h;
-    s^= h(v) + 0x9e3779b9 + (s<< 6) + (s>> 2);
-}
+    static_assert(sizeof(RenderPassKey) == sizeof(uint32_t) * (6 + 2 * MAX_SUBPASSES + 4 * (MAX_RENDER_PASS_COLOR_ATTACHMENTS + 1)));
+    static_assert(sizeof(FramebufferKey) == sizeof(VkRenderPass) + sizeof(uint32_t) * (4 + 3 * MAX_FRAMEBUFFER_ATTACHMENTS));
 
-namespace std
-{
-    template<>
-    struct hash<R2::VK::RenderPassAttachment>
+    template <typename T>
+    struct FlatKeyHash
     {
-        std::size_t operator()(const R2::VK::RenderPassAttachment& c) const
+        size_t operator()(const T& key) const
         {
-            std::size_t result = 0;
-            hash_combine(result, c.format);
-            hash_combine(result, c.loadOp);
-            hash_combine(result, c.storeOp);
-            hash_combine(result, c.samples);
-            return result;
-        }
-    };
-    
-    template<>
-    struct hash<R2::VK::RenderPassKey>
-    {
-        std::size_t operator()(const R2::VK::RenderPassKey& c) const
-        {
-            std::size_t result = 0;
-            hash_combine(result, c.viewMask);
-            hash_combine(result, c.useColor);
-            hash_combine(result, c.useDepth);
-            hash_combine(result, c.colorAttachment);
-            hash_combine(result, c.depthAttachment);
-            return result;
+            // FNV-1a
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&key);
+            uint64_t hash = 14695981039346656037ULL;
+
+            for (size_t i = 0; i < sizeof(T); i++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+
+            return (size_t)hash;
         }
     };
-    
-    template<>
-    struct hash<R2::VK::FramebufferKey>
+
+    template <typename T>
+    struct FlatKeyEqual
     {
-        std::size_t operator()(const R2::VK::FramebufferKey& c) const
+        bool operator()(const T& a, const T& b) const
         {
-            std::size_t result = 0;
-            hash_combine(result, c.width);
-            hash_combine(result, c.height);
-            hash_combine(result, c.renderPass);
-            hash_combine(result, c.numTextures);
-            hash_combine(result, c.layerCount);
-
-            for (int i = 0; i < c.numTextures; i++)
-            {
-                hash_combine(result, c.textureFormats[i]);
-                hash_combine(result, c.textureUsages[i]);
-                hash_combine(result, c.textureFlags[i]);
-            }
-            return result;
+            return memcmp(&a, &b, sizeof(T)) == 0;
         }
     };
-}
 
-namespace R2::VK
-{
     class Core;
+    class DeletionQueue;
+
+    // Only used when dynamic rendering isn't available. Render passes live until
+    // the cache is destroyed; framebuffers are evicted once they haven't been
+    // used for a while, or when there are too many of them.
     class RenderPassCache
     {
     public:
         RenderPassCache(Core* core);
-        VkRenderPass GetPass(RenderPassKey key);
-        VkFramebuffer GetFramebuffer(FramebufferKey key);
+        ~RenderPassCache();
+        VkRenderPass GetPass(const RenderPassKey& key);
+        VkFramebuffer GetFramebuffer(const FramebufferKey& key);
+        // Called once per frame after the frame's deletion queue has been cleaned up
+        void EvictFramebuffers(DeletionQueue* dq);
     private:
-        std::unordered_map<RenderPassKey, VkRenderPass> passes;
-        std::unordered_map<FramebufferKey, VkFramebuffer> framebuffers;
+        static const uint32_t NUM_SHARDS = 8;
+        static const uint64_t FRAMEBUFFER_MAX_UNUSED_FRAMES = 120;
+        static const size_t MAX_FRAMEBUFFERS = 128;
+
+        struct FramebufferEntry
+        {
+            VkFramebuffer framebuffer;
+            uint64_t lastUsedFrame;
+        };
+
+        template <typename Key, typename Value>
+        struct Shard
+        {
+            std::mutex mutex;
+            std::unordered_map<Key, Value, FlatKeyHash<Key>, FlatKeyEqual<Key>> entries;
+        };
+
+        template <typename Key, typename Value>
+        static Shard<Key, Value>& getShard(Shard<Key, Value>* shards, const Key& key, size_t& hash)
+        {
+            hash = FlatKeyHash<Key>{}(key);
+            return shards[hash % NUM_SHARDS];
+        }
+
+        Shard<RenderPassKey, VkRenderPass> passShards[NUM_SHARDS];
+        Shard<FramebufferKey, FramebufferEntry> framebufferShards[NUM_SHARDS];
+        // Written by EvictFramebuffers() while other threads look up framebuffers
+        std::atomic<uint64_t> frameCounter = 0;
         Core* core;
     };
     extern RenderPassCache* g_renderPassCache;
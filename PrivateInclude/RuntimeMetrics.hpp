@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <R2/VKMetrics.hpp>
+
+namespace R2::VK
+{
+    // Running totals of every counter since startup. Gauges aren't stored
+    // here; they're worked out when a snapshot is taken.
+    extern std::atomic<uint64_t> g_metricTotals[(uint32_t)Metric::Count];
+
+    inline void countMetric(Metric metric, uint64_t amount = 1)
+    {
+        g_metricTotals[(uint32_t)metric].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    // For one pipeline barrier or event wait command
+    inline void countBarriers(uint64_t numBarriers)
+    {
+        countMetric(Metric::Barriers, numBarriers);
+        countMetric(Metric::BarrierCommands);
+    }
+}
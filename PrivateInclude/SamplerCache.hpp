@@ -0,0 +1,9 @@
+#pragma once
+#include <volk.h>
+#include <RefCountedCache.hpp>
+
+namespace R2::VK
+{
+    // Keyed on the SamplerBuilder's create info. Owned by Core.
+    extern RefCountedCache<VkSampler>* g_samplerCache;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <volk.h>
+
+namespace R2::VK
+{
+    // Entry points for extensions that are newer than our copy of volk. These get
+    // loaded by hand after device creation and stay null if the extension wasn't
+    // enabled (or the SDK headers we're building against don't know about it).
+    struct ExtensionFunctions
+    {
+#ifdef VK_EXT_shader_object
+        PFN_vkCreateShadersEXT CreateShadersEXT;
+        PFN_vkDestroyShaderEXT DestroyShaderEXT;
+        PFN_vkCmdBindShadersEXT CmdBindShadersEXT;
+        PFN_vkCmdSetPolygonModeEXT CmdSetPolygonModeEXT;
+        PFN_vkCmdSetRasterizationSamplesEXT CmdSetRasterizationSamplesEXT;
+        PFN_vkCmdSetSampleMaskEXT CmdSetSampleMaskEXT;
+        PFN_vkCmdSetAlphaToCoverageEnableEXT CmdSetAlphaToCoverageEnableEXT;
+        PFN_vkCmdSetColorBlendEnableEXT CmdSetColorBlendEnableEXT;
+        PFN_vkCmdSetColorBlendEquationEXT CmdSetColorBlendEquationEXT;
+        PFN_vkCmdSetColorWriteMaskEXT CmdSetColorWriteMaskEXT;
+#endif
+#ifdef VK_KHR_dynamic_rendering_local_read
+        PFN_vkCmdSetRenderingAttachmentLocationsKHR CmdSetRenderingAttachmentLocationsKHR;
+        PFN_vkCmdSetRenderingInputAttachmentIndicesKHR CmdSetRenderingInputAttachmentIndicesKHR;
+#endif
+    };
+
+    extern ExtensionFunctions g_extFuncs;
+    void loadExtensionFunctions(VkDevice device);
+}
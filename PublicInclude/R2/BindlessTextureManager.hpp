@@ -18,8 +18,12 @@ namespace R2
 
     class BindlessTextureManager
     {
+    public:
+        // Sizes of the texture (binding 1) and sampler (binding 0) arrays in the descriptor set
         static const uint32_t NUM_TEXTURES = 1024;
+        static const uint32_t NUM_SAMPLERS = 16;
 
+    private:
         std::mutex texturesMutex;
         std::array<VK::Texture*, NUM_TEXTURES> textures;
         std::array<VK::TextureView*, NUM_TEXTURES> textureViews;
@@ -30,7 +34,12 @@ namespace R2
         VK::DescriptorSetLayout* textureDescriptorSetLayout;
         VK::Core* core;
         VK::Sampler* sampler;
+        // Apart from the default sampler in slot 0, these are owned by the
+        // manager (see Sampler::Share) so they don't depend on the caller's wrapper
+        std::array<VK::Sampler*, NUM_SAMPLERS> samplers;
+        std::array<uint32_t, NUM_SAMPLERS> samplerRefCounts;
         bool descriptorsNeedUpdate = false;
+        bool samplersNeedUpdate = false;
 
         uint32_t FindFreeSlot();
     public:
@@ -43,6 +52,12 @@ namespace R2
         VK::Texture* GetTextureAt(uint32_t handle);
         void FreeTextureHandle(uint32_t handle);
 
+        // Samplers live in a small table at binding 0, with the default
+        // sampler at index 0. Samplers that share a VkSampler (see SamplerBuilder)
+        // also share a slot. The sampler can be deleted while its handle is still in use.
+        uint32_t AllocateSamplerHandle(VK::Sampler* sampler);
+        void FreeSamplerHandle(uint32_t handle);
+
         VK::DescriptorSet& GetTextureDescriptorSet();
         VK::DescriptorSetLayout& GetTextureDescriptorSetLayout();
         void UpdateDescriptorsIfNecessary();
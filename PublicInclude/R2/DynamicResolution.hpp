@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <R2/VKCommandBuffer.hpp>
+#include <R2/VKTexture.hpp>
+
+namespace R2
+{
+    namespace VK
+    {
+        class Core;
+        class RenderPass;
+        class TimestampPool;
+    }
+
+    struct DynamicResolutionSettings
+    {
+        // GPU time to aim for. Set this a bit below the frame budget, since
+        // the measurement doesn't include presentation.
+        float TargetFrameTimeMs = 14.0f;
+        // Limits on the render scale, per axis
+        float MinScale = 0.5f;
+        float MaxScale = 1.0f;
+        // Maximum change in scale per frame, to avoid visible popping
+        float MaxScaleChange = 0.05f;
+        // Ignore frame time differences smaller than this fraction of the target
+        float Deadband = 0.05f;
+        // Render dimensions are rounded down to a multiple of this
+        uint32_t Granularity = 8;
+    };
+
+    // Picks a render resolution every frame from the measured GPU frame time.
+    //
+    // Usage:
+    //   DynamicResolutionController drs(core, swapchainWidth, swapchainHeight);
+    //   VK::Texture* target = rtPool.Acquire(drs.MaxRenderTargetInfo(VK::TextureFormat::R16G16B16A16_SFLOAT));
+    //   ...every frame:
+    //   drs.BeginFrame(cb);
+    //   VK::RenderPass rp;
+    //   rp.ColorAttachment(target, ...);
+    //   drs.ApplyRenderArea(rp);
+    //   rp.Begin(cb);
+    //   cb.SetViewport(drs.GetViewport());
+    //   cb.SetScissor(drs.GetScissor());
+    //   ...
+    //   drs.EndFrame(cb);
+    //
+    // Render targets are always allocated at the maximum resolution and only
+    // the top left region is rendered to, so changing the scale never creates
+    // textures or framebuffers. Shaders sampling the targets need to multiply
+    // their UVs by GetUVScale().
+    class DynamicResolutionController
+    {
+    public:
+        DynamicResolutionController(VK::Core* core, uint32_t maxWidth, uint32_t maxHeight,
+            const DynamicResolutionSettings& settings = DynamicResolutionSettings{});
+        ~DynamicResolutionController();
+
+        // Should be recorded before any other GPU work in the frame. Reads back
+        // the timing of the last frame that used the same frame in flight and
+        // updates the scale.
+        void BeginFrame(VK::CommandBuffer cb);
+        // Should be recorded after all other GPU work in the frame
+        void EndFrame(VK::CommandBuffer cb);
+
+        // Call when the output size changes. Render targets from
+        // MaxRenderTargetInfo() have to be reacquired afterwards.
+        void SetMaxResolution(uint32_t maxWidth, uint32_t maxHeight);
+        void SetSettings(const DynamicResolutionSettings& settings);
+        // Pins the scale, disabling the controller. A negative value re-enables it.
+        void ForceScale(float scale);
+
+        float GetScale() const;
+        uint32_t GetRenderWidth() const;
+        uint32_t GetRenderHeight() const;
+        uint32_t GetMaxWidth() const;
+        uint32_t GetMaxHeight() const;
+        // Smoothed GPU frame time, or 0 if nothing has been measured yet
+        float GetGPUFrameTimeMs() const;
+        // Factor to convert UVs over the render area into UVs over the full target
+        void GetUVScale(float& x, float& y) const;
+
+        VK::Viewport GetViewport() const;
+        VK::ScissorRect GetScissor() const;
+        void ApplyRenderArea(VK::RenderPass& renderPass) const;
+        VK::TextureCreateInfo MaxRenderTargetInfo(VK::TextureFormat format) const;
+    private:
+        void updateScale(float frameTimeMs);
+        void updateRenderSize();
+
+        VK::Core* core;
+        VK::TimestampPool* timestampPool;
+        DynamicResolutionSettings settings;
+        uint32_t maxWidth;
+        uint32_t maxHeight;
+        uint32_t renderWidth;
+        uint32_t renderHeight;
+        float scale = 1.0f;
+        float forcedScale = -1.0f;
+        float smoothedFrameTimeMs = 0.0f;
+        // Bit i is set if frame in flight i has timestamps waiting to be read
+        uint32_t pendingFrames = 0;
+    };
+}
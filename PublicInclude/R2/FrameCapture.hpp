@@ -0,0 +1,105 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <R2/VKTexture.hpp>
+
+namespace R2
+{
+    namespace VK
+    {
+        class Core;
+    }
+
+    enum class CaptureFileFormat
+    {
+        // 8 bit RGBA, BGRA or single channel textures only. The image data
+        // is stored without compression.
+        PNG,
+        // The texture's bytes as they were read back, with no header
+        Raw
+    };
+
+    struct FrameCaptureCreateInfo
+    {
+        CaptureFileFormat Format = CaptureFileFormat::PNG;
+        // printf style pattern for the output files, given the capture index
+        // as an unsigned int, e.g. "frames/%05u.png"
+        const char* PathPattern = nullptr;
+        uint32_t NumWorkerThreads = 2;
+        // Frames that can be waiting on readback or disk at once. The
+        // buffers for them are reused, so this bounds the memory used.
+        uint32_t MaxQueuedFrames = 8;
+        // When the queue is full, Capture() either waits for a worker to
+        // finish a frame or drops the frame and returns false
+        bool DropWhenFull = false;
+    };
+
+    // Writes rendered frames to disk without making the GPU wait on it.
+    //
+    // Usage:
+    //   FrameCapture capture(core, createInfo);
+    //   ...every frame, after rendering to target:
+    //   capture.Capture(target);
+    //   core->EndFrame();
+    //   ...at the end:
+    //   capture.Flush();
+    //
+    // Each frame is read back with Core::QueueTextureReadback(). When the
+    // frame retires, the data is copied out of the readback ring and handed
+    // to the worker threads for encoding and writing. Backpressure is applied
+    // on the CPU in Capture(), never by waiting on the device.
+    class FrameCapture
+    {
+    public:
+        FrameCapture(VK::Core* core, const FrameCaptureCreateInfo& createInfo);
+        // Flushes, so it has to be destroyed outside a frame and before the Core
+        ~FrameCapture();
+
+        // Captures mip 0 of the first layer at the end of the current frame. Only
+        // that layer is read back, so array targets cost no more than 2D ones.
+        // Returns false if the frame was dropped.
+        bool Capture(VK::Texture* texture);
+        // Waits for the device and for every captured frame to be written
+        void Flush();
+
+        uint32_t GetNumCaptured() const;
+        uint32_t GetNumWritten() const;
+        uint32_t GetNumDropped() const;
+        uint32_t GetNumFailed() const;
+    private:
+        struct CapturedFrame
+        {
+            std::vector<uint8_t> Data;
+            uint32_t Index;
+            uint32_t Width;
+            uint32_t Height;
+            VK::TextureFormat Format;
+        };
+
+        void onReadback(CapturedFrame* frame, const void* data, uint64_t dataSize);
+        void workerLoop();
+        bool writeFrame(const CapturedFrame& frame);
+
+        VK::Core* core;
+        FrameCaptureCreateInfo createInfo;
+        std::vector<std::thread> workers;
+        std::vector<CapturedFrame*> frames;
+
+        mutable std::mutex mutex;
+        std::condition_variable workAvailable;
+        std::condition_variable frameFinished;
+        std::vector<CapturedFrame*> freeFrames;
+        std::deque<CapturedFrame*> encodeQueue;
+        uint32_t numEncoding = 0;
+        bool stopping = false;
+
+        uint32_t numCaptured = 0;
+        uint32_t numWritten = 0;
+        uint32_t numDropped = 0;
+        uint32_t numFailed = 0;
+    };
+}
@@ -1,6 +1,13 @@
 #pragma once
 #include <stdint.h>
 #include <string.h>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <R2/VKCommandBuffer.hpp>
+#include <R2/VKEnums.hpp>
+#include <R2/VKRenderPass.hpp>
+#include <R2/VKTexture.hpp>
 
 namespace R2
 {
@@ -8,10 +15,183 @@ namespace R2
     {
         struct TextureCreateInfo;
         struct BufferCreateInfo;
+        class AliasedMemory;
+        class Buffer;
+        class CommandPool;
+        class Core;
+        class MemoryPool;
     }
 
+    class RenderGraph;
+    class RenderGraphWorkerPool;
+
+    // One unit of work in a RenderGraph. Passes declare every texture and buffer
+    // they touch along with how they touch it, and the graph works out the barriers.
+    // Resources used by a pass are externally synchronized while it executes, so
+    // the Acquire calls inside RenderPass::Begin and the CommandBuffer copy helpers
+    // become no-ops for them.
+    class RenderGraphPass
+    {
+    public:
+        RenderGraphPass& ReadTexture(VK::Texture* tex, VK::ImageLayout layout, VK::AccessFlags access, VK::PipelineStageFlags stage);
+        // Overwrites the whole texture, so the previous contents don't matter
+        RenderGraphPass& WriteTexture(VK::Texture* tex, VK::ImageLayout layout, VK::AccessFlags access, VK::PipelineStageFlags stage);
+        RenderGraphPass& ReadWriteTexture(VK::Texture* tex, VK::ImageLayout layout, VK::AccessFlags access, VK::PipelineStageFlags stage);
+        RenderGraphPass& ReadBuffer(VK::Buffer* buf, VK::AccessFlags access, VK::PipelineStageFlags stage);
+        RenderGraphPass& WriteBuffer(VK::Buffer* buf, VK::AccessFlags access, VK::PipelineStageFlags stage);
+        RenderGraphPass& ReadWriteBuffer(VK::Buffer* buf, VK::AccessFlags access, VK::PipelineStageFlags stage);
+
+        // Shorthands for the common cases
+        RenderGraphPass& SampledTexture(VK::Texture* tex, VK::PipelineStageFlags stage = VK::PipelineStageFlags::FragmentShader);
+        RenderGraphPass& ColorAttachment(VK::Texture* tex, VK::LoadOp loadOp);
+        RenderGraphPass& DepthAttachment(VK::Texture* tex, VK::LoadOp loadOp);
+        // The target of RenderPass::ResolveAttachment or DepthResolveAttachment
+        RenderGraphPass& ResolveAttachment(VK::Texture* tex);
+        RenderGraphPass& TransferSource(VK::Texture* tex);
+        RenderGraphPass& TransferDestination(VK::Texture* tex);
+
+        // Never cull this pass, even if nothing reads what it writes
+        RenderGraphPass& SideEffects();
+        RenderGraphPass& Execute(std::function<void(VK::CommandBuffer)> callback);
+    private:
+        struct TextureUsage
+        {
+            VK::Texture* Texture;
+            VK::ImageLayout Layout;
+            VK::AccessFlags Access;
+            VK::PipelineStageFlags Stage;
+            bool Read;
+            bool Write;
+        };
+
+        struct BufferUsage
+        {
+            VK::Buffer* Buffer;
+            VK::AccessFlags Access;
+            VK::PipelineStageFlags Stage;
+            bool Read;
+            bool Write;
+        };
+
+        RenderGraphPass(const char* name);
+
+        const char* name;
+        bool hasSideEffects = false;
+        std::vector<TextureUsage> textureUsages;
+        std::vector<BufferUsage> bufferUsages;
+        std::function<void(VK::CommandBuffer)> callback;
+
+        friend class RenderGraph;
+    };
+
+    // Usage:
+    //   graph.AddPass("Shadows").DepthAttachment(shadowMap, VK::LoadOp::Clear).Execute(...);
+    //   graph.AddPass("Main").SampledTexture(shadowMap).ColorAttachment(target, VK::LoadOp::Clear).Execute(...);
+    //   graph.MarkOutput(target, VK::ImageLayout::PresentSrc, VK::AccessFlags::None, VK::PipelineStageFlags::AllCommands);
+    //   graph.Compile();
+    //   graph.Execute(cb);
+    //
+    // Passes are declared in submission order; that order defines what each read
+    // sees. Compile() culls passes that don't contribute to an output and
+    // reorders the rest to put distance between producers and consumers.
+    // Execute() emits one batched barrier per pass. A graph can be compiled
+    // once and executed every frame, as long as the declared resources stay alive.
+    //
+    // With parallel recording enabled, every barrier is still worked out up front
+    // on the calling thread, then groups of consecutive passes are recorded into
+    // secondary command buffers by worker threads and executed from the primary
+    // in order. Pass callbacks then run concurrently, so they mustn't share
+    // mutable state, have to bind all of their own state, and shouldn't touch
+    // resources the graph doesn't know about in a way that needs Acquire.
     class RenderGraph
     {
     public:
+        RenderGraph(VK::Core* core);
+        ~RenderGraph();
+        RenderGraphPass& AddPass(const char* name);
+
+        // Keeps the passes writing to this resource alive, and transitions it to
+        // the given state once the graph has finished executing
+        void MarkOutput(VK::Texture* tex, VK::ImageLayout layout, VK::AccessFlags access, VK::PipelineStageFlags stage);
+        void MarkOutput(VK::Buffer* buf, VK::AccessFlags access, VK::PipelineStageFlags stage);
+
+        // Transient resources are owned by the graph and only hold valid contents
+        // from the first pass that uses them to the last one, so they can't be
+        // outputs. Ones whose lifetimes don't overlap share memory, which is
+        // allocated by the first Compile(). They're destroyed by Reset().
+        VK::Texture* CreateTransientTexture(const VK::TextureCreateInfo& createInfo);
+        VK::Buffer* CreateTransientBuffer(const VK::BufferCreateInfo& createInfo);
+        // Where memory for transient resources comes from. Defaults to any device local heap.
+        void SetTransientMemoryPool(VK::MemoryPool* pool);
+        uint64_t GetTransientMemorySize();
+        // How much memory the transient resources would have needed without aliasing
+        uint64_t GetUnaliasedTransientMemorySize();
+
+        // Records passes on numWorkers threads, passesPerCommandBuffer at a time.
+        // Has no effect when dynamic rendering isn't available, since a render
+        // pass begun with vkCmdBeginRenderPass can't span command buffers. Zero
+        // workers goes back to recording everything on the calling thread.
+        void EnableParallelRecording(uint32_t numWorkers, uint32_t passesPerCommandBuffer = 4);
+
+        void Compile();
+        void Execute(VK::CommandBuffer cb);
+        void Reset();
+
+        uint32_t GetNumPasses();
+        uint32_t GetNumCulledPasses();
+    private:
+        struct TextureOutput
+        {
+            VK::Texture* Texture;
+            VK::ImageLayout Layout;
+            VK::AccessFlags Access;
+            VK::PipelineStageFlags Stage;
+        };
+
+        struct BufferOutput
+        {
+            VK::Buffer* Buffer;
+            VK::AccessFlags Access;
+            VK::PipelineStageFlags Stage;
+        };
+
+        struct TransientResource
+        {
+            VK::Texture* Texture;
+            VK::Buffer* Buffer;
+            VK::MemoryRequirements Requirements;
+            uint32_t Heap;
+            uint64_t Offset;
+            // Positions in the execution order. FirstUse > LastUse if unused.
+            int FirstUse;
+            int LastUse;
+            // Transient resources whose memory overlaps this one's
+            std::vector<uint32_t> Aliases;
+        };
+
+        void computeTransientLifetimes();
+        void allocateTransients();
+        void buildDependencies(const std::vector<bool>& included, std::vector<std::vector<uint32_t>>& orderDeps,
+            std::vector<std::vector<uint32_t>>* dataDeps, std::unordered_map<const void*, uint32_t>& lastWriters);
+        void recordPass(RenderGraphPass* pass, VK::CommandBuffer cb);
+        void destroyWorkers();
+
+        VK::Core* core;
+        std::vector<RenderGraphPass*> passes;
+        std::vector<TextureOutput> textureOutputs;
+        std::vector<BufferOutput> bufferOutputs;
+        std::vector<uint32_t> executionOrder;
+        std::vector<TransientResource> transients;
+        std::unordered_map<const void*, uint32_t> transientIndices;
+        std::vector<VK::AliasedMemory*> transientHeaps;
+        VK::MemoryPool* transientPool = nullptr;
+        uint64_t unaliasedTransientSize = 0;
+        bool compiled = false;
+
+        RenderGraphWorkerPool* workerPool = nullptr;
+        // One pool per worker per frame in flight, indexed [frame * numWorkers + worker]
+        std::vector<VK::CommandPool*> commandPools;
+        std::vector<uint64_t> commandPoolResetFrames;
+        uint32_t passesPerCommandBuffer = 4;
     };
-}
\ No newline at end of file
+}
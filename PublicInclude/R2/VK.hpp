@@ -2,11 +2,19 @@
 // Common includes for VK
 #include "VKBuffer.hpp"
 #include "VKCommandBuffer.hpp"
+#include "VKCommandPool.hpp"
 #include "VKCore.hpp"
 #include "VKDescriptorSet.hpp"
 #include "VKEnums.hpp"
 #include "VKFrameSeparatedBuffer.hpp"
+#include "VKGPUProfiler.hpp"
+#include "VKMemoryReport.hpp"
+#include "VKMetrics.hpp"
 #include "VKPipeline.hpp"
+#include "VKQueryPool.hpp"
 #include "VKRenderPass.hpp"
+#include "VKRenderTargetPool.hpp"
 #include "VKSampler.hpp"
-#include "VKTexture.hpp"
\ No newline at end of file
+#include "VKShaderObject.hpp"
+#include "VKTexture.hpp"
+#include "VKTraceRecorder.hpp"
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include <R2/VKMemoryPool.hpp>
 
 #define VK_DEFINE_HANDLE(object) typedef struct object##_T* object;
 VK_DEFINE_HANDLE(VkBuffer)
@@ -7,6 +8,11 @@ VK_DEFINE_HANDLE(VkCommandBuffer)
 VK_DEFINE_HANDLE(VmaAllocation)
 #undef VK_DEFINE_HANDLE
 
+namespace R2
+{
+    class RenderGraph;
+}
+
 namespace R2::VK
 {
     struct Handles;
@@ -35,6 +41,9 @@ namespace R2::VK
         BufferUsage Usage;
         uint64_t Size;
         bool Mappable;
+        // Create the buffer without memory; it has to be bound through
+        // AliasedMemory before it can be used
+        bool DeferMemoryBinding = false;
     };
 
     class Buffer
@@ -46,6 +55,7 @@ namespace R2::VK
 
         uint64_t GetSize();
         BufferUsage GetUsage();
+        MemoryRequirements GetMemoryRequirements();
         void* Map();
         void Unmap();
         void CopyTo(VkCommandBuffer cb, Buffer* other, uint64_t numBytes, uint64_t srcOffset, uint64_t dstOffset);
@@ -54,6 +64,8 @@ namespace R2::VK
 
         ~Buffer();
     private:
+        void bindMemory(VmaAllocation memory, uint64_t offset);
+
         Core* renderer;
         VkBuffer buffer;
         VmaAllocation allocation;
@@ -63,5 +75,12 @@ namespace R2::VK
         
         AccessFlags lastAccess;
         PipelineStageFlags lastPipelineStage;
+        // Set while a RenderGraph is handling barriers for this buffer
+        bool externallySynchronized = false;
+
+        friend class AliasedMemory;
+        friend class CommandBuffer;
+        friend class Core;
+        friend class R2::RenderGraph;
     };
 }
\ No newline at end of file
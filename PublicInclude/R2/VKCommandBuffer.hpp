@@ -128,7 +128,10 @@ namespace R2::VK
     class Event;
     class Pipeline;
     class PipelineLayout;
+    class ShaderObject;
+    class SplitBarrier;
     class Texture;
+    struct GraphicsState;
     enum class AccessFlags : uint64_t;
     enum class PipelineStageFlags : uint64_t;
 
@@ -147,6 +150,12 @@ namespace R2::VK
         void DrawIndexedIndirect(Buffer* buffer, uint64_t offset, uint32_t drawCount, uint32_t stride);
         void Draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance);
 
+        // Shader object path. Requires GraphicsSupportedFeatures::ShaderObject, and all the state
+        // that would be baked into a pipeline has to be set with SetGraphicsState before drawing.
+        void BindShaders(ShaderObject* vertex, ShaderObject* fragment);
+        void BindComputeShader(ShaderObject* compute);
+        void SetGraphicsState(const GraphicsState& state);
+
         void BindComputePipeline(Pipeline* p);
         void BindComputeDescriptorSet(PipelineLayout* pipelineLayout, DescriptorSet* descriptorSet, uint32_t setNumber);
         void Dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
@@ -171,12 +180,23 @@ namespace R2::VK
         void SetFragmentShadingRate(uint32_t fragWidth, uint32_t fragHeight, FragmentShadingRateCombineOp combineOps[2]);
 
         void SetEvent(Event* evt);
+        void SetEvent(Event* evt, PipelineStageFlags stage);
         void ResetEvent(Event* evt);
+        void ResetEvent(Event* evt, PipelineStageFlags stage);
+
+        // See SplitBarrier. Texture and buffer state is updated by the wait.
+        void SignalSplitBarrier(const SplitBarrier& barrier);
+        void WaitSplitBarrier(const SplitBarrier& barrier);
 
         void EndRendering();
 
+        // Only valid on primary command buffers
+        void ExecuteCommands(const CommandBuffer* secondaries, uint32_t count);
+
         VkCommandBuffer GetNativeHandle();
     private:
+        void recordSplitBarrier(const SplitBarrier& barrier, bool wait);
+
         VkCommandBuffer cb;
     };
 }
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <R2/VKCommandBuffer.hpp>
+
+#define VK_DEFINE_HANDLE(object) typedef struct object##_T* object;
+VK_DEFINE_HANDLE(VkCommandPool)
+VK_DEFINE_HANDLE(VkCommandBuffer)
+#undef VK_DEFINE_HANDLE
+
+namespace R2::VK
+{
+    class Core;
+
+    // A pool of secondary command buffers for recording off the main thread.
+    // Like any Vulkan command pool, it can only be used by one thread at a time.
+    // Command buffers are recycled by Reset(), which must only be called once
+    // the GPU has finished with them.
+    class CommandPool
+    {
+    public:
+        CommandPool(Core* core);
+        // Begins a secondary command buffer that's recorded outside of any render pass
+        CommandBuffer BeginSecondary();
+        void End(CommandBuffer cb);
+        void Reset();
+        ~CommandPool();
+    private:
+        Core* core;
+        VkCommandPool pool;
+        std::vector<VkCommandBuffer> commandBuffers;
+        uint32_t numUsed = 0;
+    };
+}
@@ -3,6 +3,8 @@
 #include <stdint.h>
 #include <vector>
 #include <mutex>
+#include <functional>
+#include <R2/VKMetrics.hpp>
 
 #define VK_DEFINE_HANDLE(object) typedef struct object##_T* object;
 VK_DEFINE_HANDLE(VmaAllocator)
@@ -17,6 +19,8 @@ VK_DEFINE_HANDLE(VkCommandBuffer)
 VK_DEFINE_HANDLE(VkSemaphore)
 VK_DEFINE_HANDLE(VkFence)
 VK_DEFINE_HANDLE(VkDescriptorPool)
+VK_DEFINE_HANDLE(VkSurfaceKHR)
+VK_DEFINE_HANDLE(VkBuffer)
 #undef VK_DEFINE_HANDLE
 
 struct VkDebugUtilsMessengerCallbackDataEXT;
@@ -76,6 +80,8 @@ namespace R2::VK
 	{
 		char Name[256];
 		float TimestampPeriod;
+		// Stable across runs, unlike the device index. See CoreCreateInfo::DeviceUUID.
+		uint8_t UUID[16];
 	};
 
 	struct GraphicsSupportedFeatures
@@ -83,8 +89,42 @@ namespace R2::VK
 		bool RayTracing;
 		bool VariableRateShading;
 		bool DynamicRendering;
+		bool ShaderObject;
+		bool DynamicRenderingLocalRead;
+		bool CalibratedTimestamps;
+		bool PipelineStatistics;
+		bool PreciseOcclusionQueries;
+		// Only in headless mode, see CoreCreateInfo::HeadlessSurface
+		bool HeadlessSurface;
 	};
 
+	struct CoreCreateInfo
+	{
+		IDebugOutputReceiver* DebugOutputReceiver = nullptr;
+		bool EnableValidation = false;
+		// Null terminated lists of additional extensions to enable
+		const char** InstanceExtensions = nullptr;
+		const char** DeviceExtensions = nullptr;
+		// Doesn't enable any window system extensions, so no display is needed.
+		// Frames are rendered into offscreen targets (e.g. from a RenderTargetPool)
+		// and nothing waits on the frame completion semaphore.
+		bool Headless = false;
+		// In headless mode, also enables VK_EXT_headless_surface if it's supported,
+		// so that swapchains can be created on CreateHeadlessSurface() in place of a
+		// window. Every frame then has to be presented, as it would with a window.
+		bool HeadlessSurface = false;
+		// Overrides the device selection, which otherwise prefers discrete GPUs and
+		// then the most device local memory. Either an index into the list from
+		// vkEnumeratePhysicalDevices, or a pointer to a 16 byte device UUID. If both
+		// are set, initialization fails unless they refer to the same device.
+		int DeviceIndex = -1;
+		const uint8_t* DeviceUUID = nullptr;
+	};
+
+	// Gets a pointer to the read back data in host cached memory, which is only
+	// valid for the duration of the call
+	typedef std::function<void(const void* data, uint64_t dataSize)> ReadbackCallback;
+
 	void onFailedVkCheck(int res, const char* file, int line);
 
 #define VKCHECK(res) { if (res != 0) { R2::VK::onFailedVkCheck(res, __FILE__, __LINE__); } }
@@ -94,6 +134,7 @@ namespace R2::VK
 	public:
 		Core(IDebugOutputReceiver* dbgOutRecv = nullptr, bool enableValidation = false,
              const char** instanceExts = nullptr, const char** deviceExts = nullptr);
+		Core(const CoreCreateInfo& createInfo);
 
 		const GraphicsDeviceInfo& GetDeviceInfo() const;
 		const GraphicsSupportedFeatures& GetSupportedFeatures() const;
@@ -107,6 +148,11 @@ namespace R2::VK
 
 		Swapchain* CreateSwapchain(const SwapchainCreateInfo& createInfo);
 		void DestroySwapchain(Swapchain* swapchain);
+		bool IsHeadless() const;
+		// Requires GraphicsSupportedFeatures::HeadlessSurface. Headless surfaces have no
+		// size of their own, so swapchains on them take it from SwapchainCreateInfo.
+		VkSurfaceKHR CreateHeadlessSurface();
+		void DestroySurface(VkSurfaceKHR surface);
 
 		DescriptorSet* CreateDescriptorSet(DescriptorSetLayout* dsl);
 		DescriptorSet* CreateDescriptorSet(DescriptorSetLayout* dsl, uint32_t maxVariableDescriptors);
@@ -118,10 +164,26 @@ namespace R2::VK
 		void QueueBufferUpload(Buffer* buffer, const void* data, uint64_t dataSize, uint64_t dataOffset);
 		void QueueBufferToTextureCopy(Buffer* buffer, Texture* texture, uint64_t bufferOffset = 0);
 		void QueueTextureUpload(Texture* texture, void* data, uint64_t dataSize, int numMips = -1);
+		// Copies are recorded at the end of the frame's command buffer. The callback runs from
+		// BeginFrame() once that frame has retired on the GPU, so there's no wait for the device.
+		// The source has to stay alive until EndFrame().
+		void QueueBufferReadback(Buffer* buffer, uint64_t dataSize, uint64_t dataOffset, ReadbackCallback callback);
+		// Reads back one mip level, tightly packed. A layer of -1 gives every layer (or depth slice
+		// for 3D textures). Cube faces are layers, in the usual +X, -X, +Y, -Y, +Z, -Z order.
+		void QueueTextureReadback(Texture* texture, ReadbackCallback callback, int mipLevel = 0, int layer = -1);
+		// Waits for the device, then runs the callbacks of everything submitted
+		// so far. Only meant for the end of a run.
+		void FlushReadbacks();
 		uint32_t GetFrameIndex() const;
 		uint32_t GetNextFrameIndex() const;
 		uint32_t GetPreviousFrameIndex() const;
 		uint32_t GetNumFramesInFlight() const;
+		// Incremented by every BeginFrame()
+		uint64_t GetFrameNumber() const;
+		// Metrics for the last completed frame, taken by BeginFrame()
+		const MetricsSnapshot& GetFrameMetrics() const;
+		// Counter totals since startup, along with the current gauge values
+		MetricsSnapshot GetTotalMetrics() const;
 		void EndFrame();
 
 		void WaitIdle();
@@ -146,6 +208,24 @@ namespace R2::VK
 			int numMips;
 		};
 
+		struct Readback
+		{
+			Buffer* Buffer;
+			Texture* Texture;
+			int MipLevel;
+			// -1 for every layer
+			int Layer;
+			uint64_t SourceOffset;
+			uint64_t DataSize;
+			ReadbackCallback Callback;
+			// Set when the readback is recorded. Readbacks that don't fit in
+			// the ring get their own buffer, which is freed after the callback.
+			uint64_t RingOffset;
+			VkBuffer DedicatedBuffer;
+			VmaAllocation DedicatedAllocation;
+			char* DedicatedMapped;
+		};
+
 		struct PerFrameResources
 		{
 			VkCommandBuffer CommandBuffer;
@@ -161,13 +241,26 @@ namespace R2::VK
 			uint64_t StagingOffset;
 			Buffer* StagingBuffer;
 			char* StagingMapped;
+
+			std::vector<Readback> Readbacks;
+			std::vector<Readback> SubmittedReadbacks;
+			// Host cached and persistently mapped, created on first use
+			VkBuffer ReadbackBuffer;
+			VmaAllocation ReadbackAllocation;
+			char* ReadbackMapped;
 		};
 
 		void writeFrameUploadCommands(uint32_t index, VkCommandBuffer cb);
+		char* createReadbackBuffer(uint64_t size, VkBuffer* buffer, VmaAllocation* allocation);
+		uint32_t getReadbackDepth(Texture* texture, int mipLevel);
+		void writeFrameReadbackCommands(uint32_t index, VkCommandBuffer cb);
+		void completeFrameReadbacks(uint32_t index);
 
 		void setAllocCallbacks();
+		bool checkInstanceExtensionSupport(const char* extension);
 		void createInstance(bool enableValidation, const char** instanceExts);
-		void selectPhysicalDevice();
+		void selectPhysicalDevice(int deviceIndex, const uint8_t* deviceUUID);
+		int64_t scorePhysicalDevice(VkPhysicalDevice device);
 		void findQueueFamilies();
 		bool checkFeatures(VkPhysicalDevice device);
 		bool checkExtensionSupport(VkPhysicalDevice device, const char* extension);
@@ -186,14 +279,22 @@ namespace R2::VK
 		IDebugOutputReceiver* dbgOutRecv;
 		PerFrameResources perFrameResources[2];
 		uint32_t frameIndex;
+		uint64_t frameNumber;
 		bool inFrame;
+		bool headless;
 		std::mutex queueMutex;
+		MetricsSnapshot frameMetrics{};
+		MetricsSnapshot previousMetricTotals{};
 
+		friend class AliasedMemory;
 		friend class Buffer;
+		friend class CommandPool;
 		friend class DescriptorSet;
         friend class Event;
 		friend class Pipeline;
+		friend class QueryPool;
 		friend class Sampler;
+		friend class ShaderObject;
 		friend class Texture;
 		friend class TextureView;
 		friend class MemoryPool;
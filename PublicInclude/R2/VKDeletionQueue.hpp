@@ -1,6 +1,7 @@
 #pragma once
 #include <stdint.h>
 #include <vector>
+#include <mutex>
 
 #define VK_DEFINE_HANDLE(object) typedef struct object##_T* object;
 VK_DEFINE_HANDLE(VmaAllocator)
@@ -31,6 +32,7 @@ namespace R2::VK
         void QueueDescriptorSetFree(VkDescriptorPool pool, VkDescriptorSet ds);
 #endif
         void Cleanup();
+        size_t GetNumQueued() const;
     private:
         const Handles* handles;
 
@@ -76,6 +78,9 @@ namespace R2::VK
         std::vector<MemoryFree> memoryFrees;
         std::vector<PoolDeletion> poolDeletions;
         std::vector<DescriptorSetFree> dsFrees;
+        // Objects can be destroyed from any thread, and the metrics read the
+        // counts while the frame is being recorded
+        mutable std::mutex mutex;
 
         void processObjectDeletion(const ObjectDeletion& od);
         void processMemoryFree(const MemoryFree& mf);
@@ -6,6 +6,9 @@ namespace R2::VK
     enum class ShaderStage
     {
         Vertex = 0x1,
+        TessellationControl = 0x2,
+        TessellationEvaluation = 0x4,
+        Geometry = 0x8,
         Fragment = 0x10,
         Compute = 0x20,
         AllRaster = Vertex | Fragment
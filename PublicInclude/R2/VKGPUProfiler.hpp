@@ -0,0 +1,97 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <R2/VKCommandBuffer.hpp>
+
+namespace R2::VK
+{
+    class Core;
+    class TimestampPool;
+
+    // Measures named, nested regions of GPU work using timestamp queries.
+    // Each frame in flight gets its own range of queries, which is read back
+    // without waiting once BeginFrame() comes round to that frame again, so
+    // results lag a couple of frames behind. Zone names must stay valid
+    // until then; string literals are the intended use.
+    //
+    // Zones have to be recorded into the frame's primary command buffer from
+    // a single thread, since nesting is tracked with one stack.
+    class GPUProfiler
+    {
+    public:
+        struct Zone
+        {
+            const char* Name;
+            // Index of the enclosing zone in the results, or ~0u for top level zones
+            uint32_t Parent;
+            uint32_t Depth;
+            // Relative to the start of the first zone in the frame
+            double StartMs;
+            double DurationMs;
+        };
+
+        GPUProfiler(Core* core, uint32_t maxZonesPerFrame = 256);
+        ~GPUProfiler();
+
+        // Must be recorded before any zones in the frame
+        void BeginFrame(CommandBuffer cb);
+        void BeginZone(CommandBuffer cb, const char* name);
+        void EndZone(CommandBuffer cb);
+
+        // Zones are disabled entirely when false, apart from the debug labels
+        void SetEnabled(bool enabled);
+        bool IsEnabled() const;
+
+        // The most recent frame with results, as a tree flattened in the order
+        // the zones began. Parents always come before their children.
+        const std::vector<Zone>& GetResults() const;
+        // The Core frame number the results came from
+        uint64_t GetResultsFrameNumber() const;
+        // Raw GPU timestamp that the results' StartMs values are relative to
+        uint64_t GetResultsStartTimestamp() const;
+    private:
+        struct PendingZone
+        {
+            const char* Name;
+            uint32_t Parent;
+            uint32_t Depth;
+        };
+
+        struct FrameQueries
+        {
+            std::vector<PendingZone> Zones;
+            uint64_t FrameNumber;
+        };
+
+        void readResults(FrameQueries& frame, uint32_t queryOffset);
+
+        Core* core;
+        TimestampPool* timestampPool;
+        uint32_t maxZonesPerFrame;
+        bool enabled = true;
+        std::vector<FrameQueries> frames;
+        // Zone indices of the open zones, with ~0u for ones that didn't fit
+        std::vector<uint32_t> zoneStack;
+        std::vector<uint64_t> timestampScratch;
+        std::vector<Zone> results;
+        uint64_t resultsFrameNumber = 0;
+        uint64_t resultsStartTimestamp = 0;
+    };
+
+    // Usage:
+    //   {
+    //       VK::ProfileScope scope{ profiler, cb, "Shadows" };
+    //       ...
+    //   }
+    class ProfileScope
+    {
+    public:
+        ProfileScope(GPUProfiler* profiler, CommandBuffer cb, const char* name);
+        ~ProfileScope();
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+    private:
+        GPUProfiler* profiler;
+        CommandBuffer cb;
+    };
+}
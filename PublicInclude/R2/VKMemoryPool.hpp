@@ -4,11 +4,14 @@
 
 #define VK_DEFINE_HANDLE(object) typedef struct object##_T* object;
 VK_DEFINE_HANDLE(VmaPool)
+VK_DEFINE_HANDLE(VmaAllocation)
 #undef VK_DEFINE_HANDLE
 
 namespace R2::VK
 {
+    class Buffer;
     class Core;
+    class Texture;
     
     struct MemoryPoolCreateInfo
     {
@@ -37,4 +40,30 @@ namespace R2::VK
         Core* core;
         VmaPool pool;
     };
+
+    struct MemoryRequirements
+    {
+        uint64_t Size;
+        uint64_t Alignment;
+        uint32_t MemoryTypeBits;
+    };
+
+    // A single allocation that textures and buffers created with DeferMemoryBinding
+    // are placed into at fixed offsets. Resources placed at overlapping ranges alias
+    // each other, so only one of them can hold valid contents at a time and switching
+    // between them needs a barrier that discards the old contents.
+    class AliasedMemory
+    {
+    public:
+        // pool can be null, in which case the memory comes from a device local heap
+        AliasedMemory(Core* core, MemoryPool* pool, const MemoryRequirements& requirements);
+        void Bind(Texture* tex, uint64_t offset);
+        void Bind(Buffer* buf, uint64_t offset);
+        uint64_t GetSize() const { return size; }
+        ~AliasedMemory();
+    private:
+        Core* core;
+        VmaAllocation allocation;
+        uint64_t size;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace R2::VK
+{
+    class Core;
+
+    enum class MemoryCategory : uint32_t
+    {
+        Texture,
+        Buffer,
+        // Core's upload staging and readback buffers
+        Staging,
+        // Raw allocations from AliasedMemory, including RenderGraph transient heaps
+        Pool,
+        Count
+    };
+
+    struct MemoryReportEntry
+    {
+        // Debug name up to the first separator, or "<unnamed>"
+        std::string NamePrefix;
+        MemoryCategory Category;
+        uint64_t Bytes;
+        uint32_t NumAllocations;
+        // Allocations with their own VkDeviceMemory, as opposed to
+        // suballocations from a larger block
+        uint32_t NumDedicated;
+    };
+
+    struct MemoryReport
+    {
+        // Sorted by size, largest first
+        std::vector<MemoryReportEntry> Entries;
+        uint64_t CategoryBytes[(uint32_t)MemoryCategory::Count];
+        uint64_t TotalBytes;
+    };
+
+    // Groups every live allocation made by R2 by category and debug name
+    // prefix. Names come from Buffer::SetDebugName and Texture::SetDebugName.
+    // With the default separator, "Shadows/Cascade0" and "Shadows/Cascade1"
+    // are reported together as "Shadows".
+    MemoryReport BuildMemoryReport(Core* core, char prefixSeparator = '/');
+    const char* GetMemoryCategoryName(MemoryCategory category);
+
+    // Writes VMA's JSON statistics, which include every allocation when
+    // detailed is set. Returns false if the file couldn't be written.
+    bool WriteMemoryStatsJSON(Core* core, const char* path, bool detailed = true);
+}
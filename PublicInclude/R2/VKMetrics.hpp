@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+
+namespace R2::VK
+{
+    enum class Metric : uint32_t
+    {
+        // Counters, reported as the amount during the frame
+        BytesStaged,
+        Uploads,
+        // Staging buffer ran out mid-frame and had to be flushed with a wait
+        StagingFlushes,
+        // Uploads too big for the staging buffer, which wait for the GPU
+        OversizedUploads,
+        Readbacks,
+        BytesReadBack,
+        // Times the CPU waited for the whole device to go idle
+        IdleWaits,
+        Barriers,
+        BarrierCommands,
+        DescriptorWrites,
+        DescriptorSetsAllocated,
+        DescriptorSetsFreed,
+        PipelinesCreated,
+        ShaderObjectsCreated,
+        RenderPassCacheHits,
+        RenderPassCacheMisses,
+        FramebufferCacheHits,
+        FramebufferCacheMisses,
+
+        // Gauges, reported as their value when the snapshot was taken
+        LiveDescriptorSets,
+        DeletionQueueDepth,
+
+        Count
+    };
+
+    struct MetricsSnapshot
+    {
+        uint64_t Get(Metric metric) const
+        {
+            return Values[(uint32_t)metric];
+        }
+
+        // Stable snake_case names for exporting
+        static const char* GetName(Metric metric);
+        static bool IsGauge(Metric metric);
+
+        // For per-frame snapshots, the frame the counters were collected over
+        uint64_t FrameNumber;
+        uint64_t Values[(uint32_t)Metric::Count];
+    };
+}
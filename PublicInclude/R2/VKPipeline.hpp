@@ -1,7 +1,11 @@
 #pragma once
 #include <stdint.h>
+#include <stddef.h>
 #include <vector>
+#include <type_traits>
 #include <R2/VKEnums.hpp>
+#include <R2/VKDescriptorSet.hpp>
+#include <R2/VKRenderPass.hpp>
 
 #define VK_DEFINE_HANDLE(object) typedef struct object##_T* object;
 VK_DEFINE_HANDLE(VkPipeline)
@@ -11,6 +15,7 @@ VK_DEFINE_HANDLE(VkDescriptorSetLayout)
 #undef VK_DEFINE_HANDLE
 
 struct VkPipelineShaderStageCreateInfo;
+struct VkSpecializationInfo;
 
 namespace R2::VK
 {
@@ -59,15 +64,76 @@ namespace R2::VK
         FrontAndBack = 3
     };
 
+    // Values for a shader's specialization constants. The same values are
+    // given to every stage, and IDs a stage doesn't declare are ignored.
+    class SpecializationConstants
+    {
+    public:
+        template <typename T>
+        void Set(uint32_t constantId, const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Specialization constants must be plain scalars");
+            SetRaw(constantId, &value, sizeof(T));
+        }
+
+        // SPIR-V booleans are 32 bits wide, unlike C++ ones
+        void Set(uint32_t constantId, bool value)
+        {
+            uint32_t v = value ? 1 : 0;
+            SetRaw(constantId, &v, sizeof(v));
+        }
+
+        void SetRaw(uint32_t constantId, const void* data, size_t size);
+        bool IsEmpty() const;
+        // Only valid until the next call to Set
+        void GetNativeInfo(VkSpecializationInfo& info) const;
+    private:
+        // Matches VkSpecializationMapEntry
+        struct Entry
+        {
+            uint32_t ConstantID;
+            uint32_t Offset;
+            size_t Size;
+        };
+
+        std::vector<Entry> entries;
+        std::vector<uint8_t> data;
+    };
+
+    struct ShaderBinding
+    {
+        uint32_t Set;
+        uint32_t Binding;
+        DescriptorType Type;
+        // 0 for runtime-sized arrays
+        uint32_t Count;
+    };
+
+    // Resource interface of a SPIR-V module, read straight from the binary
+    struct ShaderReflection
+    {
+        bool Valid = false;
+        ShaderStage Stage = ShaderStage::Vertex;
+        std::vector<ShaderBinding> Bindings;
+        uint32_t PushConstantOffset = 0;
+        uint32_t PushConstantSize = 0;
+        // Default values if the shader uses specialization constants for its workgroup size
+        uint32_t WorkgroupSize[3] = { 1, 1, 1 };
+    };
+
+    bool ReflectSpirv(const uint32_t* data, size_t dataLength, ShaderReflection& reflection);
+
     class ShaderModule
     {
     public:
         ShaderModule(const Handles* handles, const uint32_t* data, size_t dataLength);
         ~ShaderModule();
         VkShaderModule GetNativeHandle();
+        const ShaderReflection& GetReflection() const;
     private:
         VkShaderModule mod;
         const Handles* handles;
+        ShaderReflection reflection;
     };
 
     class PipelineLayout
@@ -102,6 +168,49 @@ namespace R2::VK
         std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
     };
 
+    // Descriptor set layouts and a pipeline layout matching the resources
+    // used by a set of shader modules
+    class ReflectedLayout
+    {
+    public:
+        ~ReflectedLayout();
+        PipelineLayout* GetPipelineLayout();
+        // Sets in between used sets get an empty layout, so this is only null past the end
+        DescriptorSetLayout* GetDescriptorSetLayout(uint32_t set);
+        uint32_t GetNumDescriptorSetLayouts() const;
+        ShaderStage GetPushConstantStages() const;
+    private:
+        friend class ReflectedLayoutBuilder;
+        ReflectedLayout() = default;
+
+        PipelineLayout* pipelineLayout = nullptr;
+        std::vector<DescriptorSetLayout*> setLayouts;
+        ShaderStage pushConstantStages = ShaderStage::Vertex;
+    };
+
+    class ReflectedLayoutBuilder
+    {
+    public:
+        ReflectedLayoutBuilder(Core* core);
+        ReflectedLayoutBuilder& AddModule(const ShaderModule& mod);
+        // Descriptor count used for runtime-sized arrays, which are also made partially bound
+        ReflectedLayoutBuilder& RuntimeArraySize(uint32_t count);
+        ReflectedLayout* Build();
+    private:
+        struct MergedBinding
+        {
+            ShaderBinding Binding;
+            ShaderStage Stages;
+        };
+
+        Core* core;
+        std::vector<MergedBinding> bindings;
+        uint32_t pushConstantStart = ~0u;
+        uint32_t pushConstantEnd = 0;
+        uint32_t pushConstantStages = 0;
+        uint32_t runtimeArraySize = 1024;
+    };
+
     class Pipeline
     {
     public:
@@ -132,9 +241,19 @@ namespace R2::VK
         PipelineBuilder& DepthCompareOp(CompareOp op);
         PipelineBuilder& MSAASamples(int sampleCount);
         PipelineBuilder& ViewMask(uint32_t viewMask);
+        // The subpasses of the render pass the pipeline is used in, matching
+        // RenderPass::Subpass, and which one of them it's used in
+        PipelineBuilder& Subpass(uint32_t colorAttachmentMask, uint32_t inputAttachmentMask);
+        PipelineBuilder& SubpassIndex(uint32_t index);
         PipelineBuilder& DepthBias(bool enable);
         PipelineBuilder& ConstantDepthBias(float b);
         PipelineBuilder& SlopeDepthBias(float b);
+        template <typename T>
+        PipelineBuilder& Specialize(uint32_t constantId, const T& value)
+        {
+            specConstants.Set(constantId, value);
+            return *this;
+        }
         Pipeline* Build();
     private:
         Core* core;
@@ -162,6 +281,9 @@ namespace R2::VK
         CompareOp depthCompareOp = CompareOp::Always;
         int numSamples = 1;
         uint32_t viewMask = 0;
+        std::vector<SubpassInfo> subpasses;
+        uint32_t subpassIndex = 0;
+        SpecializationConstants specConstants;
     };
 
     class ComputePipelineBuilder
@@ -170,10 +292,17 @@ namespace R2::VK
         ComputePipelineBuilder(Core* core);
         ComputePipelineBuilder& SetShader(ShaderModule& mod);
         ComputePipelineBuilder& Layout(PipelineLayout* layout);
+        template <typename T>
+        ComputePipelineBuilder& Specialize(uint32_t constantId, const T& value)
+        {
+            specConstants.Set(constantId, value);
+            return *this;
+        }
         Pipeline* Build();
     private:
         Core* core;
         ShaderModule* shaderModule;
         VkPipelineLayout pipelineLayout;
+        SpecializationConstants specConstants;
     };
 }
\ No newline at end of file
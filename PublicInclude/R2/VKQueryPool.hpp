@@ -0,0 +1,102 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <R2/VKCommandBuffer.hpp>
+
+#define VK_DEFINE_HANDLE(object) typedef struct object##_T* object;
+VK_DEFINE_HANDLE(VkQueryPool)
+#undef VK_DEFINE_HANDLE
+
+namespace R2::VK
+{
+    class Core;
+
+    enum class QueryType
+    {
+        Occlusion,
+        PipelineStatistics
+    };
+
+    enum class PipelineStatistic : uint32_t
+    {
+        None = 0,
+        InputAssemblyVertices = 0x1,
+        InputAssemblyPrimitives = 0x2,
+        VertexShaderInvocations = 0x4,
+        GeometryShaderInvocations = 0x8,
+        GeometryShaderPrimitives = 0x10,
+        ClippingInvocations = 0x20,
+        ClippingPrimitives = 0x40,
+        FragmentShaderInvocations = 0x80,
+        TessellationControlShaderPatches = 0x100,
+        TessellationEvaluationShaderInvocations = 0x200,
+        ComputeShaderInvocations = 0x400
+    };
+
+    inline PipelineStatistic operator|(const PipelineStatistic& a, const PipelineStatistic& b)
+    {
+        return static_cast<PipelineStatistic>((uint32_t)a | (uint32_t)b);
+    }
+
+    // Occlusion or pipeline statistics queries, with a separate set of
+    // queriesPerFrame queries for each frame in flight. Query indices are
+    // relative to the current frame. Results are read back without waiting
+    // when BeginFrame() comes round to a frame again, once its fence has been
+    // waited on, so they lag a couple of frames behind.
+    //
+    // Queries begun inside a multiview render pass use one index per view.
+    // Pipeline statistics need GraphicsSupportedFeatures::PipelineStatistics.
+    class QueryPool
+    {
+    public:
+        QueryPool(Core* core, QueryType type, uint32_t queriesPerFrame,
+            PipelineStatistic statistics = PipelineStatistic::None);
+        ~QueryPool();
+
+        // Must be recorded outside of a render pass, before any queries in the frame
+        void BeginFrame(CommandBuffer cb);
+        // Precise occlusion queries count samples rather than just reporting
+        // whether any passed. Requires GraphicsSupportedFeatures::PreciseOcclusionQueries.
+        void Begin(CommandBuffer cb, uint32_t query, bool precise = false);
+        void End(CommandBuffer cb, uint32_t query);
+
+        // False if the query wasn't used in the frame the results came from
+        bool IsResultAvailable(uint32_t query) const;
+        // Number of samples that passed the depth and stencil tests
+        uint64_t GetOcclusionResult(uint32_t query) const;
+        uint64_t GetStatistic(uint32_t query, PipelineStatistic statistic) const;
+        // The Core frame number the results came from
+        uint64_t GetResultsFrameNumber() const;
+        VkQueryPool GetNativeHandle();
+    private:
+        Core* core;
+        VkQueryPool queryPool;
+        QueryType type;
+        PipelineStatistic statistics;
+        uint32_t queriesPerFrame;
+        // One per enabled statistic, followed by the availability value
+        uint32_t valuesPerQuery;
+        std::vector<uint64_t> frameNumbers;
+        std::vector<bool> frameUsed;
+        std::vector<uint64_t> results;
+        uint64_t resultsFrameNumber = 0;
+    };
+
+    // Usage:
+    //   {
+    //       VK::QueryScope scope{ statsPool, cb, passIndex };
+    //       ...draws...
+    //   }
+    class QueryScope
+    {
+    public:
+        QueryScope(QueryPool* pool, CommandBuffer cb, uint32_t query, bool precise = false);
+        ~QueryScope();
+        QueryScope(const QueryScope&) = delete;
+        QueryScope& operator=(const QueryScope&) = delete;
+    private:
+        QueryPool* pool;
+        CommandBuffer cb;
+        uint32_t query;
+    };
+}
@@ -22,6 +22,16 @@ namespace R2::VK
         DontCare
     };
 
+    // Values match VkResolveModeFlagBits
+    enum class ResolveMode
+    {
+        None = 0,
+        SampleZero = 1,
+        Average = 2,
+        Min = 4,
+        Max = 8
+    };
+
     union ClearColorValue
     {
         float       Float32[4];
@@ -59,24 +69,54 @@ namespace R2::VK
         }
     };
 
+    const uint32_t MAX_SUBPASSES = 4;
+
+    // Which of a render pass' color attachments a subpass writes, and which it
+    // reads as input attachments, as bitmasks of attachment indices. Written
+    // attachments map to consecutive fragment output locations and read ones
+    // to consecutive input_attachment_index values, both in attachment order.
+    struct SubpassInfo
+    {
+        uint32_t ColorAttachmentMask;
+        uint32_t InputAttachmentMask;
+    };
+
     class CommandBuffer;
 
     class RenderPass
     {
     public:
         RenderPass();
+        // Can be smaller than the attachments, e.g. when rendering at a reduced resolution
         RenderPass& RenderArea(uint32_t width, uint32_t height);
 
         RenderPass& ColorAttachment(Texture* tex, LoadOp loadOp, StoreOp storeOp);
         RenderPass& ColorAttachmentClearValue(ClearValue val);
+        // Resolves the last added color attachment into a single sampled texture
+        // as part of the store, so the multisampled contents can be left unstored.
+        // Color attachments can only be averaged when dynamic rendering isn't available.
+        RenderPass& ResolveAttachment(Texture* tex, ResolveMode mode = ResolveMode::Average);
         RenderPass& DepthAttachment(Texture* tex, LoadOp loadOp, StoreOp storeOp);
         RenderPass& DepthAttachmentClearValue(ClearValue val);
+        // Needs a depth resolve mode the device supports. SampleZero is always supported.
+        RenderPass& DepthResolveAttachment(Texture* tex, ResolveMode mode = ResolveMode::SampleZero);
 
         RenderPass& FragmentShadingRateAttachment(Texture* tex, uint32_t texelWidth, uint32_t texelHeight);
 
         RenderPass& ViewMask(uint32_t viewMask);
 
+        // Splits the render pass into subpasses, run in the order they're added,
+        // so that later ones can read what earlier ones wrote without it leaving
+        // tile memory. Without any there's a single subpass writing every color
+        // attachment. Uses real subpasses when dynamic rendering isn't available,
+        // and needs GraphicsSupportedFeatures::DynamicRenderingLocalRead otherwise.
+        // Pipelines have to be built with the same subpasses. With dynamic
+        // rendering, attachments that are read are in ImageLayout::RenderingLocalRead.
+        // Attachments that are read have to be created with CanUseAsInputAttachment.
+        RenderPass& Subpass(uint32_t colorAttachmentMask, uint32_t inputAttachmentMask);
+
         void Begin(CommandBuffer cb);
+        void NextSubpass(CommandBuffer cb);
         void End(CommandBuffer cb);
     private:
         struct AttachmentInfo
@@ -85,6 +125,8 @@ namespace R2::VK
             LoadOp LoadOp;
             StoreOp StoreOp;
             ClearValue ClearValue;
+            VK::Texture* ResolveTexture;
+            ResolveMode ResolveMode;
         };
 
         struct FragmentShadingRateAttachmentInfo
@@ -102,5 +144,11 @@ namespace R2::VK
         uint32_t viewMask;
         FragmentShadingRateAttachmentInfo fragmentShadingRateAttachment;
         bool useFragmentShadingRateAttachment;
+        SubpassInfo subpasses[MAX_SUBPASSES];
+        uint32_t numSubpasses;
+        uint32_t currentSubpass;
+
+        uint32_t getInputAttachmentMask() const;
+        void setLocalReadState(CommandBuffer cb);
     };
 }
\ No newline at end of file
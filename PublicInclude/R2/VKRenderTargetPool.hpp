@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include <R2/VKTexture.hpp>
+
+namespace R2::VK
+{
+    class Core;
+
+    // Recycles textures with identical create infos across frames, so that
+    // resizing or changing the render resolution back and forth doesn't
+    // allocate once every size has been seen. Acquired textures have undefined
+    // contents. A released texture can be acquired again straight away, since
+    // barrier tracking orders it against earlier uses on the same queue.
+    class RenderTargetPool
+    {
+    public:
+        RenderTargetPool(Core* core, uint32_t maxUnusedFrames = 60);
+        ~RenderTargetPool();
+        Texture* Acquire(const TextureCreateInfo& createInfo);
+        void Release(Texture* tex);
+        // Destroys free textures that haven't been acquired for maxUnusedFrames.
+        // Should be called once per frame.
+        void Evict();
+
+        uint32_t GetNumFreeTextures();
+        uint32_t GetNumAcquiredTextures();
+    private:
+        struct Key
+        {
+            Key(const TextureCreateInfo& createInfo);
+            bool operator==(const Key& other) const;
+
+            int Width;
+            int Height;
+            int Depth;
+            int Layers;
+            int NumMips;
+            TextureFormat Format;
+            TextureDimension Dimension;
+            int Samples;
+            uint32_t UsageBits;
+            MemoryPool* Pool;
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const Key& key) const;
+        };
+
+        struct FreeTexture
+        {
+            Texture* Texture;
+            uint64_t LastUsedFrame;
+        };
+
+        Core* core;
+        uint32_t maxUnusedFrames;
+        std::unordered_map<Key, std::vector<FreeTexture>, KeyHash> freeTextures;
+        std::unordered_map<Texture*, Key> acquiredTextures;
+        uint32_t numFree = 0;
+    };
+}
@@ -16,6 +16,9 @@ namespace R2::VK
     public:
         Sampler(Core* core, VkSampler sampler);
         VkSampler GetNativeHandle();
+        // Makes another wrapper around the same VkSampler with its own reference,
+        // so it stays valid after this one is deleted
+        Sampler* Share();
         ~Sampler();
     private:
         VkSampler sampler;
@@ -62,9 +65,18 @@ namespace R2::VK
         SamplerBuilder& MinFilter(Filter filt);
         SamplerBuilder& MipmapMode(SamplerMipmapMode mode);
         SamplerBuilder& AddressMode(SamplerAddressMode mode);
+        SamplerBuilder& AddressMode(SamplerAddressMode u, SamplerAddressMode v, SamplerAddressMode w);
         SamplerBuilder& EnableCompare(bool enableCompare);
         SamplerBuilder& CompareOp(CompareOp compareOp);
+        // Anisotropic filtering defaults to on at 8x
+        SamplerBuilder& Anisotropy(bool enable, float maxAnisotropy = 8.0f);
+        SamplerBuilder& MipLodBias(float bias);
+        // Defaults to the full mip chain
+        SamplerBuilder& LodRange(float minLod, float maxLod);
+        SamplerBuilder& BorderColor(VK::BorderColor color);
 
+        // Identical samplers share the same VkSampler, so building the
+        // same sampler repeatedly doesn't eat into the device's sampler limit.
         Sampler* Build();
     private:
         struct SamplerCreateInfo
@@ -82,7 +94,7 @@ namespace R2::VK
             VK::CompareOp         compareOp;
             float                 minLod;
             float                 maxLod;
-            BorderColor           borderColor;
+            VK::BorderColor       borderColor;
             Bool32                unnormalizedCoordinates;
         };
 
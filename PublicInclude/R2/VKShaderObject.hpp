@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <R2/VKEnums.hpp>
+#include <R2/VKPipeline.hpp>
+#include <R2/VKCommandBuffer.hpp>
+
+#define VK_DEFINE_HANDLE(object) typedef struct object##_T* object;
+VK_DEFINE_HANDLE(VkShaderEXT)
+VK_DEFINE_HANDLE(VkDescriptorSetLayout)
+#undef VK_DEFINE_HANDLE
+
+namespace R2::VK
+{
+    class Core;
+    class DescriptorSetLayout;
+
+    // A single shader stage compiled through VK_EXT_shader_object. Unlike a
+    // Pipeline, it doesn't bake in any state, so one ShaderObject can be used
+    // with any combination of GraphicsState.
+    class ShaderObject
+    {
+    public:
+        ShaderObject(Core* core, VkShaderEXT shader, ShaderStage stage);
+        ~ShaderObject();
+        VkShaderEXT GetNativeHandle();
+        ShaderStage GetStage();
+    private:
+        Core* core;
+        VkShaderEXT shader;
+        ShaderStage stage;
+    };
+
+    class ShaderObjectBuilder
+    {
+    public:
+        ShaderObjectBuilder(Core* core);
+        ShaderObjectBuilder& Code(ShaderStage stage, const uint32_t* data, size_t dataLength);
+        // The stage that will be bound after this one (i.e. Fragment for a vertex shader)
+        ShaderObjectBuilder& NextStage(ShaderStage stage);
+        ShaderObjectBuilder& PushConstants(ShaderStage stages, uint32_t offset, uint32_t size);
+        ShaderObjectBuilder& DescriptorSet(DescriptorSetLayout* layout);
+        template <typename T>
+        ShaderObjectBuilder& Specialize(uint32_t constantId, const T& value)
+        {
+            specConstants.Set(constantId, value);
+            return *this;
+        }
+        ShaderObject* Build();
+    private:
+        struct PushConstantRange
+        {
+            ShaderStage Stages;
+            uint32_t Offset;
+            uint32_t Size;
+        };
+
+        Core* core;
+        ShaderStage stage;
+        uint32_t nextStage = 0;
+        const uint32_t* code = nullptr;
+        size_t codeLength = 0;
+        std::vector<PushConstantRange> pushConstants;
+        std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
+        SpecializationConstants specConstants;
+    };
+
+    // Everything that PipelineBuilder would normally bake into a pipeline. When
+    // drawing with shader objects, all of it is set dynamically through
+    // CommandBuffer::SetGraphicsState.
+    struct GraphicsState
+    {
+        std::vector<VertexBinding> VertexBindings;
+        VK::Topology Topology = VK::Topology::TriangleList;
+        VK::CullMode CullMode = VK::CullMode::Back;
+        VK::Viewport Viewport{};
+        VK::ScissorRect Scissor{};
+        uint32_t NumColorAttachments = 1;
+        bool AlphaBlend = false;
+        bool AlphaToCoverage = false;
+        bool AdditiveBlend = false;
+        bool DepthTest = false;
+        bool DepthWrite = false;
+        bool DepthBias = false;
+        float ConstantDepthBias = 0.0f;
+        float SlopeDepthBias = 0.0f;
+        CompareOp DepthCompareOp = CompareOp::Always;
+        int NumSamples = 1;
+    };
+}
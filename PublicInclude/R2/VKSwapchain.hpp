@@ -22,6 +22,10 @@ namespace R2::VK
     struct SwapchainCreateInfo
     {
         VkSurfaceKHR surface;
+        // Only used when the surface doesn't determine the size, as with
+        // Core::CreateHeadlessSurface()
+        int Width = 0;
+        int Height = 0;
     };
 
     class Swapchain
@@ -1,4 +1,6 @@
 #pragma once
+#include <stdint.h>
+#include <vector>
 
 #define VK_DEFINE_HANDLE(object) typedef struct object##_T* object;
 VK_DEFINE_HANDLE(VkFence)
@@ -8,7 +10,12 @@ VK_DEFINE_HANDLE(VkEvent)
 namespace R2::VK
 {
     struct Handles;
+    class Buffer;
     class Core;
+    class Texture;
+    enum class AccessFlags : uint64_t;
+    enum class ImageLayout : uint32_t;
+    enum class PipelineStageFlags : uint64_t;
 
     enum class FenceFlags
     {
@@ -47,4 +54,53 @@ namespace R2::VK
         Core* core;
         VkEvent event;
     };
-}
\ No newline at end of file
+
+    // A barrier whose source half is signalled by CommandBuffer::SignalSplitBarrier
+    // right after the producing work, and whose destination half is waited on by
+    // CommandBuffer::WaitSplitBarrier right before the consuming work. Anything
+    // recorded in between can overlap with the producer and the transition.
+    // Both halves must be given the same SplitBarrier, since the dependencies
+    // passed to the signal and the wait have to match. The event has to be
+    // unsignalled before the barrier is signalled again.
+    class SplitBarrier
+    {
+    public:
+        SplitBarrier(Event* evt);
+        SplitBarrier& AddMemoryBarrier(PipelineStageFlags srcStage, AccessFlags srcAccess,
+            PipelineStageFlags dstStage, AccessFlags dstAccess);
+        SplitBarrier& AddTextureBarrier(Texture* tex, ImageLayout oldLayout, ImageLayout newLayout,
+            PipelineStageFlags srcStage, AccessFlags srcAccess, PipelineStageFlags dstStage, AccessFlags dstAccess);
+        SplitBarrier& AddBufferBarrier(Buffer* buf, PipelineStageFlags srcStage, AccessFlags srcAccess,
+            PipelineStageFlags dstStage, AccessFlags dstAccess);
+        Event* GetEvent() const;
+    private:
+        struct Dependency
+        {
+            PipelineStageFlags SrcStage;
+            AccessFlags SrcAccess;
+            PipelineStageFlags DstStage;
+            AccessFlags DstAccess;
+        };
+
+        struct TextureDependency
+        {
+            Texture* Texture;
+            ImageLayout OldLayout;
+            ImageLayout NewLayout;
+            Dependency Memory;
+        };
+
+        struct BufferDependency
+        {
+            Buffer* Buffer;
+            Dependency Memory;
+        };
+
+        Event* event;
+        std::vector<Dependency> memoryBarriers;
+        std::vector<TextureDependency> textureBarriers;
+        std::vector<BufferDependency> bufferBarriers;
+
+        friend class CommandBuffer;
+    };
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include <R2/VKMemoryPool.hpp>
 
 #define VK_DEFINE_HANDLE(object) typedef struct object##_T* object;
 VK_DEFINE_HANDLE(VkImage)
@@ -11,6 +12,11 @@ VK_DEFINE_HANDLE(VmaAllocation)
 typedef uint32_t VkFlags;
 typedef VkFlags VkImageAspectFlags;
 
+namespace R2
+{
+    class RenderGraph;
+}
+
 namespace R2::VK
 {
     struct Handles;
@@ -355,6 +361,7 @@ namespace R2::VK
         Preinitialized = 8,
 
         FragmentShadingRateOptimal = 1000164003,
+        RenderingLocalRead = 1000232000,
         ReadOnlyOptimal = 1000314000,
         AttachmentOptimal = 1000314001,
         PresentSrc = 1000001002
@@ -415,6 +422,11 @@ namespace R2::VK
         bool CanSample : 1 = true;
         bool CanTransfer : 1 = true;
         bool CanUseAsShadingRateAttachment : 1 = false;
+        // Render targets read by a later subpass through RenderPass::Subpass()
+        bool CanUseAsInputAttachment : 1 = false;
+        // Create the image without memory; it has to be bound through
+        // AliasedMemory before it can be used
+        bool DeferMemoryBinding : 1 = false;
         MemoryPool* Pool = nullptr;
     };
 
@@ -436,6 +448,7 @@ namespace R2::VK
         TextureFormat GetFormat();
         uint32_t GetUsageFlags();
         uint32_t GetImageFlags();
+        MemoryRequirements GetMemoryRequirements();
 
         void Acquire(CommandBuffer cb, ImageLayout layout, AccessFlags access, PipelineStageFlags stage);
         ~Texture();
@@ -453,6 +466,8 @@ namespace R2::VK
 
         void WriteLayoutTransition(CommandBuffer cb, ImageLayout layout);
         void WriteLayoutTransition(CommandBuffer cb, ImageLayout oldLayout, ImageLayout newLayout);
+        void createView();
+        void bindMemory(VmaAllocation memory, uint64_t offset);
 
         VkImageAspectFlags getAspectFlags() const;
         Core* core;
@@ -462,8 +477,13 @@ namespace R2::VK
         ImageLayout lastLayout;
         AccessFlags lastAccess;
         PipelineStageFlags lastPipelineStage;
+        // Set while a RenderGraph is handling barriers for this texture
+        bool externallySynchronized = false;
 
+        friend class AliasedMemory;
         friend class CommandBuffer;
+        friend class Core;
+        friend class R2::RenderGraph;
     };
 
     struct TextureSubset
@@ -0,0 +1,85 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <vector>
+
+namespace R2::VK
+{
+    class Core;
+    class GPUProfiler;
+
+    // Writes CPU and GPU zones to a Chrome trace event JSON file, which can be
+    // opened in chrome://tracing or Perfetto. Events are buffered and written
+    // out whenever the buffer fills, so memory use doesn't grow with the
+    // length of the trace.
+    //
+    // While a recorder exists it's the active one, and R2 records its own
+    // zones into it: frame begin/end, fence and idle waits, uploads and staging flushes,
+    // swapchain acquire/present and pipeline creation. Only one recorder can
+    // exist at a time.
+    //
+    // GPU zones come from a GPUProfiler and are placed on the CPU timeline
+    // using VK_EXT_calibrated_timestamps when the device supports it.
+    // Otherwise the clocks are correlated once, at creation, by waiting on a
+    // timestamp written from an immediate command buffer, so it shouldn't be
+    // created while other threads are submitting.
+    class TraceRecorder
+    {
+    public:
+        TraceRecorder(Core* core, const char* path, uint32_t maxBufferedEvents = 4096);
+        ~TraceRecorder();
+        bool IsOpen() const;
+        bool HasCalibratedTimestamps() const;
+
+        // Nanoseconds on the host clock used for calibration
+        static uint64_t GetCPUTimestamp();
+        static TraceRecorder* GetActive();
+
+        // Name must be valid until the next flush
+        void AddCPUZone(const char* name, uint64_t startNs, uint64_t endNs);
+        // Call once per frame after GPUProfiler::BeginFrame to add the results it read back
+        void AddGPUZones(const GPUProfiler& profiler);
+        void Flush();
+    private:
+        struct Event
+        {
+            const char* Name;
+            uint64_t StartNs;
+            uint64_t DurationNs;
+            uint32_t ThreadID;
+        };
+
+        void calibrate();
+        uint64_t gpuToCPUTime(uint64_t gpuTimestamp) const;
+        void writeEvent(const Event& evt);
+        void flushLocked();
+
+        Core* core;
+        FILE* file;
+        std::mutex mutex;
+        std::vector<Event> events;
+        uint32_t maxBufferedEvents;
+        bool calibrated = false;
+        bool hasCalibratedTimestamps = false;
+        uint32_t hostTimeDomain = 0;
+        // A GPU timestamp and the CPU time at the same instant
+        uint64_t calibrationGPUTimestamp = 0;
+        uint64_t calibrationCPUTime = 0;
+        uint64_t lastGPUFrameNumber = 0;
+    };
+
+    // Records a CPU zone into the active trace recorder, if there is one.
+    // Name must be a string literal.
+    class TraceScope
+    {
+    public:
+        TraceScope(const char* name);
+        ~TraceScope();
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+    private:
+        const char* name;
+        uint64_t start;
+    };
+}
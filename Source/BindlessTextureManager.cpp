@@ -11,7 +11,10 @@ namespace R2
     {
         VK::DescriptorSetLayoutBuilder dslb{core};
 
-        dslb.Binding(0, VK::DescriptorType::Sampler, 1, VK::ShaderStage::Vertex | VK::ShaderStage::Fragment | VK::ShaderStage::Compute);
+        dslb.Binding(0, VK::DescriptorType::Sampler, NUM_SAMPLERS,
+            VK::ShaderStage::Vertex | VK::ShaderStage::Fragment | VK::ShaderStage::Compute)
+            .PartiallyBound()
+            .UpdateAfterBind();
         dslb.Binding(1, VK::DescriptorType::SampledImage, NUM_TEXTURES, 
             VK::ShaderStage::Vertex | VK::ShaderStage::Fragment | VK::ShaderStage::Compute)
             .PartiallyBound()
@@ -35,6 +38,11 @@ namespace R2
             useView[i] = false;
         }
 
+        samplers.fill(nullptr);
+        samplerRefCounts.fill(0);
+        samplers[0] = sampler;
+        samplerRefCounts[0] = 1;
+
         VK::DescriptorSetUpdater dsu{core, textureDescriptors};
         dsu.AddSampler(0, 0, VK::DescriptorType::Sampler, sampler);
         dsu.Update();
@@ -42,6 +50,11 @@ namespace R2
 
     BindlessTextureManager::~BindlessTextureManager()
     {
+        for (uint32_t i = 1; i < NUM_SAMPLERS; i++)
+        {
+            if (samplerRefCounts[i] > 0)
+                delete samplers[i];
+        }
     }
 
     uint32_t BindlessTextureManager::FindFreeSlot()
@@ -102,6 +115,51 @@ namespace R2
         descriptorsNeedUpdate = true;
     }
 
+    uint32_t BindlessTextureManager::AllocateSamplerHandle(VK::Sampler* samp)
+    {
+        std::lock_guard lock{texturesMutex};
+        uint32_t freeSlot = ~0u;
+
+        for (uint32_t i = 0; i < NUM_SAMPLERS; i++)
+        {
+            if (samplerRefCounts[i] == 0)
+            {
+                if (freeSlot == ~0u)
+                    freeSlot = i;
+            }
+            else if (samplers[i]->GetNativeHandle() == samp->GetNativeHandle())
+            {
+                samplerRefCounts[i]++;
+                return i;
+            }
+        }
+
+        assert(freeSlot != ~0u);
+        samplers[freeSlot] = samp->Share();
+        samplerRefCounts[freeSlot] = 1;
+        samplersNeedUpdate = true;
+        return freeSlot;
+    }
+
+    void BindlessTextureManager::FreeSamplerHandle(uint32_t handle)
+    {
+        std::lock_guard lock{texturesMutex};
+        // The default sampler is never freed
+        if (handle == 0)
+            return;
+
+        assert(samplerRefCounts[handle] > 0);
+        if (--samplerRefCounts[handle] == 0)
+        {
+            // Point the slot back at the default sampler so it never refers to a destroyed one.
+            // The VkSampler is only destroyed through the deletion queue, so in-flight frames
+            // can still use it.
+            delete samplers[handle];
+            samplers[handle] = sampler;
+            samplersNeedUpdate = true;
+        }
+    }
+
     VK::DescriptorSet& BindlessTextureManager::GetTextureDescriptorSet()
     {
         return *textureDescriptors;
@@ -114,6 +172,22 @@ namespace R2
 
     void BindlessTextureManager::UpdateDescriptorsIfNecessary()
     {
+        std::lock_guard lock{texturesMutex};
+
+        if (samplersNeedUpdate)
+        {
+            VK::DescriptorSetUpdater dsu{core, textureDescriptors};
+
+            for (uint32_t i = 0; i < NUM_SAMPLERS; i++)
+            {
+                if (samplers[i] == nullptr) continue;
+                dsu.AddSampler(0, i, VK::DescriptorType::Sampler, samplers[i]);
+            }
+
+            dsu.Update();
+            samplersNeedUpdate = false;
+        }
+
         if (descriptorsNeedUpdate)
         {
             VK::DescriptorSetUpdater dsu{core, textureDescriptors};
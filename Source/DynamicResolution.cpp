@@ -0,0 +1,176 @@
+#include <R2/DynamicResolution.hpp>
+#include <R2/VKCore.hpp>
+#include <R2/VKRenderPass.hpp>
+#include <R2/VKTimestampPool.hpp>
+#include <algorithm>
+#include <math.h>
+
+namespace R2
+{
+    DynamicResolutionController::DynamicResolutionController(VK::Core* core, uint32_t maxWidth, uint32_t maxHeight,
+        const DynamicResolutionSettings& settings)
+        : core(core)
+        , settings(settings)
+        , maxWidth(maxWidth)
+        , maxHeight(maxHeight)
+    {
+        // A start and end timestamp for each frame in flight
+        timestampPool = new VK::TimestampPool(core->GetHandles(), core->GetNumFramesInFlight() * 2);
+        scale = settings.MaxScale;
+        updateRenderSize();
+    }
+
+    DynamicResolutionController::~DynamicResolutionController()
+    {
+        delete timestampPool;
+    }
+
+    void DynamicResolutionController::BeginFrame(VK::CommandBuffer cb)
+    {
+        uint32_t frameIndex = core->GetFrameIndex();
+        uint32_t frameBit = 1u << frameIndex;
+
+        // BeginFrame() has waited on this frame's fence, so the results are
+        // available unless the frame was never submitted
+        if (pendingFrames & frameBit)
+        {
+            uint64_t timestamps[2];
+            if (timestampPool->GetTimestamps(frameIndex * 2, 2, timestamps) && timestamps[1] > timestamps[0])
+            {
+                double ns = (double)(timestamps[1] - timestamps[0]) * core->GetDeviceInfo().TimestampPeriod;
+                updateScale((float)(ns / 1000000.0));
+            }
+            pendingFrames &= ~frameBit;
+        }
+
+        timestampPool->Reset(cb, frameIndex * 2, 2);
+        timestampPool->WriteTimestamp(cb, frameIndex * 2);
+    }
+
+    void DynamicResolutionController::EndFrame(VK::CommandBuffer cb)
+    {
+        uint32_t frameIndex = core->GetFrameIndex();
+        timestampPool->WriteTimestamp(cb, frameIndex * 2 + 1);
+        pendingFrames |= 1u << frameIndex;
+    }
+
+    void DynamicResolutionController::SetMaxResolution(uint32_t maxWidth, uint32_t maxHeight)
+    {
+        this->maxWidth = maxWidth;
+        this->maxHeight = maxHeight;
+        updateRenderSize();
+    }
+
+    void DynamicResolutionController::SetSettings(const DynamicResolutionSettings& settings)
+    {
+        this->settings = settings;
+        scale = std::clamp(scale, settings.MinScale, settings.MaxScale);
+        updateRenderSize();
+    }
+
+    void DynamicResolutionController::ForceScale(float scale)
+    {
+        forcedScale = scale;
+        updateRenderSize();
+    }
+
+    float DynamicResolutionController::GetScale() const
+    {
+        return forcedScale >= 0.0f ? forcedScale : scale;
+    }
+
+    uint32_t DynamicResolutionController::GetRenderWidth() const
+    {
+        return renderWidth;
+    }
+
+    uint32_t DynamicResolutionController::GetRenderHeight() const
+    {
+        return renderHeight;
+    }
+
+    uint32_t DynamicResolutionController::GetMaxWidth() const
+    {
+        return maxWidth;
+    }
+
+    uint32_t DynamicResolutionController::GetMaxHeight() const
+    {
+        return maxHeight;
+    }
+
+    float DynamicResolutionController::GetGPUFrameTimeMs() const
+    {
+        return smoothedFrameTimeMs;
+    }
+
+    void DynamicResolutionController::GetUVScale(float& x, float& y) const
+    {
+        x = (float)renderWidth / (float)maxWidth;
+        y = (float)renderHeight / (float)maxHeight;
+    }
+
+    VK::Viewport DynamicResolutionController::GetViewport() const
+    {
+        return VK::Viewport::Simple((float)renderWidth, (float)renderHeight);
+    }
+
+    VK::ScissorRect DynamicResolutionController::GetScissor() const
+    {
+        return VK::ScissorRect::Simple(renderWidth, renderHeight);
+    }
+
+    void DynamicResolutionController::ApplyRenderArea(VK::RenderPass& renderPass) const
+    {
+        renderPass.RenderArea(renderWidth, renderHeight);
+    }
+
+    VK::TextureCreateInfo DynamicResolutionController::MaxRenderTargetInfo(VK::TextureFormat format) const
+    {
+        return VK::TextureCreateInfo::RenderTarget2D(format, (int)maxWidth, (int)maxHeight);
+    }
+
+    void DynamicResolutionController::updateScale(float frameTimeMs)
+    {
+        // Exponential moving average, so single slow frames don't cause a drop
+        if (smoothedFrameTimeMs == 0.0f)
+            smoothedFrameTimeMs = frameTimeMs;
+        else
+            smoothedFrameTimeMs += (frameTimeMs - smoothedFrameTimeMs) * 0.1f;
+
+        if (forcedScale >= 0.0f)
+            return;
+
+        float ratio = settings.TargetFrameTimeMs / smoothedFrameTimeMs;
+        if (fabsf(1.0f - ratio) < settings.Deadband)
+            return;
+
+        // GPU time is roughly proportional to the number of pixels, which
+        // goes with the square of the per-axis scale
+        float desired = scale * sqrtf(ratio);
+        desired = std::clamp(desired, scale - settings.MaxScaleChange, scale + settings.MaxScaleChange);
+        desired = std::clamp(desired, settings.MinScale, settings.MaxScale);
+
+        if (desired != scale)
+        {
+            scale = desired;
+            updateRenderSize();
+        }
+    }
+
+    void DynamicResolutionController::updateRenderSize()
+    {
+        float s = GetScale();
+        uint32_t granularity = std::max(settings.Granularity, 1u);
+
+        auto scaleDimension = [&](uint32_t maxSize)
+        {
+            uint32_t size = (uint32_t)((float)maxSize * s);
+            size -= size % granularity;
+            return std::clamp(size, std::min(granularity, maxSize), maxSize);
+        };
+
+        renderWidth = scaleDimension(maxWidth);
+        renderHeight = scaleDimension(maxHeight);
+    }
+}
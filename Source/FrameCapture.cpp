@@ -0,0 +1,358 @@
+#include <R2/FrameCapture.hpp>
+#include <R2/VKCore.hpp>
+#include <R2/VKTraceRecorder.hpp>
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace R2
+{
+    namespace
+    {
+        struct CRCTable
+        {
+            uint32_t Values[256];
+
+            CRCTable()
+            {
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; k++)
+                        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    Values[i] = c;
+                }
+            }
+        };
+
+        const CRCTable crcTable;
+
+        uint32_t updateCRC(uint32_t crc, const uint8_t* data, size_t size)
+        {
+            for (size_t i = 0; i < size; i++)
+                crc = crcTable.Values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+            return crc;
+        }
+
+        void writeU32BE(uint8_t* out, uint32_t v)
+        {
+            out[0] = (uint8_t)(v >> 24);
+            out[1] = (uint8_t)(v >> 16);
+            out[2] = (uint8_t)(v >> 8);
+            out[3] = (uint8_t)v;
+        }
+
+        bool writePNGChunk(FILE* f, const char* type, const uint8_t* data, uint32_t size)
+        {
+            uint8_t header[8];
+            writeU32BE(header, size);
+            memcpy(header + 4, type, 4);
+
+            uint32_t crc = updateCRC(0xFFFFFFFFu, header + 4, 4);
+            crc = updateCRC(crc, data, size) ^ 0xFFFFFFFFu;
+            uint8_t footer[4];
+            writeU32BE(footer, crc);
+
+            return fwrite(header, 1, 8, f) == 8 &&
+                   fwrite(data, 1, size, f) == size &&
+                   fwrite(footer, 1, 4, f) == 4;
+        }
+
+        // Returns the number of channels, or 0 if the format can't be written as a PNG
+        uint32_t getPNGChannels(VK::TextureFormat format, bool& swapRedBlue)
+        {
+            swapRedBlue = false;
+
+            switch (format)
+            {
+            case VK::TextureFormat::R8_UNORM:
+            case VK::TextureFormat::R8_SRGB:
+                return 1;
+            case VK::TextureFormat::B8G8R8A8_UNORM:
+            case VK::TextureFormat::B8G8R8A8_SRGB:
+                swapRedBlue = true;
+                return 4;
+            case VK::TextureFormat::R8G8B8A8_UNORM:
+            case VK::TextureFormat::R8G8B8A8_SRGB:
+                return 4;
+            default:
+                return 0;
+            }
+        }
+
+        // There's no compression library in the tree, so the zlib stream
+        // uses stored deflate blocks. Files end up about the size of the
+        // raw data but any PNG reader can open them.
+        bool writePNG(FILE* f, const uint8_t* pixels, uint32_t width, uint32_t height, VK::TextureFormat format)
+        {
+            bool swapRedBlue;
+            uint32_t channels = getPNGChannels(format, swapRedBlue);
+            size_t rowSize = (size_t)width * channels;
+
+            // Scanlines with a filter type byte in front of each
+            thread_local std::vector<uint8_t> scanlines;
+            scanlines.resize((rowSize + 1) * height);
+
+            for (uint32_t y = 0; y < height; y++)
+            {
+                uint8_t* row = &scanlines[(rowSize + 1) * y];
+                row[0] = 0;
+                memcpy(row + 1, pixels + rowSize * y, rowSize);
+
+                if (swapRedBlue)
+                {
+                    for (size_t x = 1; x < rowSize + 1; x += 4)
+                    {
+                        uint8_t b = row[x];
+                        row[x] = row[x + 2];
+                        row[x + 2] = b;
+                    }
+                }
+            }
+
+            const size_t maxBlockSize = 65535;
+            size_t numBlocks = (scanlines.size() + maxBlockSize - 1) / maxBlockSize;
+
+            thread_local std::vector<uint8_t> zlib;
+            zlib.resize(2 + numBlocks * 5 + scanlines.size() + 4);
+            uint8_t* out = zlib.data();
+
+            // Deflate with a 32K window, no preset dictionary
+            *out++ = 0x78;
+            *out++ = 0x01;
+
+            uint32_t adlerA = 1;
+            uint32_t adlerB = 0;
+            for (size_t offset = 0; offset < scanlines.size(); offset += maxBlockSize)
+            {
+                uint16_t blockSize = (uint16_t)std::min(maxBlockSize, scanlines.size() - offset);
+                *out++ = offset + blockSize == scanlines.size() ? 1 : 0;
+                *out++ = (uint8_t)blockSize;
+                *out++ = (uint8_t)(blockSize >> 8);
+                *out++ = (uint8_t)~blockSize;
+                *out++ = (uint8_t)(~blockSize >> 8);
+                memcpy(out, &scanlines[offset], blockSize);
+                out += blockSize;
+
+                for (size_t i = offset; i < offset + blockSize; i++)
+                {
+                    adlerA = (adlerA + scanlines[i]) % 65521;
+                    adlerB = (adlerB + adlerA) % 65521;
+                }
+            }
+
+            writeU32BE(out, (adlerB << 16) | adlerA);
+
+            static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+            uint8_t ihdr[13];
+            writeU32BE(ihdr, width);
+            writeU32BE(ihdr + 4, height);
+            ihdr[8] = 8;
+            // Greyscale or RGBA
+            ihdr[9] = channels == 1 ? 0 : 6;
+            ihdr[10] = 0;
+            ihdr[11] = 0;
+            ihdr[12] = 0;
+
+            return fwrite(signature, 1, 8, f) == 8 &&
+                   writePNGChunk(f, "IHDR", ihdr, sizeof(ihdr)) &&
+                   writePNGChunk(f, "IDAT", zlib.data(), (uint32_t)zlib.size()) &&
+                   writePNGChunk(f, "IEND", nullptr, 0);
+        }
+    }
+
+    FrameCapture::FrameCapture(VK::Core* core, const FrameCaptureCreateInfo& createInfo)
+        : core(core)
+        , createInfo(createInfo)
+    {
+        assert(createInfo.PathPattern);
+        // Frames waiting on readback only come back once their frame retires,
+        // so there has to be room for more than the frames in flight
+        assert(createInfo.MaxQueuedFrames > core->GetNumFramesInFlight());
+
+        for (uint32_t i = 0; i < createInfo.MaxQueuedFrames; i++)
+        {
+            frames.push_back(new CapturedFrame{});
+        }
+        freeFrames = frames;
+
+        for (uint32_t i = 0; i < createInfo.NumWorkerThreads; i++)
+        {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    FrameCapture::~FrameCapture()
+    {
+        Flush();
+
+        {
+            std::unique_lock lock{mutex};
+            stopping = true;
+        }
+        workAvailable.notify_all();
+
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+
+        for (CapturedFrame* frame : frames)
+        {
+            delete frame;
+        }
+    }
+
+    bool FrameCapture::Capture(VK::Texture* texture)
+    {
+        bool swapRedBlue;
+        assert(createInfo.Format != CaptureFileFormat::PNG || getPNGChannels(texture->GetFormat(), swapRedBlue) != 0);
+
+        CapturedFrame* frame;
+        {
+            std::unique_lock lock{mutex};
+
+            // Waiting only makes sense when a worker can free a frame. The others
+            // come back through Core::BeginFrame() on this thread.
+            if (freeFrames.empty() && !createInfo.DropWhenFull)
+            {
+                VK::TraceScope traceScope{ "Wait for capture encoding" };
+                frameFinished.wait(lock, [&]()
+                {
+                    return !freeFrames.empty() || (encodeQueue.empty() && numEncoding == 0);
+                });
+            }
+
+            if (freeFrames.empty())
+            {
+                numDropped++;
+                return false;
+            }
+
+            frame = freeFrames.back();
+            freeFrames.pop_back();
+            frame->Index = numCaptured++;
+        }
+
+        frame->Width = texture->GetWidth();
+        frame->Height = texture->GetHeight();
+        frame->Format = texture->GetFormat();
+
+        core->QueueTextureReadback(texture, [this, frame](const void* data, uint64_t dataSize)
+        {
+            onReadback(frame, data, dataSize);
+        }, 0, 0);
+
+        return true;
+    }
+
+    void FrameCapture::Flush()
+    {
+        core->FlushReadbacks();
+
+        std::unique_lock lock{mutex};
+        frameFinished.wait(lock, [&]() { return encodeQueue.empty() && numEncoding == 0; });
+    }
+
+    uint32_t FrameCapture::GetNumCaptured() const
+    {
+        std::unique_lock lock{mutex};
+        return numCaptured;
+    }
+
+    uint32_t FrameCapture::GetNumWritten() const
+    {
+        std::unique_lock lock{mutex};
+        return numWritten;
+    }
+
+    uint32_t FrameCapture::GetNumDropped() const
+    {
+        std::unique_lock lock{mutex};
+        return numDropped;
+    }
+
+    uint32_t FrameCapture::GetNumFailed() const
+    {
+        std::unique_lock lock{mutex};
+        return numFailed;
+    }
+
+    void FrameCapture::onReadback(CapturedFrame* frame, const void* data, uint64_t dataSize)
+    {
+        // The pointer is only valid during the callback. The frame's vector
+        // keeps its capacity, so this doesn't allocate after the first use.
+        const uint8_t* bytes = (const uint8_t*)data;
+        frame->Data.assign(bytes, bytes + dataSize);
+
+        {
+            std::unique_lock lock{mutex};
+            encodeQueue.push_back(frame);
+        }
+        workAvailable.notify_one();
+    }
+
+    void FrameCapture::workerLoop()
+    {
+        while (true)
+        {
+            CapturedFrame* frame;
+            {
+                std::unique_lock lock{mutex};
+                workAvailable.wait(lock, [&]() { return stopping || !encodeQueue.empty(); });
+
+                if (encodeQueue.empty())
+                    return;
+
+                frame = encodeQueue.front();
+                encodeQueue.pop_front();
+                numEncoding++;
+            }
+
+            bool written = writeFrame(*frame);
+
+            {
+                std::unique_lock lock{mutex};
+                numEncoding--;
+                if (written)
+                    numWritten++;
+                else
+                    numFailed++;
+                freeFrames.push_back(frame);
+            }
+            frameFinished.notify_all();
+        }
+    }
+
+    bool FrameCapture::writeFrame(const CapturedFrame& frame)
+    {
+        VK::TraceScope traceScope{ "Write captured frame" };
+
+        char path[512];
+        snprintf(path, sizeof(path), createInfo.PathPattern, frame.Index);
+
+        FILE* f = fopen(path, "wb");
+        bool written = false;
+
+        if (f)
+        {
+            if (createInfo.Format == CaptureFileFormat::PNG)
+                written = writePNG(f, frame.Data.data(), frame.Width, frame.Height, frame.Format);
+            else
+                written = fwrite(frame.Data.data(), 1, frame.Data.size(), f) == frame.Data.size();
+
+            written = fclose(f) == 0 && written;
+        }
+
+        if (!written && core->GetDebugOutputReceiver())
+        {
+            char buffer[600];
+            snprintf(buffer, sizeof(buffer), "Failed to write captured frame to %s", path);
+            core->GetDebugOutputReceiver()->DebugMessage(buffer);
+        }
+
+        return written;
+    }
+}
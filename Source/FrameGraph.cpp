@@ -0,0 +1,1276 @@
+#include <R2/FrameGraph.hpp>
+#include <R2/VKBuffer.hpp>
+#include <R2/VKCommandPool.hpp>
+#include <R2/VKCore.hpp>
+#include <R2/VKMemoryPool.hpp>
+#include <R2/VKTexture.hpp>
+#include <RenderPassCache.hpp>
+#include <RuntimeMetrics.hpp>
+#include <VKSyncLegacyHelpers.hpp>
+#include <volk.h>
+#include <assert.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace R2
+{
+    using namespace R2::VK;
+
+    const uint64_t WRITE_ACCESS_MASK =
+        (uint64_t)AccessFlags::ShaderWrite |
+        (uint64_t)AccessFlags::ColorAttachmentWrite |
+        (uint64_t)AccessFlags::DepthStencilAttachmentWrite |
+        (uint64_t)AccessFlags::TransferWrite |
+        (uint64_t)AccessFlags::HostWrite |
+        (uint64_t)AccessFlags::MemoryWrite |
+        (uint64_t)AccessFlags::ShaderStorageWrite;
+
+    // What the graph knows about a resource while executing. "Write" here also
+    // covers layout transitions, since they have to be ordered like writes.
+    struct ResourceState
+    {
+        struct VisibleScope
+        {
+            uint64_t Stages;
+            uint64_t Access;
+        };
+
+        ImageLayout Layout = ImageLayout::Undefined;
+        uint64_t WriteStages = 0;
+        // Write accesses that still have to be made available
+        uint64_t WriteAccess = 0;
+        // Stages that have read the resource since the last write
+        uint64_t ReadStages = 0;
+        uint64_t ReadAccess = 0;
+        // Scopes the last write has already been made visible to
+        std::vector<VisibleScope> Visible;
+    };
+
+    struct ResourceAccess
+    {
+        ImageLayout Layout;
+        uint64_t Access;
+        uint64_t Stage;
+        bool Read;
+        bool Write;
+    };
+
+    struct Barrier
+    {
+        ImageLayout OldLayout;
+        ImageLayout NewLayout;
+        uint64_t SrcStages;
+        uint64_t SrcAccess;
+        uint64_t DstStages;
+        uint64_t DstAccess;
+    };
+
+    bool isSubset(uint64_t flags, uint64_t of)
+    {
+        return (flags & of) == flags;
+    }
+
+    // Works out the barrier needed before `access` given everything that has
+    // happened to the resource so far, and advances the state past it.
+    // Returns false if no barrier is needed at all.
+    bool transitionResource(ResourceState& state, const ResourceAccess& access, Barrier& barrier)
+    {
+        bool layoutChange = state.Layout != access.Layout;
+        barrier.OldLayout = state.Layout;
+        barrier.NewLayout = access.Layout;
+        barrier.DstStages = access.Stage;
+        barrier.DstAccess = access.Access;
+
+        if (layoutChange || access.Write)
+        {
+            // Wait for the last write and for any reads since then (write-after-read
+            // only needs an execution dependency, so their access isn't included)
+            barrier.SrcStages = state.WriteStages | state.ReadStages;
+            barrier.SrcAccess = state.WriteAccess;
+            bool needed = layoutChange || barrier.SrcStages != 0;
+
+            state.Layout = access.Layout;
+            state.WriteStages = access.Stage;
+            state.WriteAccess = access.Write ? (access.Access & WRITE_ACCESS_MASK) : 0;
+            state.ReadStages = 0;
+            state.ReadAccess = 0;
+            state.Visible.clear();
+
+            // A read-only layout transition is already visible to this access
+            if (!access.Write)
+            {
+                state.Visible.push_back(ResourceState::VisibleScope{ access.Stage, access.Access });
+                state.ReadStages = access.Stage;
+                state.ReadAccess = access.Access;
+            }
+
+            return needed;
+        }
+
+        // Read-after-read in the same layout doesn't need anything, provided the
+        // last write has already been made visible to this stage and access
+        bool visible = state.WriteStages == 0;
+        for (const ResourceState::VisibleScope& scope : state.Visible)
+        {
+            if (isSubset(access.Stage, scope.Stages) && isSubset(access.Access, scope.Access))
+            {
+                visible = true;
+                break;
+            }
+        }
+
+        state.ReadStages |= access.Stage;
+        state.ReadAccess |= access.Access;
+
+        if (visible)
+            return false;
+
+        barrier.SrcStages = state.WriteStages;
+        barrier.SrcAccess = state.WriteAccess;
+        state.Visible.push_back(ResourceState::VisibleScope{ access.Stage, access.Access });
+        return true;
+    }
+
+    ResourceState initialState(ImageLayout layout, AccessFlags lastAccess, PipelineStageFlags lastStage)
+    {
+        // We don't know whether the last access was a read or a write, so assume
+        // it was a write
+        ResourceState state{};
+        state.Layout = layout;
+        state.WriteStages = (uint64_t)lastStage;
+        state.WriteAccess = (uint64_t)lastAccess & WRITE_ACCESS_MASK;
+        return state;
+    }
+
+    class BarrierBatch
+    {
+    public:
+        void AddImageBarrier(Texture* tex, VkImageAspectFlags aspect, const Barrier& barrier)
+        {
+            VkImageMemoryBarrier2 imb{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+            imb.image = tex->GetNativeHandle();
+            imb.oldLayout = (VkImageLayout)barrier.OldLayout;
+            imb.newLayout = (VkImageLayout)barrier.NewLayout;
+            imb.srcStageMask = barrier.SrcStages;
+            imb.srcAccessMask = barrier.SrcAccess;
+            imb.dstStageMask = barrier.DstStages;
+            imb.dstAccessMask = barrier.DstAccess;
+            imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imb.subresourceRange = VkImageSubresourceRange{ aspect, 0, (uint32_t)tex->GetNumMips(), 0, (uint32_t)tex->GetLayerCount() };
+            imageBarriers.push_back(imb);
+        }
+
+        void AddBufferBarrier(Buffer* buf, const Barrier& barrier)
+        {
+            VkBufferMemoryBarrier2 bmb{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+            bmb.buffer = buf->GetNativeHandle();
+            bmb.offset = 0;
+            bmb.size = VK_WHOLE_SIZE;
+            bmb.srcStageMask = barrier.SrcStages;
+            bmb.srcAccessMask = barrier.SrcAccess;
+            bmb.dstStageMask = barrier.DstStages;
+            bmb.dstAccessMask = barrier.DstAccess;
+            bmb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bmb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarriers.push_back(bmb);
+        }
+
+        void Flush(CommandBuffer cb)
+        {
+            if (imageBarriers.empty() && bufferBarriers.empty())
+                return;
+
+            VK::countBarriers(imageBarriers.size() + bufferBarriers.size());
+
+            if (vkCmdPipelineBarrier2 != NULL)
+            {
+                VkDependencyInfo di{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+                di.imageMemoryBarrierCount = (uint32_t)imageBarriers.size();
+                di.pImageMemoryBarriers = imageBarriers.data();
+                di.bufferMemoryBarrierCount = (uint32_t)bufferBarriers.size();
+                di.pBufferMemoryBarriers = bufferBarriers.data();
+                di.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+                vkCmdPipelineBarrier2(cb.GetNativeHandle(), &di);
+            }
+            else
+            {
+                // The old barrier API only takes one set of stage masks, so merge them
+                uint64_t srcStages = 0;
+                uint64_t dstStages = 0;
+
+                std::vector<VkImageMemoryBarrier> oldImageBarriers;
+                oldImageBarriers.reserve(imageBarriers.size());
+                for (const VkImageMemoryBarrier2& imb2 : imageBarriers)
+                {
+                    VkImageMemoryBarrier imb{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+                    imb.image = imb2.image;
+                    imb.oldLayout = imb2.oldLayout;
+                    imb.newLayout = imb2.newLayout;
+                    imb.srcAccessMask = getOldAccessFlags((AccessFlags)imb2.srcAccessMask);
+                    imb.dstAccessMask = getOldAccessFlags((AccessFlags)imb2.dstAccessMask);
+                    imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    imb.subresourceRange = imb2.subresourceRange;
+                    oldImageBarriers.push_back(imb);
+
+                    srcStages |= imb2.srcStageMask;
+                    dstStages |= imb2.dstStageMask;
+                }
+
+                std::vector<VkBufferMemoryBarrier> oldBufferBarriers;
+                oldBufferBarriers.reserve(bufferBarriers.size());
+                for (const VkBufferMemoryBarrier2& bmb2 : bufferBarriers)
+                {
+                    VkBufferMemoryBarrier bmb{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+                    bmb.buffer = bmb2.buffer;
+                    bmb.offset = bmb2.offset;
+                    bmb.size = bmb2.size;
+                    bmb.srcAccessMask = getOldAccessFlags((AccessFlags)bmb2.srcAccessMask);
+                    bmb.dstAccessMask = getOldAccessFlags((AccessFlags)bmb2.dstAccessMask);
+                    bmb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    bmb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    oldBufferBarriers.push_back(bmb);
+
+                    srcStages |= bmb2.srcStageMask;
+                    dstStages |= bmb2.dstStageMask;
+                }
+
+                VkPipelineStageFlags oldSrcStages = getOldPipelineStageFlags((PipelineStageFlags)srcStages);
+                VkPipelineStageFlags oldDstStages = getOldPipelineStageFlags((PipelineStageFlags)dstStages);
+
+                // Stage masks can't be empty without synchronization2
+                if (oldSrcStages == 0)
+                    oldSrcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+                if (oldDstStages == 0)
+                    oldDstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+                vkCmdPipelineBarrier(
+                    cb.GetNativeHandle(),
+                    oldSrcStages,
+                    oldDstStages,
+                    VK_DEPENDENCY_BY_REGION_BIT,
+                    0, nullptr,
+                    (uint32_t)oldBufferBarriers.size(), oldBufferBarriers.data(),
+                    (uint32_t)oldImageBarriers.size(), oldImageBarriers.data()
+                );
+            }
+
+            imageBarriers.clear();
+            bufferBarriers.clear();
+        }
+    private:
+        std::vector<VkImageMemoryBarrier2> imageBarriers;
+        std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+    };
+
+    // Threads that stay alive between executions. Run() blocks until every job
+    // has been handed out and finished. The calling thread doesn't take jobs
+    // itself, since each worker records into its own command pool.
+    class RenderGraphWorkerPool
+    {
+    public:
+        RenderGraphWorkerPool(uint32_t numWorkers)
+        {
+            for (uint32_t i = 0; i < numWorkers; i++)
+            {
+                threads.emplace_back([this, i]() { workerLoop(i); });
+            }
+        }
+
+        uint32_t GetNumWorkers() const
+        {
+            return (uint32_t)threads.size();
+        }
+
+        void Run(uint32_t numJobs, const std::function<void(uint32_t job, uint32_t worker)>& fn)
+        {
+            if (numJobs == 0)
+                return;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            jobFn = &fn;
+            nextJob = 0;
+            numJobsTotal = numJobs;
+            numJobsRemaining = numJobs;
+            generation++;
+            wakeCondition.notify_all();
+
+            doneCondition.wait(lock, [this]() { return numJobsRemaining == 0; });
+            jobFn = nullptr;
+        }
+
+        ~RenderGraphWorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+
+            wakeCondition.notify_all();
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+        }
+    private:
+        void workerLoop(uint32_t worker)
+        {
+            uint64_t seenGeneration = 0;
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while (true)
+            {
+                wakeCondition.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+
+                if (stopping)
+                    return;
+
+                seenGeneration = generation;
+
+                while (nextJob < numJobsTotal)
+                {
+                    uint32_t job = nextJob++;
+
+                    lock.unlock();
+                    (*jobFn)(job, worker);
+                    lock.lock();
+
+                    if (--numJobsRemaining == 0)
+                        doneCondition.notify_one();
+                }
+            }
+        }
+
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wakeCondition;
+        std::condition_variable doneCondition;
+        const std::function<void(uint32_t, uint32_t)>* jobFn = nullptr;
+        uint32_t nextJob = 0;
+        uint32_t numJobsTotal = 0;
+        uint32_t numJobsRemaining = 0;
+        uint64_t generation = 0;
+        bool stopping = false;
+    };
+
+    RenderGraphPass::RenderGraphPass(const char* name)
+        : name(name)
+    {}
+
+    RenderGraphPass& RenderGraphPass::ReadTexture(Texture* tex, ImageLayout layout, AccessFlags access, PipelineStageFlags stage)
+    {
+        for (TextureUsage& usage : textureUsages)
+        {
+            if (usage.Texture == tex)
+            {
+                assert(usage.Layout == layout && "A texture can only be used in one layout per pass");
+                usage.Access = usage.Access | access;
+                usage.Stage = usage.Stage | stage;
+                usage.Read = true;
+                return *this;
+            }
+        }
+
+        textureUsages.push_back(TextureUsage{ tex, layout, access, stage, true, false });
+        return *this;
+    }
+
+    RenderGraphPass& RenderGraphPass::WriteTexture(Texture* tex, ImageLayout layout, AccessFlags access, PipelineStageFlags stage)
+    {
+        for (TextureUsage& usage : textureUsages)
+        {
+            if (usage.Texture == tex)
+            {
+                assert(usage.Layout == layout && "A texture can only be used in one layout per pass");
+                usage.Access = usage.Access | access;
+                usage.Stage = usage.Stage | stage;
+                usage.Write = true;
+                return *this;
+            }
+        }
+
+        textureUsages.push_back(TextureUsage{ tex, layout, access, stage, false, true });
+        return *this;
+    }
+
+    RenderGraphPass& RenderGraphPass::ReadWriteTexture(Texture* tex, ImageLayout layout, AccessFlags access, PipelineStageFlags stage)
+    {
+        ReadTexture(tex, layout, access, stage);
+        return WriteTexture(tex, layout, access, stage);
+    }
+
+    RenderGraphPass& RenderGraphPass::ReadBuffer(Buffer* buf, AccessFlags access, PipelineStageFlags stage)
+    {
+        for (BufferUsage& usage : bufferUsages)
+        {
+            if (usage.Buffer == buf)
+            {
+                usage.Access = usage.Access | access;
+                usage.Stage = usage.Stage | stage;
+                usage.Read = true;
+                return *this;
+            }
+        }
+
+        bufferUsages.push_back(BufferUsage{ buf, access, stage, true, false });
+        return *this;
+    }
+
+    RenderGraphPass& RenderGraphPass::WriteBuffer(Buffer* buf, AccessFlags access, PipelineStageFlags stage)
+    {
+        for (BufferUsage& usage : bufferUsages)
+        {
+            if (usage.Buffer == buf)
+            {
+                usage.Access = usage.Access | access;
+                usage.Stage = usage.Stage | stage;
+                usage.Write = true;
+                return *this;
+            }
+        }
+
+        bufferUsages.push_back(BufferUsage{ buf, access, stage, false, true });
+        return *this;
+    }
+
+    RenderGraphPass& RenderGraphPass::ReadWriteBuffer(Buffer* buf, AccessFlags access, PipelineStageFlags stage)
+    {
+        ReadBuffer(buf, access, stage);
+        return WriteBuffer(buf, access, stage);
+    }
+
+    RenderGraphPass& RenderGraphPass::SampledTexture(Texture* tex, PipelineStageFlags stage)
+    {
+        return ReadTexture(tex, ImageLayout::ReadOnlyOptimal, AccessFlags::ShaderSampledRead, stage);
+    }
+
+    RenderGraphPass& RenderGraphPass::ColorAttachment(Texture* tex, LoadOp loadOp)
+    {
+        if (loadOp == LoadOp::Load)
+        {
+            return ReadWriteTexture(tex, ImageLayout::AttachmentOptimal,
+                AccessFlags::ColorAttachmentReadWrite, PipelineStageFlags::ColorAttachmentOutput);
+        }
+
+        return WriteTexture(tex, ImageLayout::AttachmentOptimal,
+            AccessFlags::ColorAttachmentReadWrite, PipelineStageFlags::ColorAttachmentOutput);
+    }
+
+    RenderGraphPass& RenderGraphPass::ResolveAttachment(Texture* tex)
+    {
+        // Resolves write through the color attachment output stage, even for depth
+        return WriteTexture(tex, ImageLayout::AttachmentOptimal,
+            AccessFlags::ColorAttachmentWrite | AccessFlags::DepthStencilAttachmentWrite,
+            PipelineStageFlags::ColorAttachmentOutput | PipelineStageFlags::LateFragmentTests);
+    }
+
+    RenderGraphPass& RenderGraphPass::DepthAttachment(Texture* tex, LoadOp loadOp)
+    {
+        PipelineStageFlags stages = PipelineStageFlags::EarlyFragmentTests | PipelineStageFlags::LateFragmentTests;
+
+        if (loadOp == LoadOp::Load)
+        {
+            return ReadWriteTexture(tex, ImageLayout::AttachmentOptimal,
+                AccessFlags::DepthStencilAttachmentReadWrite, stages);
+        }
+
+        return WriteTexture(tex, ImageLayout::AttachmentOptimal,
+            AccessFlags::DepthStencilAttachmentReadWrite, stages);
+    }
+
+    RenderGraphPass& RenderGraphPass::TransferSource(Texture* tex)
+    {
+        return ReadTexture(tex, ImageLayout::TransferSrcOptimal, AccessFlags::TransferRead, PipelineStageFlags::Transfer);
+    }
+
+    RenderGraphPass& RenderGraphPass::TransferDestination(Texture* tex)
+    {
+        return WriteTexture(tex, ImageLayout::TransferDstOptimal, AccessFlags::TransferWrite, PipelineStageFlags::Transfer);
+    }
+
+    RenderGraphPass& RenderGraphPass::SideEffects()
+    {
+        hasSideEffects = true;
+        return *this;
+    }
+
+    RenderGraphPass& RenderGraphPass::Execute(std::function<void(CommandBuffer)> callback)
+    {
+        this->callback = std::move(callback);
+        return *this;
+    }
+
+    RenderGraph::RenderGraph(Core* core)
+        : core(core)
+    {}
+
+    RenderGraph::~RenderGraph()
+    {
+        Reset();
+        destroyWorkers();
+    }
+
+    RenderGraphPass& RenderGraph::AddPass(const char* name)
+    {
+        compiled = false;
+        RenderGraphPass* pass = new RenderGraphPass(name);
+        passes.push_back(pass);
+        return *pass;
+    }
+
+    void RenderGraph::MarkOutput(Texture* tex, ImageLayout layout, AccessFlags access, PipelineStageFlags stage)
+    {
+        assert(!transientIndices.contains(tex) && "Transient textures can't be graph outputs");
+        compiled = false;
+        textureOutputs.push_back(TextureOutput{ tex, layout, access, stage });
+    }
+
+    void RenderGraph::MarkOutput(Buffer* buf, AccessFlags access, PipelineStageFlags stage)
+    {
+        assert(!transientIndices.contains(buf) && "Transient buffers can't be graph outputs");
+        compiled = false;
+        bufferOutputs.push_back(BufferOutput{ buf, access, stage });
+    }
+
+    Texture* RenderGraph::CreateTransientTexture(const TextureCreateInfo& createInfo)
+    {
+        assert(transientHeaps.empty() && "Transient resources have to be created before the first Compile()");
+
+        TextureCreateInfo tci = createInfo;
+        tci.DeferMemoryBinding = true;
+        Texture* tex = new Texture(core, tci);
+
+        transientIndices[tex] = (uint32_t)transients.size();
+        transients.push_back(TransientResource{ .Texture = tex, .Buffer = nullptr });
+        return tex;
+    }
+
+    Buffer* RenderGraph::CreateTransientBuffer(const BufferCreateInfo& createInfo)
+    {
+        assert(transientHeaps.empty() && "Transient resources have to be created before the first Compile()");
+
+        BufferCreateInfo bci = createInfo;
+        bci.DeferMemoryBinding = true;
+        Buffer* buf = new Buffer(core, bci);
+
+        transientIndices[buf] = (uint32_t)transients.size();
+        transients.push_back(TransientResource{ .Texture = nullptr, .Buffer = buf });
+        return buf;
+    }
+
+    void RenderGraph::SetTransientMemoryPool(MemoryPool* pool)
+    {
+        transientPool = pool;
+    }
+
+    uint64_t RenderGraph::GetTransientMemorySize()
+    {
+        uint64_t size = 0;
+        for (AliasedMemory* heap : transientHeaps)
+        {
+            size += heap->GetSize();
+        }
+
+        return size;
+    }
+
+    uint64_t RenderGraph::GetUnaliasedTransientMemorySize()
+    {
+        return unaliasedTransientSize;
+    }
+
+    void RenderGraph::EnableParallelRecording(uint32_t numWorkers, uint32_t passesPerCommandBuffer)
+    {
+        assert(passesPerCommandBuffer > 0);
+        destroyWorkers();
+        this->passesPerCommandBuffer = passesPerCommandBuffer;
+
+        if (numWorkers == 0)
+            return;
+
+        workerPool = new RenderGraphWorkerPool(numWorkers);
+
+        uint32_t numPools = numWorkers * core->GetNumFramesInFlight();
+        for (uint32_t i = 0; i < numPools; i++)
+        {
+            commandPools.push_back(new CommandPool(core));
+        }
+
+        commandPoolResetFrames.resize(numPools, ~0ull);
+    }
+
+    void RenderGraph::destroyWorkers()
+    {
+        // Joins the threads, so nothing is recording into the pools anymore
+        delete workerPool;
+        workerPool = nullptr;
+
+        for (CommandPool* pool : commandPools)
+        {
+            delete pool;
+        }
+
+        commandPools.clear();
+        commandPoolResetFrames.clear();
+    }
+
+    void RenderGraph::recordPass(RenderGraphPass* pass, CommandBuffer cb)
+    {
+        if (!pass->callback)
+            return;
+
+        cb.BeginDebugLabel(pass->name, 0.5f, 0.5f, 0.5f);
+        pass->callback(cb);
+        cb.EndDebugLabel();
+    }
+
+    void RenderGraph::computeTransientLifetimes()
+    {
+        for (TransientResource& transient : transients)
+        {
+            transient.FirstUse = INT32_MAX;
+            transient.LastUse = -1;
+        }
+
+        auto markUse = [&](const void* resource, int position)
+        {
+            auto it = transientIndices.find(resource);
+            if (it == transientIndices.end())
+                return;
+
+            TransientResource& transient = transients[it->second];
+            transient.FirstUse = std::min(transient.FirstUse, position);
+            transient.LastUse = std::max(transient.LastUse, position);
+        };
+
+        for (int position = 0; position < (int)executionOrder.size(); position++)
+        {
+            RenderGraphPass* pass = passes[executionOrder[position]];
+
+            for (const RenderGraphPass::TextureUsage& usage : pass->textureUsages)
+                markUse(usage.Texture, position);
+
+            for (const RenderGraphPass::BufferUsage& usage : pass->bufferUsages)
+                markUse(usage.Buffer, position);
+        }
+    }
+
+    bool lifetimesOverlap(int firstA, int lastA, int firstB, int lastB)
+    {
+        return firstA <= lastB && firstB <= lastA;
+    }
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void RenderGraph::allocateTransients()
+    {
+        const Handles* handles = core->GetHandles();
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(handles->PhysicalDevice, &properties);
+        uint64_t granularity = properties.limits.bufferImageGranularity;
+
+        // Resources can only share an allocation if they can live in the same
+        // memory types, so split them into heaps by memory type bits
+        struct Heap
+        {
+            uint32_t MemoryTypeBits;
+            std::vector<uint32_t> Members;
+            bool HasTextures = false;
+            bool HasBuffers = false;
+        };
+
+        std::vector<Heap> heaps;
+        unaliasedTransientSize = 0;
+
+        for (uint32_t i = 0; i < transients.size(); i++)
+        {
+            TransientResource& transient = transients[i];
+            transient.Requirements = transient.Texture
+                ? transient.Texture->GetMemoryRequirements()
+                : transient.Buffer->GetMemoryRequirements();
+            unaliasedTransientSize += transient.Requirements.Size;
+
+            auto heapIt = std::find_if(heaps.begin(), heaps.end(),
+                [&](const Heap& h) { return h.MemoryTypeBits == transient.Requirements.MemoryTypeBits; });
+
+            if (heapIt == heaps.end())
+            {
+                heaps.push_back(Heap{ transient.Requirements.MemoryTypeBits });
+                heapIt = heaps.end() - 1;
+            }
+
+            transient.Heap = (uint32_t)(heapIt - heaps.begin());
+            heapIt->Members.push_back(i);
+
+            if (transient.Texture)
+                heapIt->HasTextures = true;
+            else
+                heapIt->HasBuffers = true;
+        }
+
+        for (uint32_t heapIdx = 0; heapIdx < heaps.size(); heapIdx++)
+        {
+            Heap& heap = heaps[heapIdx];
+
+            // Place the biggest resources first, each at the lowest offset that
+            // doesn't overlap anything already placed that's alive at the same time
+            std::vector<uint32_t> order = heap.Members;
+            std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+            {
+                return transients[a].Requirements.Size > transients[b].Requirements.Size;
+            });
+
+            // Linear and optimal resources that are alive at the same time can't
+            // share a page
+            bool mixed = heap.HasTextures && heap.HasBuffers;
+            uint64_t heapSize = 0;
+            uint64_t heapAlignment = 1;
+            std::vector<uint32_t> placed;
+
+            for (uint32_t idx : order)
+            {
+                TransientResource& transient = transients[idx];
+                uint64_t alignment = transient.Requirements.Alignment;
+                if (mixed)
+                    alignment = std::max(alignment, granularity);
+
+                std::vector<uint64_t> candidates{ 0 };
+                for (uint32_t other : placed)
+                {
+                    const TransientResource& o = transients[other];
+                    if (lifetimesOverlap(transient.FirstUse, transient.LastUse, o.FirstUse, o.LastUse))
+                        candidates.push_back(alignUp(o.Offset + o.Requirements.Size, alignment));
+                }
+
+                std::sort(candidates.begin(), candidates.end());
+
+                for (uint64_t candidate : candidates)
+                {
+                    bool fits = true;
+                    for (uint32_t other : placed)
+                    {
+                        const TransientResource& o = transients[other];
+                        if (!lifetimesOverlap(transient.FirstUse, transient.LastUse, o.FirstUse, o.LastUse))
+                            continue;
+
+                        if (candidate < o.Offset + o.Requirements.Size && o.Offset < candidate + transient.Requirements.Size)
+                        {
+                            fits = false;
+                            break;
+                        }
+                    }
+
+                    if (fits)
+                    {
+                        transient.Offset = candidate;
+                        break;
+                    }
+                }
+
+                placed.push_back(idx);
+                heapSize = std::max(heapSize, transient.Offset + transient.Requirements.Size);
+                heapAlignment = std::max(heapAlignment, alignment);
+            }
+
+            MemoryRequirements heapRequirements{ heapSize, heapAlignment, heap.MemoryTypeBits };
+            AliasedMemory* memory = new AliasedMemory(core, transientPool, heapRequirements);
+            transientHeaps.push_back(memory);
+
+            for (uint32_t idx : heap.Members)
+            {
+                TransientResource& transient = transients[idx];
+                if (transient.Texture)
+                    memory->Bind(transient.Texture, transient.Offset);
+                else
+                    memory->Bind(transient.Buffer, transient.Offset);
+            }
+
+            for (uint32_t a : heap.Members)
+            {
+                for (uint32_t b : heap.Members)
+                {
+                    const TransientResource& ta = transients[a];
+                    const TransientResource& tb = transients[b];
+
+                    if (a != b && ta.Offset < tb.Offset + tb.Requirements.Size && tb.Offset < ta.Offset + ta.Requirements.Size)
+                        transients[a].Aliases.push_back(b);
+                }
+            }
+        }
+    }
+
+    // Walks the included passes in declaration order and records, for each one,
+    // which earlier passes it has to run after. If `dataDeps` is given, the
+    // read-after-write edges (the ones that carry data) are also written to it.
+    // `lastWriters` ends up holding the final writer of every resource.
+    void RenderGraph::buildDependencies(const std::vector<bool>& included, std::vector<std::vector<uint32_t>>& orderDeps,
+        std::vector<std::vector<uint32_t>>* dataDeps, std::unordered_map<const void*, uint32_t>& lastWriters)
+    {
+        struct ResourceHistory
+        {
+            int LastWriter = -1;
+            std::vector<uint32_t> ReadersSinceWrite;
+        };
+
+        std::unordered_map<const void*, ResourceHistory> history;
+        orderDeps.assign(passes.size(), {});
+        if (dataDeps)
+            dataDeps->assign(passes.size(), {});
+
+        auto addDep = [](std::vector<uint32_t>& deps, uint32_t dep)
+        {
+            for (uint32_t d : deps)
+            {
+                if (d == dep)
+                    return;
+            }
+
+            deps.push_back(dep);
+        };
+
+        auto visit = [&](uint32_t passIdx, const void* resource, bool read, bool write)
+        {
+            ResourceHistory& h = history[resource];
+
+            if (read && h.LastWriter != -1)
+            {
+                addDep(orderDeps[passIdx], (uint32_t)h.LastWriter);
+                if (dataDeps)
+                    addDep((*dataDeps)[passIdx], (uint32_t)h.LastWriter);
+            }
+
+            if (write)
+            {
+                for (uint32_t reader : h.ReadersSinceWrite)
+                {
+                    if (reader != passIdx)
+                        addDep(orderDeps[passIdx], reader);
+                }
+
+                if (h.LastWriter != -1 && h.LastWriter != (int)passIdx)
+                    addDep(orderDeps[passIdx], (uint32_t)h.LastWriter);
+
+                h.LastWriter = (int)passIdx;
+                h.ReadersSinceWrite.clear();
+            }
+            else
+            {
+                h.ReadersSinceWrite.push_back(passIdx);
+            }
+        };
+
+        for (uint32_t i = 0; i < passes.size(); i++)
+        {
+            if (!included[i])
+                continue;
+
+            for (const RenderGraphPass::TextureUsage& usage : passes[i]->textureUsages)
+                visit(i, usage.Texture, usage.Read, usage.Write);
+
+            for (const RenderGraphPass::BufferUsage& usage : passes[i]->bufferUsages)
+                visit(i, usage.Buffer, usage.Read, usage.Write);
+        }
+
+        lastWriters.clear();
+        for (const auto& pair : history)
+        {
+            if (pair.second.LastWriter != -1)
+                lastWriters[pair.first] = (uint32_t)pair.second.LastWriter;
+        }
+    }
+
+    void RenderGraph::Compile()
+    {
+        uint32_t numPasses = (uint32_t)passes.size();
+
+        // Cull passes that don't contribute to an output. Dependencies always point
+        // at earlier passes, so a single backwards sweep is enough.
+        std::vector<std::vector<uint32_t>> orderDeps;
+        std::vector<std::vector<uint32_t>> dataDeps;
+        std::unordered_map<const void*, uint32_t> lastWriters;
+        buildDependencies(std::vector<bool>(numPasses, true), orderDeps, &dataDeps, lastWriters);
+
+        std::vector<bool> alive(numPasses, false);
+        for (uint32_t i = 0; i < numPasses; i++)
+        {
+            alive[i] = passes[i]->hasSideEffects;
+        }
+
+        for (const TextureOutput& output : textureOutputs)
+        {
+            auto it = lastWriters.find(output.Texture);
+            if (it != lastWriters.end())
+                alive[it->second] = true;
+        }
+
+        for (const BufferOutput& output : bufferOutputs)
+        {
+            auto it = lastWriters.find(output.Buffer);
+            if (it != lastWriters.end())
+                alive[it->second] = true;
+        }
+
+        for (int i = (int)numPasses - 1; i >= 0; i--)
+        {
+            if (!alive[i])
+                continue;
+
+            for (uint32_t dep : dataDeps[i])
+                alive[dep] = true;
+        }
+
+        // Rebuild the ordering constraints without the culled passes, then
+        // topologically sort. Out of the passes that are ready, prefer the one
+        // whose dependencies finished longest ago so that consumers don't
+        // immediately stall on their producers.
+        buildDependencies(alive, orderDeps, nullptr, lastWriters);
+
+        std::vector<uint32_t> remainingDeps(numPasses, 0);
+        std::vector<std::vector<uint32_t>> dependents(numPasses);
+        for (uint32_t i = 0; i < numPasses; i++)
+        {
+            remainingDeps[i] = (uint32_t)orderDeps[i].size();
+            for (uint32_t dep : orderDeps[i])
+                dependents[dep].push_back(i);
+        }
+
+        std::vector<int> readyAfter(numPasses, -1);
+        std::vector<uint32_t> ready;
+        for (uint32_t i = 0; i < numPasses; i++)
+        {
+            if (alive[i] && remainingDeps[i] == 0)
+                ready.push_back(i);
+        }
+
+        executionOrder.clear();
+        while (!ready.empty())
+        {
+            size_t best = 0;
+            for (size_t i = 1; i < ready.size(); i++)
+            {
+                uint32_t candidate = ready[i];
+                uint32_t current = ready[best];
+                if (readyAfter[candidate] < readyAfter[current] ||
+                    (readyAfter[candidate] == readyAfter[current] && candidate < current))
+                {
+                    best = i;
+                }
+            }
+
+            uint32_t passIdx = ready[best];
+            ready.erase(ready.begin() + best);
+
+            int position = (int)executionOrder.size();
+            executionOrder.push_back(passIdx);
+
+            for (uint32_t dependent : dependents[passIdx])
+            {
+                readyAfter[dependent] = position;
+                if (--remainingDeps[dependent] == 0)
+                    ready.push_back(dependent);
+            }
+        }
+
+        if (!transients.empty())
+        {
+            computeTransientLifetimes();
+
+            if (transientHeaps.empty())
+            {
+                allocateTransients();
+            }
+            else
+            {
+                // Memory has already been placed for the old lifetimes
+                for (const TransientResource& transient : transients)
+                {
+                    for (uint32_t alias : transient.Aliases)
+                    {
+                        const TransientResource& other = transients[alias];
+                        assert(!lifetimesOverlap(transient.FirstUse, transient.LastUse, other.FirstUse, other.LastUse) &&
+                            "Transient resource lifetimes changed after their memory was allocated; Reset() the graph instead");
+                    }
+                }
+            }
+        }
+
+        compiled = true;
+    }
+
+    void RenderGraph::Execute(CommandBuffer cb)
+    {
+        if (!compiled)
+            Compile();
+
+        bool legacyLayouts = vkCmdPipelineBarrier2 == NULL;
+
+        // ReadOnlyOptimal and AttachmentOptimal need synchronization2
+        auto resolveLayout = [&](Texture* tex, ImageLayout layout)
+        {
+            if (!legacyLayouts)
+                return layout;
+
+            bool isDepth = (tex->getAspectFlags() & VK_IMAGE_ASPECT_DEPTH_BIT) != 0;
+
+            if (layout == ImageLayout::AttachmentOptimal)
+                return isDepth ? ImageLayout::DepthStencilAttachmentOptimal : ImageLayout::ColorAttachmentOptimal;
+
+            if (layout == ImageLayout::ReadOnlyOptimal)
+                return isDepth ? ImageLayout::DepthStencilReadOnlyOptimal : ImageLayout::ShaderReadOnlyOptimal;
+
+            return layout;
+        };
+
+        std::unordered_map<Texture*, ResourceState> textureStates;
+        std::unordered_map<Buffer*, ResourceState> bufferStates;
+
+        // A transient resource's old contents are discarded when it's first used,
+        // but that first use still has to wait for everything else that used
+        // the same memory: aliases used earlier in this execution, and aliases
+        // (or the resource itself) used later on during the previous one.
+        auto aliasedState = [&](uint32_t transientIdx)
+        {
+            uint64_t stages = 0;
+            uint64_t writeAccess = 0;
+
+            auto addPrevious = [&](const TransientResource& transient)
+            {
+                if (transient.Texture)
+                {
+                    auto it = textureStates.find(transient.Texture);
+                    if (it != textureStates.end())
+                    {
+                        stages |= it->second.WriteStages | it->second.ReadStages;
+                        writeAccess |= it->second.WriteAccess;
+                        return;
+                    }
+
+                    stages |= (uint64_t)transient.Texture->lastPipelineStage;
+                    writeAccess |= (uint64_t)transient.Texture->lastAccess & WRITE_ACCESS_MASK;
+                }
+                else
+                {
+                    auto it = bufferStates.find(transient.Buffer);
+                    if (it != bufferStates.end())
+                    {
+                        stages |= it->second.WriteStages | it->second.ReadStages;
+                        writeAccess |= it->second.WriteAccess;
+                        return;
+                    }
+
+                    stages |= (uint64_t)transient.Buffer->lastPipelineStage;
+                    writeAccess |= (uint64_t)transient.Buffer->lastAccess & WRITE_ACCESS_MASK;
+                }
+            };
+
+            addPrevious(transients[transientIdx]);
+            for (uint32_t alias : transients[transientIdx].Aliases)
+            {
+                // Never used, so it can't have touched the memory
+                if (transients[alias].FirstUse > transients[alias].LastUse)
+                    continue;
+
+                addPrevious(transients[alias]);
+            }
+
+            ResourceState state{};
+            state.Layout = ImageLayout::Undefined;
+            state.WriteStages = stages;
+            state.WriteAccess = writeAccess;
+            return state;
+        };
+
+        auto getTextureState = [&](Texture* tex) -> ResourceState&
+        {
+            auto it = textureStates.find(tex);
+            if (it != textureStates.end())
+                return it->second;
+
+            tex->externallySynchronized = true;
+
+            auto transientIt = transientIndices.find(tex);
+            if (transientIt != transientIndices.end())
+                return textureStates[tex] = aliasedState(transientIt->second);
+
+            return textureStates[tex] = initialState(tex->lastLayout, tex->lastAccess, tex->lastPipelineStage);
+        };
+
+        auto getBufferState = [&](Buffer* buf) -> ResourceState&
+        {
+            auto it = bufferStates.find(buf);
+            if (it != bufferStates.end())
+                return it->second;
+
+            buf->externallySynchronized = true;
+
+            auto transientIt = transientIndices.find(buf);
+            if (transientIt != transientIndices.end())
+                return bufferStates[buf] = aliasedState(transientIt->second);
+
+            return bufferStates[buf] = initialState(ImageLayout::Undefined, buf->lastAccess, buf->lastPipelineStage);
+        };
+
+        // Secondary command buffers can't continue a render pass from the primary,
+        // so the legacy render pass path has to record everything in one place
+        bool parallel = workerPool != nullptr && g_renderPassCache == nullptr && executionOrder.size() > 1;
+
+        // When recording in parallel every pass gets its own batch, so that all
+        // the barriers can be resolved before any recording starts
+        std::vector<BarrierBatch> passBatches(parallel ? executionOrder.size() : 0);
+        BarrierBatch outputBatch;
+        BarrierBatch* batch = &outputBatch;
+
+        auto useTexture = [&](Texture* tex, ImageLayout layout, AccessFlags access, PipelineStageFlags stage, bool read, bool write)
+        {
+            ResourceAccess ra{ resolveLayout(tex, layout), (uint64_t)access, (uint64_t)stage, read, write };
+            Barrier barrier;
+            if (transitionResource(getTextureState(tex), ra, barrier))
+                batch->AddImageBarrier(tex, tex->getAspectFlags(), barrier);
+        };
+
+        auto useBuffer = [&](Buffer* buf, AccessFlags access, PipelineStageFlags stage, bool read, bool write)
+        {
+            ResourceAccess ra{ ImageLayout::Undefined, (uint64_t)access, (uint64_t)stage, read, write };
+            Barrier barrier;
+            if (transitionResource(getBufferState(buf), ra, barrier))
+                batch->AddBufferBarrier(buf, barrier);
+        };
+
+        for (size_t i = 0; i < executionOrder.size(); i++)
+        {
+            RenderGraphPass* pass = passes[executionOrder[i]];
+
+            if (parallel)
+                batch = &passBatches[i];
+
+            for (const RenderGraphPass::TextureUsage& usage : pass->textureUsages)
+                useTexture(usage.Texture, usage.Layout, usage.Access, usage.Stage, usage.Read, usage.Write);
+
+            for (const RenderGraphPass::BufferUsage& usage : pass->bufferUsages)
+                useBuffer(usage.Buffer, usage.Access, usage.Stage, usage.Read, usage.Write);
+
+            if (!parallel)
+            {
+                batch->Flush(cb);
+                recordPass(pass, cb);
+            }
+        }
+
+        if (parallel)
+        {
+            uint32_t numWorkers = workerPool->GetNumWorkers();
+            uint32_t poolOffset = core->GetFrameIndex() * numWorkers;
+            uint64_t frameNumber = core->GetFrameNumber();
+
+            // The last time this frame's pools were used was a full set of frames
+            // in flight ago, so BeginFrame has already waited for them
+            for (uint32_t i = poolOffset; i < poolOffset + numWorkers; i++)
+            {
+                if (commandPoolResetFrames[i] != frameNumber)
+                {
+                    commandPools[i]->Reset();
+                    commandPoolResetFrames[i] = frameNumber;
+                }
+            }
+
+            uint32_t numPasses = (uint32_t)executionOrder.size();
+            uint32_t numGroups = (numPasses + passesPerCommandBuffer - 1) / passesPerCommandBuffer;
+            std::vector<CommandBuffer> secondaries(numGroups, CommandBuffer(nullptr));
+
+            workerPool->Run(numGroups, [&](uint32_t group, uint32_t worker)
+            {
+                CommandPool* pool = commandPools[poolOffset + worker];
+                CommandBuffer scb = pool->BeginSecondary();
+
+                uint32_t end = std::min(numPasses, (group + 1) * passesPerCommandBuffer);
+                for (uint32_t i = group * passesPerCommandBuffer; i < end; i++)
+                {
+                    passBatches[i].Flush(scb);
+                    recordPass(passes[executionOrder[i]], scb);
+                }
+
+                pool->End(scb);
+                secondaries[group] = scb;
+            });
+
+            cb.ExecuteCommands(secondaries.data(), numGroups);
+            batch = &outputBatch;
+        }
+
+        for (const TextureOutput& output : textureOutputs)
+            useTexture(output.Texture, output.Layout, output.Access, output.Stage, true, false);
+
+        for (const BufferOutput& output : bufferOutputs)
+            useBuffer(output.Buffer, output.Access, output.Stage, true, false);
+
+        batch->Flush(cb);
+
+        // Hand the resources back to the regular Acquire path
+        for (auto& pair : textureStates)
+        {
+            Texture* tex = pair.first;
+            const ResourceState& state = pair.second;
+            tex->lastLayout = state.Layout;
+            tex->lastAccess = (AccessFlags)(state.WriteAccess | state.ReadAccess);
+            tex->lastPipelineStage = (PipelineStageFlags)(state.WriteStages | state.ReadStages);
+            tex->externallySynchronized = false;
+        }
+
+        for (auto& pair : bufferStates)
+        {
+            Buffer* buf = pair.first;
+            const ResourceState& state = pair.second;
+            buf->lastAccess = (AccessFlags)(state.WriteAccess | state.ReadAccess);
+            buf->lastPipelineStage = (PipelineStageFlags)(state.WriteStages | state.ReadStages);
+            buf->externallySynchronized = false;
+        }
+    }
+
+    void RenderGraph::Reset()
+    {
+        for (RenderGraphPass* pass : passes)
+        {
+            delete pass;
+        }
+
+        for (TransientResource& transient : transients)
+        {
+            delete transient.Texture;
+            delete transient.Buffer;
+        }
+
+        for (AliasedMemory* heap : transientHeaps)
+        {
+            delete heap;
+        }
+
+        passes.clear();
+        transients.clear();
+        transientIndices.clear();
+        transientHeaps.clear();
+        unaliasedTransientSize = 0;
+        textureOutputs.clear();
+        bufferOutputs.clear();
+        executionOrder.clear();
+        compiled = false;
+    }
+
+    uint32_t RenderGraph::GetNumPasses()
+    {
+        return (uint32_t)passes.size();
+    }
+
+    uint32_t RenderGraph::GetNumCulledPasses()
+    {
+        return compiled ? (uint32_t)(passes.size() - executionOrder.size()) : 0;
+    }
+}
@@ -0,0 +1,134 @@
+#include <LayoutCache.hpp>
+#include <R2/VKCore.hpp>
+#include <algorithm>
+#include <assert.h>
+#include <vector>
+
+namespace R2::VK
+{
+    LayoutCache* g_layoutCache;
+
+    LayoutCache::LayoutCache(const Handles* handles)
+        : handles(handles)
+    {
+    }
+
+    LayoutCache::~LayoutCache()
+    {
+        setLayouts.Clear([&](VkDescriptorSetLayout dsl)
+        {
+            vkDestroyDescriptorSetLayout(handles->Device, dsl, handles->AllocCallbacks);
+        });
+
+        pipelineLayouts.Clear([&](VkPipelineLayout pl)
+        {
+            vkDestroyPipelineLayout(handles->Device, pl, handles->AllocCallbacks);
+        });
+    }
+
+    VkDescriptorSetLayout LayoutCache::AcquireDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& createInfo)
+    {
+        const VkDescriptorBindingFlags* bindingFlags = nullptr;
+        const VkBaseInStructure* next = (const VkBaseInStructure*)createInfo.pNext;
+
+        while (next)
+        {
+            if (next->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO)
+            {
+                bindingFlags = ((const VkDescriptorSetLayoutBindingFlagsCreateInfo*)next)->pBindingFlags;
+            }
+            next = next->pNext;
+        }
+
+        // Binding order doesn't change the layout, so sort to catch more duplicates
+        std::vector<uint32_t> order(createInfo.bindingCount);
+        for (uint32_t i = 0; i < createInfo.bindingCount; i++)
+        {
+            order[i] = i;
+        }
+
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+        {
+            return createInfo.pBindings[a].binding < createInfo.pBindings[b].binding;
+        });
+
+        std::string key;
+        appendCacheKey(key, createInfo.flags);
+        appendCacheKey(key, createInfo.bindingCount);
+
+        for (uint32_t i : order)
+        {
+            const VkDescriptorSetLayoutBinding& b = createInfo.pBindings[i];
+            appendCacheKey(key, b.binding);
+            appendCacheKey(key, b.descriptorType);
+            appendCacheKey(key, b.descriptorCount);
+            appendCacheKey(key, b.stageFlags);
+            appendCacheKey(key, bindingFlags ? bindingFlags[i] : 0u);
+
+            if (b.pImmutableSamplers)
+            {
+                for (uint32_t j = 0; j < b.descriptorCount; j++)
+                {
+                    appendCacheKey(key, b.pImmutableSamplers[j]);
+                }
+            }
+        }
+
+        return setLayouts.Acquire(key, [&]()
+        {
+            VkDescriptorSetLayout dsl;
+            VKCHECK(vkCreateDescriptorSetLayout(handles->Device, &createInfo, handles->AllocCallbacks, &dsl));
+            return dsl;
+        });
+    }
+
+    VkPipelineLayout LayoutCache::AcquirePipelineLayout(const VkPipelineLayoutCreateInfo& createInfo)
+    {
+        // Set layouts are keyed by their description rather than their handle. A set
+        // layout can be destroyed while pipeline layouts made from it are still
+        // cached, and the driver is then free to reuse its handle value.
+        std::string key;
+        appendCacheKey(key, createInfo.setLayoutCount);
+        for (uint32_t i = 0; i < createInfo.setLayoutCount; i++)
+        {
+            std::string setLayoutKey;
+            bool known = setLayouts.GetKey(createInfo.pSetLayouts[i], setLayoutKey);
+            assert(known);
+
+            appendCacheKey(key, (uint64_t)setLayoutKey.size());
+            key.append(setLayoutKey);
+        }
+
+        appendCacheKey(key, createInfo.pushConstantRangeCount);
+        for (uint32_t i = 0; i < createInfo.pushConstantRangeCount; i++)
+        {
+            const VkPushConstantRange& pcr = createInfo.pPushConstantRanges[i];
+            appendCacheKey(key, pcr.stageFlags);
+            appendCacheKey(key, pcr.offset);
+            appendCacheKey(key, pcr.size);
+        }
+
+        return pipelineLayouts.Acquire(key, [&]()
+        {
+            VkPipelineLayout pl;
+            VKCHECK(vkCreatePipelineLayout(handles->Device, &createInfo, handles->AllocCallbacks, &pl));
+            return pl;
+        });
+    }
+
+    void LayoutCache::Release(VkDescriptorSetLayout layout)
+    {
+        if (setLayouts.Release(layout))
+        {
+            vkDestroyDescriptorSetLayout(handles->Device, layout, handles->AllocCallbacks);
+        }
+    }
+
+    void LayoutCache::Release(VkPipelineLayout layout)
+    {
+        if (pipelineLayouts.Release(layout))
+        {
+            vkDestroyPipelineLayout(handles->Device, layout, handles->AllocCallbacks);
+        }
+    }
+}
@@ -1,10 +1,15 @@
 #include <volk.h>
 #include <R2/VK.hpp>
+#include <R2/VKDeletionQueue.hpp>
 #include <RenderPassCache.hpp>
+#include <RuntimeMetrics.hpp>
+#include <algorithm>
+#include <assert.h>
+#include <vector>
 
 namespace R2::VK
 {
-    VkAttachmentDescription getAttachmentDesc(RenderPassAttachment attachment, bool isColor)
+    VkAttachmentDescription2 getAttachmentDesc(RenderPassAttachment attachment, bool isColor)
     {
         VkImageLayout layout;
         if (isColor)
@@ -16,7 +21,8 @@ namespace R2::VK
             layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
         }
         
-        return VkAttachmentDescription {
+        return VkAttachmentDescription2 {
+            .sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2,
             .flags = 0,
             .format = attachment.format,
             .samples = attachment.samples,
@@ -28,107 +34,302 @@ namespace R2::VK
             .finalLayout = layout
         };
     }
+
+    // Resolve targets are single sampled and fully overwritten by the resolve
+    VkAttachmentDescription2 getResolveAttachmentDesc(RenderPassAttachment source, bool isColor)
+    {
+        RenderPassAttachment attachment = source;
+        attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        return getAttachmentDesc(attachment, isColor);
+    }
     
     RenderPassCache::RenderPassCache(Core* core)
         : core(core)
     {
     }
 
-    VkRenderPass RenderPassCache::GetPass(RenderPassKey key)
+    RenderPassCache::~RenderPassCache()
     {
-        auto pos = passes.find(key);
-        if (pos != passes.end())
+        const Handles* handles = core->GetHandles();
+
+        for (auto& shard : framebufferShards)
         {
+            for (auto& pair : shard.entries)
+            {
+                vkDestroyFramebuffer(handles->Device, pair.second.framebuffer, handles->AllocCallbacks);
+            }
+        }
+
+        for (auto& shard : passShards)
+        {
+            for (auto& pair : shard.entries)
+            {
+                vkDestroyRenderPass(handles->Device, pair.second, handles->AllocCallbacks);
+            }
+        }
+    }
+
+    VkRenderPass RenderPassCache::GetPass(const RenderPassKey& key)
+    {
+        size_t hash;
+        auto& shard = getShard(passShards, key, hash);
+        std::lock_guard lock{shard.mutex};
+
+        auto pos = shard.entries.find(key);
+        if (pos != shard.entries.end())
+        {
+            countMetric(Metric::RenderPassCacheHits);
             return pos->second;
         }
 
-        // now how do we create a render pass...
-        VkAttachmentDescription depthDesc = getAttachmentDesc(key.depthAttachment, false);
-        VkAttachmentDescription colorDesc = getAttachmentDesc(key.colorAttachment, true);
+        countMetric(Metric::RenderPassCacheMisses);
+
+        assert(key.numColorAttachments <= MAX_RENDER_PASS_COLOR_ATTACHMENTS);
+        assert(key.numSubpasses <= MAX_SUBPASSES);
+
+        // No subpasses means a single one that writes everything
+        uint32_t numSubpasses = key.numSubpasses;
+        uint32_t colorMasks[MAX_SUBPASSES];
+        uint32_t inputMasks[MAX_SUBPASSES];
+
+        if (numSubpasses == 0)
+        {
+            numSubpasses = 1;
+            colorMasks[0] = (1u << key.numColorAttachments) - 1;
+            inputMasks[0] = 0;
+        }
+        else
+        {
+            for (uint32_t i = 0; i < numSubpasses; i++)
+            {
+                colorMasks[i] = key.subpassColorMasks[i];
+                inputMasks[i] = key.subpassInputMasks[i];
+            }
+        }
+
+        // Only the last subpass resolves. Pipelines don't know about resolves,
+        // which is fine for compatibility only with a single subpass.
+        assert(numSubpasses == 1 || (key.colorResolveMask == 0 && key.depthResolveMode == 0));
 
+        // Depth goes first, followed by the color attachments in order, then
+        // the color resolve attachments and finally the depth resolve attachment
+        VkAttachmentDescription2 attachments[MAX_FRAMEBUFFER_ATTACHMENTS];
         uint32_t attachmentCount = 0;
-        
-        VkAttachmentReference depthRef
+        uint32_t colorAttachmentStart = key.useDepth ? 1 : 0;
+
+        VkAttachmentReference2 depthRef
         {
+            .sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2,
             .attachment = attachmentCount,
-            .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL 
+            .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT
         };
 
-        if (key.useDepth) attachmentCount++;
+        if (key.useDepth)
+        {
+            attachments[attachmentCount++] = getAttachmentDesc(key.depthAttachment, false);
+        }
+
+        for (uint32_t i = 0; i < key.numColorAttachments; i++)
+        {
+            attachments[attachmentCount++] = getAttachmentDesc(key.colorAttachments[i], true);
+        }
+
+        // Indexed by fragment output location in the last subpass
+        VkAttachmentReference2 resolveRefs[MAX_RENDER_PASS_COLOR_ATTACHMENTS];
+        uint32_t lastColorMask = colorMasks[numSubpasses - 1];
+        uint32_t numResolveRefs = 0;
+
+        for (uint32_t i = 0; i < key.numColorAttachments; i++)
+        {
+            if ((lastColorMask & (1u << i)) == 0)
+            {
+                assert((key.colorResolveMask & (1u << i)) == 0);
+                continue;
+            }
+
+            VkAttachmentReference2& ref = resolveRefs[numResolveRefs++];
+            ref = VkAttachmentReference2
+            {
+                .sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2,
+                .attachment = VK_ATTACHMENT_UNUSED,
+                .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT
+            };
+
+            if (key.colorResolveMask & (1u << i))
+            {
+                ref.attachment = attachmentCount;
+                attachments[attachmentCount++] = getResolveAttachmentDesc(key.colorAttachments[i], true);
+            }
+        }
 
-        VkAttachmentReference colorRef
+        VkAttachmentReference2 depthResolveRef
         {
+            .sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2,
             .attachment = attachmentCount,
-            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+            .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT
         };
 
-        if (key.useColor) attachmentCount++;
-
-        VkSubpassDescription subpassDesc
+        VkSubpassDescriptionDepthStencilResolve depthResolve
         {
-            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-            .colorAttachmentCount = key.useColor ? 1u : 0u,
-            .pColorAttachments = key.useColor ? &colorRef : nullptr,
-            .pDepthStencilAttachment = key.useDepth ? &depthRef : nullptr,
+            .sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_DEPTH_STENCIL_RESOLVE,
+            .depthResolveMode = (VkResolveModeFlagBits)key.depthResolveMode,
+            .stencilResolveMode = VK_RESOLVE_MODE_NONE,
+            .pDepthStencilResolveAttachment = &depthResolveRef
         };
 
-        std::vector<VkAttachmentDescription> attachments;
+        bool resolveDepth = key.useDepth && key.depthResolveMode != 0;
+        if (resolveDepth)
+        {
+            attachments[attachmentCount++] = getResolveAttachmentDesc(key.depthAttachment, false);
+        }
 
-        if (key.useDepth) attachments.push_back(depthDesc);
-        if (key.useColor) attachments.push_back(colorDesc);
+        VkSubpassDescription2 subpassDescs[MAX_SUBPASSES];
+        VkAttachmentReference2 colorRefs[MAX_SUBPASSES][MAX_RENDER_PASS_COLOR_ATTACHMENTS];
+        VkAttachmentReference2 inputRefs[MAX_SUBPASSES][MAX_RENDER_PASS_COLOR_ATTACHMENTS];
+        uint32_t preserveRefs[MAX_SUBPASSES][MAX_RENDER_PASS_COLOR_ATTACHMENTS];
+        VkSubpassDependency2 dependencies[MAX_SUBPASSES];
+        uint32_t dependencyCount = 0;
 
-        VkRenderPassMultiviewCreateInfo multiviewCi
+        for (uint32_t s = 0; s < numSubpasses; s++)
         {
-            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO,
-            .subpassCount = 1,
-            .pViewMasks = &key.viewMask,
-            .dependencyCount = 0,
-            .pViewOffsets = nullptr,
-            .correlationMaskCount = (key.viewMask != 0) ? 1u : 0u,
-            .pCorrelationMasks = &key.viewMask
-        };
+            uint32_t numColorRefs = 0;
+            uint32_t numInputRefs = 0;
+            uint32_t numPreserveRefs = 0;
+
+            uint32_t usedBefore = 0;
+            uint32_t usedAfter = 0;
+
+            for (uint32_t other = 0; other < numSubpasses; other++)
+            {
+                if (other < s)
+                    usedBefore |= colorMasks[other] | inputMasks[other];
+                else if (other > s)
+                    usedAfter |= colorMasks[other] | inputMasks[other];
+            }
+
+            for (uint32_t i = 0; i < key.numColorAttachments; i++)
+            {
+                uint32_t bit = 1u << i;
+                bool written = (colorMasks[s] & bit) != 0;
+                bool read = (inputMasks[s] & bit) != 0;
+
+                if (written)
+                {
+                    colorRefs[s][numColorRefs++] = VkAttachmentReference2
+                    {
+                        .sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2,
+                        .attachment = colorAttachmentStart + i,
+                        .layout = read ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT
+                    };
+                }
 
-        VkRenderPassCreateInfo createInfo
+                if (read)
+                {
+                    inputRefs[s][numInputRefs++] = VkAttachmentReference2
+                    {
+                        .sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2,
+                        .attachment = colorAttachmentStart + i,
+                        .layout = written ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT
+                    };
+                }
+
+                // Contents that are needed later have to survive subpasses that don't touch them
+                if (!written && !read && (usedBefore & bit) && (usedAfter & bit))
+                {
+                    preserveRefs[s][numPreserveRefs++] = colorAttachmentStart + i;
+                }
+            }
+
+            bool isLast = s == numSubpasses - 1;
+
+            subpassDescs[s] = VkSubpassDescription2
+            {
+                .sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2,
+                .pNext = (isLast && resolveDepth) ? &depthResolve : nullptr,
+                .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+                .viewMask = key.viewMask,
+                .inputAttachmentCount = numInputRefs,
+                .pInputAttachments = numInputRefs > 0 ? inputRefs[s] : nullptr,
+                .colorAttachmentCount = numColorRefs,
+                .pColorAttachments = numColorRefs > 0 ? colorRefs[s] : nullptr,
+                .pResolveAttachments = (isLast && key.colorResolveMask != 0) ? resolveRefs : nullptr,
+                .pDepthStencilAttachment = key.useDepth ? &depthRef : nullptr,
+                .preserveAttachmentCount = numPreserveRefs,
+                .pPreserveAttachments = numPreserveRefs > 0 ? preserveRefs[s] : nullptr
+            };
+
+            if (s > 0)
+            {
+                // Attachment writes in the previous subpass become visible to
+                // input attachment reads and further attachment access, per pixel
+                dependencies[dependencyCount++] = VkSubpassDependency2
+                {
+                    .sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2,
+                    .srcSubpass = s - 1,
+                    .dstSubpass = s,
+                    .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    .dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    .dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT
+                };
+            }
+        }
+
+        VkRenderPassCreateInfo2 createInfo
         {
-            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-            .pNext = &multiviewCi,
-            .attachmentCount = (uint32_t)attachments.size(),
-            .pAttachments = attachments.data(),
-            .subpassCount = 1,
-            .pSubpasses = &subpassDesc,
-            .dependencyCount = 0,
-            .pDependencies = nullptr
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2,
+            .attachmentCount = attachmentCount,
+            .pAttachments = attachments,
+            .subpassCount = numSubpasses,
+            .pSubpasses = subpassDescs,
+            .dependencyCount = dependencyCount,
+            .pDependencies = dependencyCount > 0 ? dependencies : nullptr,
+            .correlatedViewMaskCount = (key.viewMask != 0) ? 1u : 0u,
+            .pCorrelatedViewMasks = &key.viewMask
         };
 
         const Handles* handles = core->GetHandles();
 
         VkRenderPass renderPass;
-        VKCHECK(vkCreateRenderPass(handles->Device, &createInfo, handles->AllocCallbacks, &renderPass));
+        VKCHECK(vkCreateRenderPass2(handles->Device, &createInfo, handles->AllocCallbacks, &renderPass));
 
-        // leak!!! be evil!!! never destroy!!!!!
-        passes.insert({ key, renderPass });
+        shard.entries.insert({ key, renderPass });
         return renderPass;
     }
 
-    bool isAttachmentDepth(VkFormat format)
+    VkFramebuffer RenderPassCache::GetFramebuffer(const FramebufferKey& key)
     {
-        // FIXME: there are so many more depth formats!!!
-        return format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_D16_UNORM;
-    }
+        size_t hash;
+        auto& shard = getShard(framebufferShards, key, hash);
+        std::lock_guard lock{shard.mutex};
 
-    VkFramebuffer RenderPassCache::GetFramebuffer(FramebufferKey key)
-    {
-        if (framebuffers.contains(key))
+        auto pos = shard.entries.find(key);
+        if (pos != shard.entries.end())
         {
-            return framebuffers.at(key);
+            pos->second.lastUsedFrame = frameCounter.load(std::memory_order_relaxed);
+            countMetric(Metric::FramebufferCacheHits);
+            return pos->second.framebuffer;
         }
 
+        countMetric(Metric::FramebufferCacheMisses);
+
         // otherwise create a framebuffer :(
-        std::vector<VkFramebufferAttachmentImageInfo> imageInfos;
+        VkFramebufferAttachmentImageInfo imageInfos[MAX_FRAMEBUFFER_ATTACHMENTS];
 
-        for (int i = 0; i < key.numTextures; i++)
+        for (uint32_t i = 0; i < key.numTextures; i++)
         {
-            VkFramebufferAttachmentImageInfo imageInfo
+            imageInfos[i] = VkFramebufferAttachmentImageInfo
             {
                 .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENT_IMAGE_INFO,
                 .flags = key.textureFlags[i],
@@ -139,15 +340,13 @@ namespace R2::VK
                 .viewFormatCount = 1,
                 .pViewFormats = &key.textureFormats[i]
             };
-            
-            imageInfos.push_back(imageInfo);
         }
 
         VkFramebufferAttachmentsCreateInfo faci
         {
             .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENTS_CREATE_INFO,
-            .attachmentImageInfoCount = (uint32_t)imageInfos.size(),
-            .pAttachmentImageInfos = imageInfos.data()
+            .attachmentImageInfoCount = key.numTextures,
+            .pAttachmentImageInfos = imageInfos
         };
 
         VkFramebufferCreateInfo fci
@@ -166,8 +365,67 @@ namespace R2::VK
         const Handles* handles = core->GetHandles();
         VkFramebuffer framebuffer;
         VKCHECK(vkCreateFramebuffer(handles->Device, &fci, handles->AllocCallbacks, &framebuffer));
-        framebuffers.insert({ key, framebuffer });
+        shard.entries.insert({ key, FramebufferEntry{ framebuffer, frameCounter.load(std::memory_order_relaxed) } });
 
         return framebuffer;
     }
-}
\ No newline at end of file
+
+    void RenderPassCache::EvictFramebuffers(DeletionQueue* dq)
+    {
+        struct Candidate
+        {
+            uint64_t lastUsedFrame;
+            uint32_t shardIndex;
+            FramebufferKey key;
+        };
+
+        std::vector<Candidate> remaining;
+        uint64_t currentFrame = frameCounter.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        for (uint32_t i = 0; i < NUM_SHARDS; i++)
+        {
+            auto& shard = framebufferShards[i];
+            std::lock_guard lock{shard.mutex};
+
+            for (auto it = shard.entries.begin(); it != shard.entries.end();)
+            {
+                // Anything that hasn't been used in a while is most likely from an old
+                // resolution or a render target that no longer exists
+                if (currentFrame - it->second.lastUsedFrame > FRAMEBUFFER_MAX_UNUSED_FRAMES)
+                {
+                    DQ_QueueObjectDeletion(dq, it->second.framebuffer, VK_OBJECT_TYPE_FRAMEBUFFER);
+                    it = shard.entries.erase(it);
+                }
+                else
+                {
+                    remaining.push_back(Candidate{ it->second.lastUsedFrame, i, it->first });
+                    ++it;
+                }
+            }
+        }
+
+        if (remaining.size() <= MAX_FRAMEBUFFERS)
+            return;
+
+        // Still over budget, so drop the least recently used ones
+        std::sort(remaining.begin(), remaining.end(), [](const Candidate& a, const Candidate& b)
+        {
+            return a.lastUsedFrame < b.lastUsedFrame;
+        });
+
+        size_t numToEvict = remaining.size() - MAX_FRAMEBUFFERS;
+        for (size_t i = 0; i < numToEvict; i++)
+        {
+            auto& shard = framebufferShards[remaining[i].shardIndex];
+            std::lock_guard lock{shard.mutex};
+
+            auto pos = shard.entries.find(remaining[i].key);
+            // Skip anything that got used again since we looked
+            if (pos == shard.entries.end() || pos->second.lastUsedFrame != remaining[i].lastUsedFrame)
+                continue;
+
+            DQ_QueueObjectDeletion(dq, pos->second.framebuffer, VK_OBJECT_TYPE_FRAMEBUFFER);
+            shard.entries.erase(pos);
+        }
+    }
+}
@@ -5,8 +5,11 @@
 #include <R2/VKEnums.hpp>
 #include <R2/VKUtil.hpp>
 #include <VKSyncLegacyHelpers.hpp>
+#include <AllocationRegistry.hpp>
+#include <RuntimeMetrics.hpp>
 #include <volk.h>
 #include <vk_mem_alloc.h>
+#include <assert.h>
 
 namespace R2::VK
 {
@@ -52,6 +55,15 @@ namespace R2::VK
         bci.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
         bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+        if (createInfo.DeferMemoryBinding)
+        {
+            assert(!createInfo.Mappable);
+            allocation = nullptr;
+            const Handles* handles = renderer->GetHandles();
+            VKCHECK(vkCreateBuffer(handles->Device, &bci, handles->AllocCallbacks, &buffer));
+            return;
+        }
+
         VmaAllocationCreateInfo vaci{};
         vaci.usage = VMA_MEMORY_USAGE_AUTO;
 
@@ -61,6 +73,7 @@ namespace R2::VK
         }
 
         VKCHECK(vmaCreateBuffer(renderer->handles.Allocator, &bci, &vaci, &buffer, &allocation, nullptr));
+        registerAllocation(allocation, MemoryCategory::Buffer);
     }
 
     VkBuffer Buffer::GetNativeHandle()
@@ -96,6 +109,19 @@ namespace R2::VK
         return usage;
     }
 
+    MemoryRequirements Buffer::GetMemoryRequirements()
+    {
+        VkMemoryRequirements memReq;
+        vkGetBufferMemoryRequirements(renderer->GetHandles()->Device, buffer, &memReq);
+        return MemoryRequirements{ memReq.size, memReq.alignment, memReq.memoryTypeBits };
+    }
+
+    void Buffer::bindMemory(VmaAllocation memory, uint64_t offset)
+    {
+        assert(allocation == nullptr);
+        VKCHECK(vmaBindBufferMemory2(renderer->GetHandles()->Allocator, memory, offset, buffer, nullptr));
+    }
+
     void* Buffer::Map()
     {
         void* mem;
@@ -120,52 +146,16 @@ namespace R2::VK
 
     void Buffer::Acquire(CommandBuffer cb, AccessFlags access)
     {
-        if (vkCmdPipelineBarrier2 != NULL)
-        {
-            VkBufferMemoryBarrier2 bmb { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
-            bmb.buffer = buffer;
-            bmb.offset = 0;
-            bmb.size = VK_WHOLE_SIZE;
-            bmb.srcAccessMask = (VkAccessFlags2)lastAccess;
-            bmb.srcStageMask = (VkPipelineStageFlags2)lastPipelineStage;
-            bmb.dstAccessMask = (VkAccessFlags2)access;
-            bmb.dstStageMask = (VkPipelineStageFlags2)getPipelineStage(access);
-
-            VkDependencyInfo di { VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
-            di.pBufferMemoryBarriers = &bmb;
-            di.bufferMemoryBarrierCount = 1;
-            vkCmdPipelineBarrier2(cb.GetNativeHandle(), &di);
-            lastAccess = access;
-            lastPipelineStage = getPipelineStage(access);
-
-            vkCmdPipelineBarrier2(cb.GetNativeHandle(), &di);
-        }
-        else
-        {
-            VkBufferMemoryBarrier bmb{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
-            bmb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bmb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bmb.srcAccessMask = getOldAccessFlags(lastAccess);
-            bmb.dstAccessMask = getOldAccessFlags(access);
-            bmb.size = VK_WHOLE_SIZE;
-            bmb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bmb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            bmb.buffer = buffer;
-
-            vkCmdPipelineBarrier(
-                    cb.GetNativeHandle(),
-                    getOldPipelineStageFlags(lastPipelineStage),
-                    getOldPipelineStageFlags(lastPipelineStage),
-                    VK_DEPENDENCY_BY_REGION_BIT,
-                    0, nullptr,
-                    1, &bmb,
-                    0, nullptr
-            );
-        }
+        Acquire(cb, access, getPipelineStage(access));
     }
 
     void Buffer::Acquire(CommandBuffer cb, AccessFlags access, PipelineStageFlags stage)
     {
+        if (externallySynchronized)
+            return;
+
+        countBarriers(1);
+
         if (vkCmdPipelineBarrier2 != NULL)
         {
             VkBufferMemoryBarrier2 bmb { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
@@ -181,10 +171,6 @@ namespace R2::VK
             di.pBufferMemoryBarriers = &bmb;
             di.bufferMemoryBarrierCount = 1;
             vkCmdPipelineBarrier2(cb.GetNativeHandle(), &di);
-            lastAccess = access;
-            lastPipelineStage = stage;
-
-            vkCmdPipelineBarrier2(cb.GetNativeHandle(), &di);
         }
         else
         {
@@ -208,12 +194,18 @@ namespace R2::VK
                     0, nullptr
             );
         }
+
+        lastAccess = access;
+        lastPipelineStage = stage;
     }
 
     Buffer::~Buffer()
     {
         DeletionQueue* dq = renderer->getCurrentDq();
         DQ_QueueObjectDeletion(dq, buffer, VK_OBJECT_TYPE_BUFFER);
-        DQ_QueueMemoryFree(dq, allocation);
+
+        // Buffers bound to AliasedMemory don't own their memory
+        if (allocation)
+            DQ_QueueMemoryFree(dq, allocation);
     }
 }
\ No newline at end of file
@@ -5,8 +5,13 @@
 #include <R2/VKSyncPrims.hpp>
 #include <R2/VKTexture.hpp>
 #include <R2/VKPipeline.hpp>
+#include <R2/VKShaderObject.hpp>
 #include <VKSyncLegacyHelpers.hpp>
+#include <VKExtensionFunctions.hpp>
 #include <RenderPassCache.hpp>
+#include <RuntimeMetrics.hpp>
+#include <assert.h>
+#include <vector>
 
 namespace R2::VK
 {
@@ -81,6 +86,169 @@ namespace R2::VK
         vkCmdDraw(cb, vertexCount, instanceCount, firstVertex, firstInstance);
     }
 
+    void CommandBuffer::BindShaders(ShaderObject* vertex, ShaderObject* fragment)
+    {
+#ifdef VK_EXT_shader_object
+        // Explicitly unbind the stages we don't expose so nothing left over from
+        // a previous bind ends up in the pipeline
+        VkShaderStageFlagBits stages[] = {
+            VK_SHADER_STAGE_VERTEX_BIT,
+            VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+            VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+            VK_SHADER_STAGE_GEOMETRY_BIT,
+            VK_SHADER_STAGE_FRAGMENT_BIT
+        };
+
+        VkShaderEXT shaders[] = {
+            vertex->GetNativeHandle(),
+            VK_NULL_HANDLE,
+            VK_NULL_HANDLE,
+            VK_NULL_HANDLE,
+            fragment ? fragment->GetNativeHandle() : VK_NULL_HANDLE
+        };
+
+        g_extFuncs.CmdBindShadersEXT(cb, 5, stages, shaders);
+#else
+        assert(false && "R2 was built against Vulkan headers without VK_EXT_shader_object");
+#endif
+    }
+
+    void CommandBuffer::BindComputeShader(ShaderObject* compute)
+    {
+#ifdef VK_EXT_shader_object
+        VkShaderStageFlagBits stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        VkShaderEXT shader = compute->GetNativeHandle();
+        g_extFuncs.CmdBindShadersEXT(cb, 1, &stage, &shader);
+#else
+        assert(false && "R2 was built against Vulkan headers without VK_EXT_shader_object");
+#endif
+    }
+
+    void CommandBuffer::SetGraphicsState(const GraphicsState& state)
+    {
+#ifdef VK_EXT_shader_object
+        const uint32_t MAX_COLOR_ATTACHMENTS = 8;
+        assert(state.NumColorAttachments <= MAX_COLOR_ATTACHMENTS);
+
+        // Vertex input
+        std::vector<VkVertexInputBindingDescription2EXT> bindingDescs;
+        std::vector<VkVertexInputAttributeDescription2EXT> attributeDescs;
+
+        for (const VertexBinding& vb : state.VertexBindings)
+        {
+            VkVertexInputBindingDescription2EXT desc{ VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT };
+            desc.binding = vb.Binding;
+            desc.stride = vb.Size;
+            desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+            desc.divisor = 1;
+
+            for (const VertexAttribute& va : vb.Attributes)
+            {
+                VkVertexInputAttributeDescription2EXT adesc{ VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT };
+                adesc.binding = vb.Binding;
+                adesc.location = va.Index;
+                adesc.offset = va.Offset;
+                adesc.format = static_cast<VkFormat>(va.Format);
+
+                attributeDescs.push_back(adesc);
+            }
+
+            bindingDescs.push_back(desc);
+        }
+
+        vkCmdSetVertexInputEXT(cb, (uint32_t)bindingDescs.size(), bindingDescs.data(),
+            (uint32_t)attributeDescs.size(), attributeDescs.data());
+
+        // Input assembly
+        vkCmdSetPrimitiveTopology(cb, static_cast<VkPrimitiveTopology>(state.Topology));
+        vkCmdSetPrimitiveRestartEnable(cb, VK_FALSE);
+
+        // Viewport
+        VkViewport vkv{ state.Viewport.X, state.Viewport.Y, state.Viewport.Width, state.Viewport.Height,
+            state.Viewport.MinDepth, state.Viewport.MaxDepth };
+        VkRect2D vks{ { state.Scissor.X, state.Scissor.Y }, { state.Scissor.Width, state.Scissor.Height } };
+        vkCmdSetViewportWithCount(cb, 1, &vkv);
+        vkCmdSetScissorWithCount(cb, 1, &vks);
+
+        // Rasterization
+        vkCmdSetRasterizerDiscardEnable(cb, VK_FALSE);
+        g_extFuncs.CmdSetPolygonModeEXT(cb, VK_POLYGON_MODE_FILL);
+        vkCmdSetCullMode(cb, static_cast<VkCullModeFlags>(state.CullMode));
+        vkCmdSetFrontFace(cb, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+        vkCmdSetLineWidth(cb, 1.0f);
+        vkCmdSetDepthBiasEnable(cb, state.DepthBias);
+        if (state.DepthBias)
+        {
+            vkCmdSetDepthBias(cb, state.ConstantDepthBias, 0.0f, state.SlopeDepthBias);
+        }
+
+        // Depth stencil
+        vkCmdSetDepthTestEnable(cb, state.DepthTest);
+        vkCmdSetDepthWriteEnable(cb, state.DepthWrite);
+        vkCmdSetDepthCompareOp(cb, static_cast<VkCompareOp>(state.DepthCompareOp));
+        vkCmdSetDepthBoundsTestEnable(cb, VK_FALSE);
+        vkCmdSetStencilTestEnable(cb, VK_FALSE);
+
+        // Multisample
+        VkSampleMask sampleMask[2] = { ~0u, ~0u };
+        g_extFuncs.CmdSetRasterizationSamplesEXT(cb, (VkSampleCountFlagBits)state.NumSamples);
+        g_extFuncs.CmdSetSampleMaskEXT(cb, (VkSampleCountFlagBits)state.NumSamples, sampleMask);
+        g_extFuncs.CmdSetAlphaToCoverageEnableEXT(cb, state.AlphaToCoverage);
+
+        // Attachment blend states
+        if (state.NumColorAttachments > 0)
+        {
+            VkBool32 blendEnables[MAX_COLOR_ATTACHMENTS];
+            VkColorBlendEquationEXT blendEquations[MAX_COLOR_ATTACHMENTS]{};
+            VkColorComponentFlags writeMasks[MAX_COLOR_ATTACHMENTS];
+
+            for (uint32_t i = 0; i < state.NumColorAttachments; i++)
+            {
+                VkColorBlendEquationEXT& eq = blendEquations[i];
+                blendEnables[i] = state.AlphaBlend || state.AdditiveBlend;
+                writeMasks[i] = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+                if (state.AlphaBlend)
+                {
+                    eq.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+                    eq.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+                    eq.colorBlendOp = VK_BLEND_OP_ADD;
+                    eq.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+                    eq.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+                    eq.alphaBlendOp = VK_BLEND_OP_ADD;
+                }
+                else if (state.AdditiveBlend)
+                {
+                    eq.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+                    eq.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+                    eq.colorBlendOp = VK_BLEND_OP_ADD;
+                    eq.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+                    eq.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+                    eq.alphaBlendOp = VK_BLEND_OP_MAX;
+                }
+            }
+
+            g_extFuncs.CmdSetColorBlendEnableEXT(cb, 0, state.NumColorAttachments, blendEnables);
+            g_extFuncs.CmdSetColorBlendEquationEXT(cb, 0, state.NumColorAttachments, blendEquations);
+            g_extFuncs.CmdSetColorWriteMaskEXT(cb, 0, state.NumColorAttachments, writeMasks);
+        }
+
+        // Pipelines default to a 1x1 shading rate, so match that here.
+        // SetFragmentShadingRate can still override it afterwards.
+        if (vkCmdSetFragmentShadingRateKHR)
+        {
+            VkExtent2D fragSize{ 1, 1 };
+            VkFragmentShadingRateCombinerOpKHR combinerOps[2] = {
+                VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR,
+                VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR
+            };
+            vkCmdSetFragmentShadingRateKHR(cb, &fragSize, combinerOps);
+        }
+#else
+        assert(false && "R2 was built against Vulkan headers without VK_EXT_shader_object");
+#endif
+    }
+
     void CommandBuffer::BindComputePipeline(Pipeline* p)
     {
         vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, p->GetNativeHandle());
@@ -131,6 +299,8 @@ namespace R2::VK
 
     void CommandBuffer::TextureBarrier(Texture* tex, PipelineStageFlags srcStage, PipelineStageFlags dstStage, AccessFlags srcAccess, AccessFlags dstAccess)
     {
+        countBarriers(1);
+
         if (vkCmdPipelineBarrier2 != NULL)
         {
             VkImageMemoryBarrier2 imageBarrier { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
@@ -327,6 +497,215 @@ namespace R2::VK
         vkCmdResetEvent(cb, evt->GetNativeHandle(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
     }
 
+    void CommandBuffer::SetEvent(Event* evt, PipelineStageFlags stage)
+    {
+        if (vkCmdSetEvent2 != NULL)
+        {
+            VkMemoryBarrier2 mb{ VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+            mb.srcStageMask = (VkPipelineStageFlags2)stage;
+
+            VkDependencyInfo di{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+            di.memoryBarrierCount = 1;
+            di.pMemoryBarriers = &mb;
+            vkCmdSetEvent2(cb, evt->GetNativeHandle(), &di);
+        }
+        else
+        {
+            vkCmdSetEvent(cb, evt->GetNativeHandle(), getOldPipelineStageFlags(stage));
+        }
+    }
+
+    void CommandBuffer::ResetEvent(Event* evt, PipelineStageFlags stage)
+    {
+        if (vkCmdResetEvent2 != NULL)
+        {
+            vkCmdResetEvent2(cb, evt->GetNativeHandle(), (VkPipelineStageFlags2)stage);
+        }
+        else
+        {
+            vkCmdResetEvent(cb, evt->GetNativeHandle(), getOldPipelineStageFlags(stage));
+        }
+    }
+
+    void CommandBuffer::SignalSplitBarrier(const SplitBarrier& barrier)
+    {
+        recordSplitBarrier(barrier, false);
+    }
+
+    void CommandBuffer::WaitSplitBarrier(const SplitBarrier& barrier)
+    {
+        recordSplitBarrier(barrier, true);
+
+        for (const auto& dep : barrier.textureBarriers)
+        {
+            if (dep.Texture->externallySynchronized)
+                continue;
+
+            dep.Texture->lastLayout = dep.NewLayout;
+            dep.Texture->lastAccess = dep.Memory.DstAccess;
+            dep.Texture->lastPipelineStage = dep.Memory.DstStage;
+        }
+
+        for (const auto& dep : barrier.bufferBarriers)
+        {
+            if (dep.Buffer->externallySynchronized)
+                continue;
+
+            dep.Buffer->lastAccess = dep.Memory.DstAccess;
+            dep.Buffer->lastPipelineStage = dep.Memory.DstStage;
+        }
+    }
+
+    // Both halves of a split barrier are built here from the same description,
+    // so the dependencies given to the signal and the wait always match
+    void CommandBuffer::recordSplitBarrier(const SplitBarrier& barrier, bool wait)
+    {
+        VkEvent evt = barrier.event->GetNativeHandle();
+
+        if (wait)
+            countBarriers(barrier.memoryBarriers.size() + barrier.textureBarriers.size() + barrier.bufferBarriers.size());
+
+        if (vkCmdSetEvent2 != NULL)
+        {
+            std::vector<VkMemoryBarrier2> memoryBarriers;
+            for (const auto& dep : barrier.memoryBarriers)
+            {
+                VkMemoryBarrier2 mb{ VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+                mb.srcStageMask = (VkPipelineStageFlags2)dep.SrcStage;
+                mb.srcAccessMask = (VkAccessFlags2)dep.SrcAccess;
+                mb.dstStageMask = (VkPipelineStageFlags2)dep.DstStage;
+                mb.dstAccessMask = (VkAccessFlags2)dep.DstAccess;
+                memoryBarriers.push_back(mb);
+            }
+
+            std::vector<VkImageMemoryBarrier2> imageBarriers;
+            for (const auto& dep : barrier.textureBarriers)
+            {
+                Texture* tex = dep.Texture;
+
+                VkImageMemoryBarrier2 imb{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+                imb.image = tex->GetNativeHandle();
+                imb.oldLayout = (VkImageLayout)dep.OldLayout;
+                imb.newLayout = (VkImageLayout)dep.NewLayout;
+                imb.srcStageMask = (VkPipelineStageFlags2)dep.Memory.SrcStage;
+                imb.srcAccessMask = (VkAccessFlags2)dep.Memory.SrcAccess;
+                imb.dstStageMask = (VkPipelineStageFlags2)dep.Memory.DstStage;
+                imb.dstAccessMask = (VkAccessFlags2)dep.Memory.DstAccess;
+                imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imb.subresourceRange = VkImageSubresourceRange { tex->getAspectFlags(), 0, (uint32_t)tex->GetNumMips(), 0, (uint32_t)tex->GetLayerCount() };
+                imageBarriers.push_back(imb);
+            }
+
+            std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+            for (const auto& dep : barrier.bufferBarriers)
+            {
+                VkBufferMemoryBarrier2 bmb{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+                bmb.buffer = dep.Buffer->GetNativeHandle();
+                bmb.offset = 0;
+                bmb.size = VK_WHOLE_SIZE;
+                bmb.srcStageMask = (VkPipelineStageFlags2)dep.Memory.SrcStage;
+                bmb.srcAccessMask = (VkAccessFlags2)dep.Memory.SrcAccess;
+                bmb.dstStageMask = (VkPipelineStageFlags2)dep.Memory.DstStage;
+                bmb.dstAccessMask = (VkAccessFlags2)dep.Memory.DstAccess;
+                bmb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                bmb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                bufferBarriers.push_back(bmb);
+            }
+
+            VkDependencyInfo di{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+            di.memoryBarrierCount = (uint32_t)memoryBarriers.size();
+            di.pMemoryBarriers = memoryBarriers.data();
+            di.imageMemoryBarrierCount = (uint32_t)imageBarriers.size();
+            di.pImageMemoryBarriers = imageBarriers.data();
+            di.bufferMemoryBarrierCount = (uint32_t)bufferBarriers.size();
+            di.pBufferMemoryBarriers = bufferBarriers.data();
+
+            if (wait)
+                vkCmdWaitEvents2(cb, 1, &evt, &di);
+            else
+                vkCmdSetEvent2(cb, evt, &di);
+
+            return;
+        }
+
+        // Without synchronization2, signalling only takes a stage mask, which
+        // has to match the source stages given to the wait
+        uint64_t srcStages = 0;
+        uint64_t dstStages = 0;
+
+        std::vector<VkMemoryBarrier> memoryBarriers;
+        for (const auto& dep : barrier.memoryBarriers)
+        {
+            VkMemoryBarrier mb{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+            mb.srcAccessMask = getOldAccessFlags(dep.SrcAccess);
+            mb.dstAccessMask = getOldAccessFlags(dep.DstAccess);
+            memoryBarriers.push_back(mb);
+
+            srcStages |= (uint64_t)dep.SrcStage;
+            dstStages |= (uint64_t)dep.DstStage;
+        }
+
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        for (const auto& dep : barrier.textureBarriers)
+        {
+            Texture* tex = dep.Texture;
+
+            VkImageMemoryBarrier imb{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+            imb.image = tex->GetNativeHandle();
+            imb.oldLayout = (VkImageLayout)dep.OldLayout;
+            imb.newLayout = (VkImageLayout)dep.NewLayout;
+            imb.srcAccessMask = getOldAccessFlags(dep.Memory.SrcAccess);
+            imb.dstAccessMask = getOldAccessFlags(dep.Memory.DstAccess);
+            imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imb.subresourceRange = VkImageSubresourceRange { tex->getAspectFlags(), 0, (uint32_t)tex->GetNumMips(), 0, (uint32_t)tex->GetLayerCount() };
+            imageBarriers.push_back(imb);
+
+            srcStages |= (uint64_t)dep.Memory.SrcStage;
+            dstStages |= (uint64_t)dep.Memory.DstStage;
+        }
+
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        for (const auto& dep : barrier.bufferBarriers)
+        {
+            VkBufferMemoryBarrier bmb{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+            bmb.buffer = dep.Buffer->GetNativeHandle();
+            bmb.offset = 0;
+            bmb.size = VK_WHOLE_SIZE;
+            bmb.srcAccessMask = getOldAccessFlags(dep.Memory.SrcAccess);
+            bmb.dstAccessMask = getOldAccessFlags(dep.Memory.DstAccess);
+            bmb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bmb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarriers.push_back(bmb);
+
+            srcStages |= (uint64_t)dep.Memory.SrcStage;
+            dstStages |= (uint64_t)dep.Memory.DstStage;
+        }
+
+        VkPipelineStageFlags oldSrcStages = getOldPipelineStageFlags((PipelineStageFlags)srcStages);
+        VkPipelineStageFlags oldDstStages = getOldPipelineStageFlags((PipelineStageFlags)dstStages);
+
+        // Stage masks can't be empty without synchronization2
+        if (oldSrcStages == 0)
+            oldSrcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+        if (oldDstStages == 0)
+            oldDstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+        if (wait)
+        {
+            vkCmdWaitEvents(cb, 1, &evt, oldSrcStages, oldDstStages,
+                (uint32_t)memoryBarriers.size(), memoryBarriers.data(),
+                (uint32_t)bufferBarriers.size(), bufferBarriers.data(),
+                (uint32_t)imageBarriers.size(), imageBarriers.data());
+        }
+        else
+        {
+            vkCmdSetEvent(cb, evt, oldSrcStages);
+        }
+    }
+
     void CommandBuffer::EndRendering()
     {
         if (g_renderPassCache == nullptr)
@@ -338,4 +717,18 @@ namespace R2::VK
             vkCmdEndRenderPass(cb);
         }
     }
+
+    void CommandBuffer::ExecuteCommands(const CommandBuffer* secondaries, uint32_t count)
+    {
+        if (count == 0)
+            return;
+
+        std::vector<VkCommandBuffer> nativeHandles(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            nativeHandles[i] = secondaries[i].cb;
+        }
+
+        vkCmdExecuteCommands(cb, count, nativeHandles.data());
+    }
 }
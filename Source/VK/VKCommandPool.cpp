@@ -0,0 +1,64 @@
+#include <R2/VKCommandPool.hpp>
+#include <R2/VKCore.hpp>
+#include <R2/VKDeletionQueue.hpp>
+#include <volk.h>
+
+namespace R2::VK
+{
+    CommandPool::CommandPool(Core* core)
+        : core(core)
+    {
+        const Handles* handles = core->GetHandles();
+
+        VkCommandPoolCreateInfo cpci{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+        cpci.queueFamilyIndex = handles->Queues.GraphicsFamilyIndex;
+        cpci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        VKCHECK(vkCreateCommandPool(handles->Device, &cpci, handles->AllocCallbacks, &pool));
+    }
+
+    CommandBuffer CommandPool::BeginSecondary()
+    {
+        const Handles* handles = core->GetHandles();
+
+        if (numUsed == commandBuffers.size())
+        {
+            VkCommandBufferAllocateInfo cbai{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+            cbai.commandPool = pool;
+            cbai.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            cbai.commandBufferCount = 1;
+
+            VkCommandBuffer cb;
+            VKCHECK(vkAllocateCommandBuffers(handles->Device, &cbai, &cb));
+            commandBuffers.push_back(cb);
+        }
+
+        VkCommandBuffer cb = commandBuffers[numUsed++];
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+        VkCommandBufferBeginInfo cbbi{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+        cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        cbbi.pInheritanceInfo = &inheritanceInfo;
+        VKCHECK(vkBeginCommandBuffer(cb, &cbbi));
+
+        return CommandBuffer(cb);
+    }
+
+    void CommandPool::End(CommandBuffer cb)
+    {
+        VKCHECK(vkEndCommandBuffer(cb.GetNativeHandle()));
+    }
+
+    void CommandPool::Reset()
+    {
+        VKCHECK(vkResetCommandPool(core->GetHandles()->Device, pool, 0));
+        numUsed = 0;
+    }
+
+    CommandPool::~CommandPool()
+    {
+        // Destroying the pool frees its command buffers too
+        DeletionQueue* dq = core->perFrameResources[core->frameIndex].DeletionQueue;
+        DQ_QueueObjectDeletion(dq, pool, VK_OBJECT_TYPE_COMMAND_POOL);
+    }
+}
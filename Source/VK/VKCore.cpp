@@ -6,9 +6,15 @@
 #include <R2/VKDeletionQueue.hpp>
 #include <R2/VKCommandBuffer.hpp>
 #include <R2/VKDescriptorSet.hpp>
+#include <R2/VKTraceRecorder.hpp>
 #include <volk.h>
 #include <RenderPassCache.hpp>
+#include <LayoutCache.hpp>
+#include <SamplerCache.hpp>
+#include <RuntimeMetrics.hpp>
+#include <AllocationRegistry.hpp>
 #include <vk_mem_alloc.h>
+#include <assert.h>
 #include <string.h>
 
 size_t operator""_KB(unsigned long long sz)
@@ -27,6 +33,7 @@ namespace R2::VK
 {
     const uint32_t NUM_FRAMES_IN_FLIGHT = 2;
     const size_t STAGING_BUFFER_SIZE = 64_MB;
+    const size_t READBACK_BUFFER_SIZE = 32_MB;
     IDebugOutputReceiver* g_dbgOutRecv;
     RenderPassCache* g_renderPassCache;
     
@@ -47,26 +54,43 @@ namespace R2::VK
 
     Core::Core(IDebugOutputReceiver* dbgOutRecv, bool enableValidation, const char** instanceExts,
                const char** deviceExts)
+        : Core(CoreCreateInfo{ dbgOutRecv, enableValidation, instanceExts, deviceExts })
+    {
+    }
+
+    Core::Core(const CoreCreateInfo& createInfo)
         : inFrame(false)
         , frameIndex(0)
+        , frameNumber(0)
+        , headless(createInfo.Headless)
     {
-        this->dbgOutRecv = dbgOutRecv;
+        this->dbgOutRecv = createInfo.DebugOutputReceiver;
         vmaDebugOutputRecv = dbgOutRecv;
         g_dbgOutRecv = dbgOutRecv;
 
+        // Requested here, then cleared by createInstance() if it isn't supported
+        supportedFeatures.HeadlessSurface = createInfo.Headless && createInfo.HeadlessSurface;
+
         setAllocCallbacks();
-        createInstance(enableValidation, instanceExts);
+        createInstance(createInfo.EnableValidation, createInfo.InstanceExtensions);
+        selectPhysicalDevice(createInfo.DeviceIndex, createInfo.DeviceUUID);
         findQueueFamilies();
-        createDevice(deviceExts);
+        createDevice(createInfo.DeviceExtensions);
         createCommandPool();
         createAllocator();
         createDescriptorPool();
+        g_layoutCache = new LayoutCache(GetHandles());
+        g_samplerCache = new RefCountedCache<VkSampler>();
 
-        VkPhysicalDeviceProperties deviceProps{};
-        vkGetPhysicalDeviceProperties(handles.PhysicalDevice, &deviceProps);
+        VkPhysicalDeviceIDProperties idProps{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES};
+        VkPhysicalDeviceProperties2 deviceProps2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+        deviceProps2.pNext = &idProps;
+        vkGetPhysicalDeviceProperties2(handles.PhysicalDevice, &deviceProps2);
+        const VkPhysicalDeviceProperties& deviceProps = deviceProps2.properties;
 
         strncpy(deviceInfo.Name, deviceProps.deviceName, 256);
         deviceInfo.TimestampPeriod = deviceProps.limits.timestampPeriod;
+        memcpy(deviceInfo.UUID, idProps.deviceUUID, VK_UUID_SIZE);
 
         Utils::SetupImmediateCommandBuffer(GetHandles());
 
@@ -97,8 +121,14 @@ namespace R2::VK
             stagingCreateInfo.Usage = BufferUsage::Storage;
             stagingCreateInfo.Mappable = true;
             perFrameResources[i].StagingBuffer = CreateBuffer(stagingCreateInfo);
+            perFrameResources[i].StagingBuffer->SetDebugName("R2/Staging");
+            registerAllocation(perFrameResources[i].StagingBuffer->allocation, MemoryCategory::Staging);
 
             perFrameResources[i].StagingMapped = (char*)perFrameResources[i].StagingBuffer->Map();
+
+            perFrameResources[i].ReadbackBuffer = VK_NULL_HANDLE;
+            perFrameResources[i].ReadbackAllocation = nullptr;
+            perFrameResources[i].ReadbackMapped = nullptr;
         }
     }
 
@@ -150,6 +180,26 @@ namespace R2::VK
         delete swapchain;
     }
 
+    bool Core::IsHeadless() const
+    {
+        return headless;
+    }
+
+    VkSurfaceKHR Core::CreateHeadlessSurface()
+    {
+        assert(supportedFeatures.HeadlessSurface);
+        VkHeadlessSurfaceCreateInfoEXT hsci{VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT};
+
+        VkSurfaceKHR surface;
+        VKCHECK(vkCreateHeadlessSurfaceEXT(handles.Instance, &hsci, handles.AllocCallbacks, &surface));
+        return surface;
+    }
+
+    void Core::DestroySurface(VkSurfaceKHR surface)
+    {
+        vkDestroySurfaceKHR(handles.Instance, surface, handles.AllocCallbacks);
+    }
+
     DescriptorSet* Core::CreateDescriptorSet(DescriptorSetLayout* dsl)
     {
         VkDescriptorSet ds;
@@ -203,8 +253,22 @@ namespace R2::VK
 
     void Core::BeginFrame()
     {
+        TraceScope traceScope{ "Core::BeginFrame" };
+
+        MetricsSnapshot totals = GetTotalMetrics();
+        for (uint32_t i = 0; i < (uint32_t)Metric::Count; i++)
+        {
+            if (MetricsSnapshot::IsGauge((Metric)i))
+                frameMetrics.Values[i] = totals.Values[i];
+            else
+                frameMetrics.Values[i] = totals.Values[i] - previousMetricTotals.Values[i];
+        }
+        frameMetrics.FrameNumber = frameNumber;
+        previousMetricTotals = totals;
+
         inFrame = true;
         frameIndex++;
+        frameNumber++;
 
         if (frameIndex >= NUM_FRAMES_IN_FLIGHT)
         {
@@ -213,16 +277,27 @@ namespace R2::VK
 
         PerFrameResources& frameResources = perFrameResources[frameIndex];
 
-        VKCHECK(vkWaitForFences(handles.Device, 1, &frameResources.Fence, VK_TRUE, UINT64_MAX));
+        {
+            TraceScope waitScope{ "Wait for frame fence" };
+            VKCHECK(vkWaitForFences(handles.Device, 1, &frameResources.Fence, VK_TRUE, UINT64_MAX));
+        }
         VKCHECK(vkResetFences(handles.Device, 1, &frameResources.Fence));
 
         // Prepare the command buffer for recording
         VKCHECK(vkResetCommandBuffer(frameResources.CommandBuffer, 0));
 
+        // The frame's copies have landed, so hand out the read back data
+        completeFrameReadbacks(frameIndex);
+
         // Now we know that the command buffer has finished executing, so we can
         // go through the deletion queue and clean up
         frameResources.DeletionQueue->Cleanup();
 
+        if (g_renderPassCache)
+        {
+            g_renderPassCache->EvictFramebuffers(frameResources.DeletionQueue);
+        }
+
         VkCommandBufferBeginInfo cbbi{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
         cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
         VKCHECK(vkBeginCommandBuffer(frameResources.CommandBuffer, &cbbi));
@@ -245,12 +320,16 @@ namespace R2::VK
 
     void Core::QueueBufferUpload(Buffer* buffer, const void* data, uint64_t dataSize, uint64_t dataOffset)
     {
+        TraceScope traceScope{ "Core::QueueBufferUpload" };
         PerFrameResources& frameResources = perFrameResources[frameIndex];
         std::unique_lock buLock{frameResources.BufferUploadMutex};
+        countMetric(Metric::Uploads);
 
         if (dataSize >= STAGING_BUFFER_SIZE)
         {
             this->dbgOutRecv->DebugMessage("Queued buffer too big to go in staging buffer! THIS IS A STALL");
+            TraceScope traceScope{ "Oversized buffer upload stall" };
+            countMetric(Metric::OversizedUploads);
             VkBufferCreateInfo bci{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
             bci.size = dataSize;
             bci.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
@@ -262,6 +341,8 @@ namespace R2::VK
             VmaAllocation tempAlloc;
             VmaAllocationInfo tempAllocInfo{};
             VKCHECK(vmaCreateBuffer(handles.Allocator, &bci, &vaci, &tempBuffer, &tempAlloc, &tempAllocInfo));
+            vmaSetAllocationName(handles.Allocator, tempAlloc, "R2/Oversized upload");
+            registerAllocation(tempAlloc, MemoryCategory::Staging);
 
             memcpy(tempAllocInfo.pMappedData, data, dataSize);
 
@@ -288,6 +369,7 @@ namespace R2::VK
             VKCHECK(vkQueueSubmit(handles.Queues.Graphics, 1, &uploadSubmitInfo, VK_NULL_HANDLE));
             WaitIdle();
 
+            unregisterAllocation(tempAlloc);
             vmaDestroyBuffer(handles.Allocator, tempBuffer, tempAlloc);
 
             return;
@@ -297,6 +379,8 @@ namespace R2::VK
         {
             std::unique_lock queueLock{queueMutex};
             this->dbgOutRecv->DebugMessage("Flushing staged uploads!!! THIS IS A STALL");
+            TraceScope traceScope{ "Staging flush stall" };
+            countMetric(Metric::StagingFlushes);
             VkCommandBuffer cb = Utils::AcquireImmediateCommandBuffer();
             writeFrameUploadCommands(frameIndex, cb);
 
@@ -305,6 +389,7 @@ namespace R2::VK
         }
 
         memcpy(frameResources.StagingMapped + frameResources.StagingOffset, data, dataSize);
+        countMetric(Metric::BytesStaged, dataSize);
 
         frameResources.BufferUploads.push_back({ buffer, frameResources.StagingOffset, dataSize, dataOffset });
         frameResources.StagingOffset += dataSize;
@@ -320,13 +405,17 @@ namespace R2::VK
 
     void Core::QueueTextureUpload(Texture* texture, void* data, uint64_t dataSize, int numMips)
     {
+        TraceScope traceScope{ "Core::QueueTextureUpload" };
         PerFrameResources& frameResources = perFrameResources[frameIndex];
         std::unique_lock buLock{frameResources.BufferUploadMutex};
         int mipsToUpload = numMips == -1 ? texture->GetNumMips() : numMips;
+        countMetric(Metric::Uploads);
 
         if (dataSize >= STAGING_BUFFER_SIZE)
         {
             this->dbgOutRecv->DebugMessage("Queued texture too big to go in staging buffer! THIS IS A STALL");
+            TraceScope traceScope{ "Oversized texture upload stall" };
+            countMetric(Metric::OversizedUploads);
 
             VkBufferCreateInfo bci{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
             bci.size = dataSize;
@@ -339,6 +428,8 @@ namespace R2::VK
             VmaAllocation tempAlloc;
             VmaAllocationInfo tempAllocInfo{};
             VKCHECK(vmaCreateBuffer(handles.Allocator, &bci, &vaci, &tempBuffer, &tempAlloc, &tempAllocInfo));
+            vmaSetAllocationName(handles.Allocator, tempAlloc, "R2/Oversized upload");
+            registerAllocation(tempAlloc, MemoryCategory::Staging);
 
             memcpy(tempAllocInfo.pMappedData, data, dataSize);
             std::unique_lock queueLock{queueMutex};
@@ -387,6 +478,7 @@ namespace R2::VK
             VKCHECK(vkQueueSubmit(handles.Queues.Graphics, 1, &uploadSubmitInfo, VK_NULL_HANDLE));
             WaitIdle();
 
+            unregisterAllocation(tempAlloc);
             vmaDestroyBuffer(handles.Allocator, tempBuffer, tempAlloc);
 
             return;
@@ -399,6 +491,8 @@ namespace R2::VK
         {
             std::unique_lock queueLock{queueMutex};
             this->dbgOutRecv->DebugMessage("Flushing staged uploads!!! THIS IS A STALL");
+            TraceScope traceScope{ "Staging flush stall" };
+            countMetric(Metric::StagingFlushes);
             VkCommandBuffer cb = Utils::AcquireImmediateCommandBuffer();
             writeFrameUploadCommands(frameIndex, cb);
             Utils::ExecuteImmediateCommandBuffer();
@@ -409,12 +503,72 @@ namespace R2::VK
         }
 
         memcpy(frameResources.StagingMapped + uploadedOffset + requiredPadding, data, dataSize);
+        countMetric(Metric::BytesStaged, dataSize);
 
         frameResources.BufferToTextureCopies.push_back({ frameResources.StagingBuffer, texture,
                                                           uploadedOffset + requiredPadding, mipsToUpload });
         frameResources.StagingOffset += dataSize + requiredPadding;
     }
 
+    void Core::QueueBufferReadback(Buffer* buffer, uint64_t dataSize, uint64_t dataOffset, ReadbackCallback callback)
+    {
+        PerFrameResources& frameResources = perFrameResources[frameIndex];
+        std::unique_lock buLock{frameResources.BufferUploadMutex};
+        frameResources.Readbacks.push_back({ buffer, nullptr, 0, 0, dataOffset, dataSize, std::move(callback) });
+    }
+
+    uint32_t getDepthReadbackTexelSize(TextureFormat format)
+    {
+        // Only the depth aspect is copied, so stencil never ends up in the
+        // buffer. 24 bit depth is padded out to 32 bits.
+        switch (format)
+        {
+        case TextureFormat::D16_UNORM:
+        case TextureFormat::D16_UNORM_S8_UINT:
+            return 2;
+        case TextureFormat::X8_D24_UNORM_PACK32:
+        case TextureFormat::D24_UNORM_S8_UINT:
+        case TextureFormat::D32_SFLOAT:
+        case TextureFormat::D32_SFLOAT_S8_UINT:
+            return 4;
+        case TextureFormat::S8_UINT:
+            assert(false && "Stencil-only textures can't be read back");
+            return 0;
+        default:
+            return 0;
+        }
+    }
+
+    void Core::QueueTextureReadback(Texture* texture, ReadbackCallback callback, int mipLevel, int layer)
+    {
+        assert(layer < texture->GetLayerCount());
+        int layerCount = layer < 0 ? texture->GetLayerCount() : 1;
+
+        // The layer count already includes the 6 faces of cube textures, and
+        // 3D textures have one layer made up of depth slices
+        uint32_t width = mipScale(texture->GetWidth(), mipLevel);
+        uint32_t height = mipScale(texture->GetHeight(), mipLevel);
+        uint32_t depthTexelSize = getDepthReadbackTexelSize(texture->GetFormat());
+        uint64_t dataSize = depthTexelSize != 0
+            ? (uint64_t)depthTexelSize * width * height * layerCount
+            : CalculateTextureByteSize(texture->GetFormat(), width, height, layerCount);
+        dataSize *= getReadbackDepth(texture, mipLevel);
+
+        PerFrameResources& frameResources = perFrameResources[frameIndex];
+        std::unique_lock buLock{frameResources.BufferUploadMutex};
+        frameResources.Readbacks.push_back({ nullptr, texture, mipLevel, layer, 0, dataSize, std::move(callback) });
+    }
+
+    void Core::FlushReadbacks()
+    {
+        WaitIdle();
+
+        for (uint32_t i = 0; i < NUM_FRAMES_IN_FLIGHT; i++)
+        {
+            completeFrameReadbacks(i);
+        }
+    }
+
     uint32_t Core::GetFrameIndex() const
     {
         return frameIndex;
@@ -435,14 +589,49 @@ namespace R2::VK
         return NUM_FRAMES_IN_FLIGHT;
     }
 
+    uint64_t Core::GetFrameNumber() const
+    {
+        return frameNumber;
+    }
+
+    const MetricsSnapshot& Core::GetFrameMetrics() const
+    {
+        return frameMetrics;
+    }
+
+    MetricsSnapshot Core::GetTotalMetrics() const
+    {
+        MetricsSnapshot snapshot{};
+        snapshot.FrameNumber = frameNumber;
+
+        for (uint32_t i = 0; i < (uint32_t)Metric::Count; i++)
+        {
+            snapshot.Values[i] = g_metricTotals[i].load(std::memory_order_relaxed);
+        }
+
+        snapshot.Values[(uint32_t)Metric::LiveDescriptorSets] =
+            snapshot.Get(Metric::DescriptorSetsAllocated) - snapshot.Get(Metric::DescriptorSetsFreed);
+
+        uint64_t queued = 0;
+        for (uint32_t i = 0; i < NUM_FRAMES_IN_FLIGHT; i++)
+        {
+            queued += perFrameResources[i].DeletionQueue->GetNumQueued();
+        }
+        snapshot.Values[(uint32_t)Metric::DeletionQueueDepth] = queued;
+
+        return snapshot;
+    }
+
     void Core::EndFrame()
     {
+        TraceScope traceScope{ "Core::EndFrame" };
         std::unique_lock queueLock{queueMutex};
         PerFrameResources& frameResources = perFrameResources[frameIndex];
-        VKCHECK(vkEndCommandBuffer(frameResources.CommandBuffer));
-
         std::unique_lock uploadLock{frameResources.BufferUploadMutex};
 
+        writeFrameReadbackCommands(frameIndex, frameResources.CommandBuffer);
+        VKCHECK(vkEndCommandBuffer(frameResources.CommandBuffer));
+
         VkCommandBufferBeginInfo cbbi{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
         cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
         VKCHECK(vkBeginCommandBuffer(frameResources.UploadCommandBuffer, &cbbi));
@@ -471,8 +660,13 @@ namespace R2::VK
         submitInfo.waitSemaphoreCount = 1;
         submitInfo.pWaitDstStageMask = &waitStage;
 #ifndef __ANDROID__
-        submitInfo.pSignalSemaphores = &frameResources.Completion;
-        submitInfo.signalSemaphoreCount = 1;
+        // Only presentation waits on the completion semaphore, and a binary
+        // semaphore can't be signalled again until it's been waited on
+        if (!headless || supportedFeatures.HeadlessSurface)
+        {
+            submitInfo.pSignalSemaphores = &frameResources.Completion;
+            submitInfo.signalSemaphoreCount = 1;
+        }
 #endif
 
         VKCHECK(vkQueueSubmit(handles.Queues.Graphics, 1, &submitInfo, frameResources.Fence));
@@ -481,6 +675,8 @@ namespace R2::VK
 
     void Core::WaitIdle()
     {
+        TraceScope traceScope{ "Core::WaitIdle" };
+        countMetric(Metric::IdleWaits);
         VKCHECK(vkDeviceWaitIdle(handles.Device));
     }
 
@@ -491,6 +687,17 @@ namespace R2::VK
         for (uint32_t i = 0; i < NUM_FRAMES_IN_FLIGHT; i++)
         {
             frameIndex = i;
+            // Anything still queued was never recorded, so its callback would never run
+            assert(perFrameResources[i].Readbacks.empty() && "readbacks queued after the last EndFrame()");
+            completeFrameReadbacks(i);
+
+            if (perFrameResources[i].ReadbackBuffer)
+            {
+                unregisterAllocation(perFrameResources[i].ReadbackAllocation);
+                vmaDestroyBuffer(handles.Allocator, perFrameResources[i].ReadbackBuffer,
+                                 perFrameResources[i].ReadbackAllocation);
+            }
+
             vkFreeCommandBuffers(handles.Device, handles.CommandPool, 1, &perFrameResources[i].CommandBuffer);
             vkFreeCommandBuffers(handles.Device, handles.CommandPool, 1, &perFrameResources[i].UploadCommandBuffer);
 
@@ -509,6 +716,19 @@ namespace R2::VK
             vkDestroyDebugUtilsMessengerEXT(handles.Instance, messenger, handles.AllocCallbacks);
         }
 
+        delete g_renderPassCache;
+        g_renderPassCache = nullptr;
+
+        delete g_layoutCache;
+        g_layoutCache = nullptr;
+
+        g_samplerCache->Clear([&](VkSampler sampler)
+        {
+            vkDestroySampler(handles.Device, sampler, handles.AllocCallbacks);
+        });
+        delete g_samplerCache;
+        g_samplerCache = nullptr;
+
         vmaDestroyAllocator(handles.Allocator);
         vkDestroyCommandPool(handles.Device, handles.CommandPool, handles.AllocCallbacks);
         vkDestroyDevice(handles.Device, handles.AllocCallbacks);
@@ -573,6 +793,145 @@ namespace R2::VK
         frameResources.StagingOffset = 0;
     }
 
+    char* Core::createReadbackBuffer(uint64_t size, VkBuffer* buffer, VmaAllocation* allocation)
+    {
+        VkBufferCreateInfo bci{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        bci.size = size;
+        bci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+        // Random access prefers host cached memory, which is much faster to read from
+        VmaAllocationCreateInfo vaci{};
+        vaci.usage = VMA_MEMORY_USAGE_AUTO;
+        vaci.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+        VmaAllocationInfo allocInfo{};
+        VKCHECK(vmaCreateBuffer(handles.Allocator, &bci, &vaci, buffer, allocation, &allocInfo));
+        vmaSetAllocationName(handles.Allocator, *allocation, "R2/Readback");
+        registerAllocation(*allocation, MemoryCategory::Staging);
+
+        return (char*)allocInfo.pMappedData;
+    }
+
+    uint32_t Core::getReadbackDepth(Texture* texture, int mipLevel)
+    {
+        if (texture->dimension != TextureDimension::Dim3D)
+            return 1;
+
+        return mipScale(texture->depth, mipLevel);
+    }
+
+    void Core::writeFrameReadbackCommands(uint32_t index, VkCommandBuffer cb)
+    {
+        PerFrameResources& frameResources = perFrameResources[index];
+
+        if (frameResources.Readbacks.empty())
+            return;
+
+        if (!frameResources.ReadbackBuffer)
+        {
+            frameResources.ReadbackMapped = createReadbackBuffer(READBACK_BUFFER_SIZE, &frameResources.ReadbackBuffer,
+                                                                 &frameResources.ReadbackAllocation);
+        }
+
+        uint64_t ringOffset = 0;
+        for (Readback& rb : frameResources.Readbacks)
+        {
+            countMetric(Metric::Readbacks);
+            countMetric(Metric::BytesReadBack, rb.DataSize);
+
+            VkBuffer destination = frameResources.ReadbackBuffer;
+            rb.RingOffset = (ringOffset + 15) & ~15ull;
+            rb.DedicatedBuffer = VK_NULL_HANDLE;
+            rb.DedicatedAllocation = nullptr;
+
+            if (rb.RingOffset + rb.DataSize > READBACK_BUFFER_SIZE)
+            {
+                rb.RingOffset = 0;
+                rb.DedicatedMapped = createReadbackBuffer(rb.DataSize, &rb.DedicatedBuffer, &rb.DedicatedAllocation);
+                destination = rb.DedicatedBuffer;
+            }
+            else
+            {
+                ringOffset = rb.RingOffset + rb.DataSize;
+            }
+
+            if (rb.Buffer)
+            {
+                rb.Buffer->Acquire(cb, AccessFlags::TransferRead, PipelineStageFlags::Transfer);
+
+                VkBufferCopy bc{};
+                bc.size = rb.DataSize;
+                bc.srcOffset = rb.SourceOffset;
+                bc.dstOffset = rb.RingOffset;
+                vkCmdCopyBuffer(cb, rb.Buffer->GetNativeHandle(), destination, 1, &bc);
+            }
+            else
+            {
+                rb.Texture->Acquire(cb, ImageLayout::TransferSrcOptimal, AccessFlags::TransferRead,
+                                    PipelineStageFlags::Transfer);
+
+                // Only one aspect can be copied at a time, so depth/stencil textures give their depth
+                VkImageAspectFlags aspect = getDepthReadbackTexelSize(rb.Texture->GetFormat()) != 0
+                    ? VK_IMAGE_ASPECT_DEPTH_BIT
+                    : rb.Texture->getAspectFlags();
+
+                VkBufferImageCopy bic{};
+                bic.bufferOffset = rb.RingOffset;
+                bic.imageSubresource.aspectMask = aspect;
+                bic.imageSubresource.mipLevel = rb.MipLevel;
+                bic.imageSubresource.baseArrayLayer = rb.Layer < 0 ? 0 : rb.Layer;
+                bic.imageSubresource.layerCount = rb.Layer < 0 ? rb.Texture->GetLayerCount() : 1;
+                bic.imageExtent.width = mipScale(rb.Texture->GetWidth(), rb.MipLevel);
+                bic.imageExtent.height = mipScale(rb.Texture->GetHeight(), rb.MipLevel);
+                bic.imageExtent.depth = getReadbackDepth(rb.Texture, rb.MipLevel);
+
+                vkCmdCopyImageToBuffer(cb, rb.Texture->GetNativeHandle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                       destination, 1, &bic);
+            }
+        }
+
+        // Make the copies visible to the host once the frame fence is signalled
+        VkMemoryBarrier hostBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                             1, &hostBarrier, 0, nullptr, 0, nullptr);
+        countBarriers(1);
+
+        // Readbacks queued after this point go in with the next use of this frame index
+        frameResources.SubmittedReadbacks.swap(frameResources.Readbacks);
+        frameResources.Readbacks.clear();
+    }
+
+    void Core::completeFrameReadbacks(uint32_t index)
+    {
+        PerFrameResources& frameResources = perFrameResources[index];
+
+        if (frameResources.SubmittedReadbacks.empty())
+            return;
+
+        TraceScope traceScope{ "Complete readbacks" };
+        std::vector<Readback> readbacks;
+        readbacks.swap(frameResources.SubmittedReadbacks);
+
+        VKCHECK(vmaInvalidateAllocation(handles.Allocator, frameResources.ReadbackAllocation, 0, VK_WHOLE_SIZE));
+
+        for (Readback& rb : readbacks)
+        {
+            if (rb.DedicatedBuffer)
+            {
+                VKCHECK(vmaInvalidateAllocation(handles.Allocator, rb.DedicatedAllocation, 0, VK_WHOLE_SIZE));
+                rb.Callback(rb.DedicatedMapped, rb.DataSize);
+
+                unregisterAllocation(rb.DedicatedAllocation);
+                vmaDestroyBuffer(handles.Allocator, rb.DedicatedBuffer, rb.DedicatedAllocation);
+            }
+            else
+            {
+                rb.Callback(frameResources.ReadbackMapped + rb.RingOffset, rb.DataSize);
+            }
+        }
+    }
+
     DeletionQueue* Core::getCurrentDq()
     {
         return perFrameResources[frameIndex].DeletionQueue;
@@ -1,6 +1,7 @@
 #include <R2/VKCore.hpp>
 #include <R2/R2.hpp>
 #include <RenderPassCache.hpp>
+#include <VKExtensionFunctions.hpp>
 #include <volk.h>
 #ifdef __ANDROID__
 #include <vulkan/vulkan_android.h>
@@ -9,6 +10,7 @@
 #include <vector>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 namespace R2::VK
 {
@@ -32,6 +34,23 @@ namespace R2::VK
         return VK_FALSE;
     }
 
+    bool Core::checkInstanceExtensionSupport(const char* extension)
+    {
+        uint32_t extCount;
+        VKCHECK(vkEnumerateInstanceExtensionProperties(nullptr, &extCount, nullptr));
+        std::vector<VkExtensionProperties> extProps;
+        extProps.resize(extCount);
+        VKCHECK(vkEnumerateInstanceExtensionProperties(nullptr, &extCount, extProps.data()));
+
+        for (auto& extProp : extProps)
+        {
+            if (strcmp(extProp.extensionName, extension) == 0)
+                return true;
+        }
+
+        return false;
+    }
+
     void Core::createInstance(bool enableValidation, const char** instanceExts)
     {
         VKCHECK(volkInitialize());
@@ -54,13 +73,27 @@ namespace R2::VK
         }
 
         extensions.push_back("VK_EXT_debug_utils");
-        extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+
+        if (!headless)
+        {
+            extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
 #ifdef _WIN32
-        extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+            extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 #endif
 #ifdef __ANDROID__
-        extensions.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
+            extensions.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
 #endif
+        }
+        else if (supportedFeatures.HeadlessSurface)
+        {
+            supportedFeatures.HeadlessSurface = checkInstanceExtensionSupport(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+
+            if (supportedFeatures.HeadlessSurface)
+            {
+                extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+                extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+            }
+        }
 
         if (instanceExts != nullptr)
         {
@@ -100,20 +133,132 @@ namespace R2::VK
         {
             messenger = VK_NULL_HANDLE;
         }
+    }
+
+    const char* getDeviceTypeName(VkPhysicalDeviceType type)
+    {
+        switch (type)
+        {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return "CPU";
+        default:
+            return "other";
+        }
+    }
+
+    void Core::selectPhysicalDevice(int deviceIndex, const uint8_t* deviceUUID)
+    {
+        uint32_t deviceCount;
+        VKCHECK(vkEnumeratePhysicalDevices(handles.Instance, &deviceCount, nullptr));
+        std::vector<VkPhysicalDevice> devices;
+        devices.resize(deviceCount);
+        VKCHECK(vkEnumeratePhysicalDevices(handles.Instance, &deviceCount, devices.data()));
+
+        if (deviceCount == 0)
+            throw RenderInitException("No Vulkan devices found!");
+
+        int bestDevice = -1;
+        int64_t bestScore = -1;
+        int requestedDevice = -1;
+
+        for (uint32_t i = 0; i < deviceCount; i++)
+        {
+            VkPhysicalDeviceIDProperties idProps{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES};
+            VkPhysicalDeviceProperties2 props2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+            props2.pNext = &idProps;
+            vkGetPhysicalDeviceProperties2(devices[i], &props2);
+
+            int64_t score = scorePhysicalDevice(devices[i]);
+
+            if (dbgOutRecv)
+            {
+                char buffer[512];
+                snprintf(buffer, sizeof(buffer), "Device %u: %s (%s, score %lli)%s", i,
+                         props2.properties.deviceName, getDeviceTypeName(props2.properties.deviceType), (long long)score,
+                         score < 0 ? " - missing required features" : "");
+                dbgOutRecv->DebugMessage(buffer);
+            }
+
+            // When both are given they have to name the same device
+            bool indexMatches = deviceIndex < 0 || (int)i == deviceIndex;
+            bool uuidMatches = deviceUUID == nullptr || memcmp(idProps.deviceUUID, deviceUUID, VK_UUID_SIZE) == 0;
+
+            if ((deviceIndex >= 0 || deviceUUID != nullptr) && indexMatches && uuidMatches)
+            {
+                if (score < 0)
+                    throw RenderInitException("The requested device doesn't support the required features!");
+
+                requestedDevice = (int)i;
+            }
+
+            if (score > bestScore)
+            {
+                bestScore = score;
+                bestDevice = (int)i;
+            }
+        }
+
+        if (deviceIndex >= 0 || deviceUUID != nullptr)
+        {
+            if (requestedDevice == -1)
+                throw RenderInitException("Couldn't find the requested device!");
+
+            handles.PhysicalDevice = devices[requestedDevice];
+            return;
+        }
 
-        selectPhysicalDevice();
+        if (bestDevice == -1)
+            throw RenderInitException("No Vulkan devices support the required features!");
+
+        handles.PhysicalDevice = devices[bestDevice];
     }
 
-    void Core::selectPhysicalDevice()
+    // Returns -1 if the device can't be used. The device type comes first,
+    // then the amount of device local memory breaks ties.
+    int64_t Core::scorePhysicalDevice(VkPhysicalDevice device)
     {
-        VkPhysicalDevice devices[8];
-        int deviceScores[8] = {0};
-        uint32_t deviceCount = 8;
+        VkPhysicalDeviceProperties props;
+        vkGetPhysicalDeviceProperties(device, &props);
+
+        // checkFeatures() needs the 1.3 feature structs
+        if (props.apiVersion < VK_API_VERSION_1_3 || !checkFeatures(device))
+            return -1;
+
+        int64_t typeScore;
+        switch (props.deviceType)
+        {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            typeScore = 3;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            typeScore = 2;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            typeScore = 1;
+            break;
+        default:
+            typeScore = 0;
+            break;
+        }
 
-        VKCHECK(vkEnumeratePhysicalDevices(handles.Instance, &deviceCount, devices));
+        VkPhysicalDeviceMemoryProperties memProps;
+        vkGetPhysicalDeviceMemoryProperties(device, &memProps);
 
-        // Most of the time, we just want to pick the first device.
-        handles.PhysicalDevice = devices[0];
+        uint64_t deviceLocalBytes = 0;
+        for (uint32_t i = 0; i < memProps.memoryHeapCount; i++)
+        {
+            if (memProps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+                deviceLocalBytes += memProps.memoryHeaps[i].size;
+        }
+
+        // In MB, so it can't overflow into the type score
+        return typeScore * (1ll << 40) + (int64_t)(deviceLocalBytes >> 20);
     }
 
     void Core::findQueueFamilies()
@@ -227,6 +372,23 @@ namespace R2::VK
         supportedFeatures.RayTracing = checkRaytracingSupport(handles.PhysicalDevice);
         supportedFeatures.VariableRateShading = checkExtensionSupport(handles.PhysicalDevice, VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
         supportedFeatures.DynamicRendering = checkExtensionSupport(handles.PhysicalDevice, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+        supportedFeatures.ShaderObject = false;
+#ifdef VK_EXT_shader_object
+        // Shader objects have no render pass compatibility info, so they're only usable with dynamic rendering
+        supportedFeatures.ShaderObject = supportedFeatures.DynamicRendering &&
+            checkExtensionSupport(handles.PhysicalDevice, VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+#endif
+        supportedFeatures.DynamicRenderingLocalRead = false;
+#ifdef VK_KHR_dynamic_rendering_local_read
+        supportedFeatures.DynamicRenderingLocalRead = supportedFeatures.DynamicRendering &&
+            checkExtensionSupport(handles.PhysicalDevice, VK_KHR_DYNAMIC_RENDERING_LOCAL_READ_EXTENSION_NAME);
+#endif
+        supportedFeatures.CalibratedTimestamps = checkExtensionSupport(handles.PhysicalDevice, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+
+        VkPhysicalDeviceFeatures deviceFeatures;
+        vkGetPhysicalDeviceFeatures(handles.PhysicalDevice, &deviceFeatures);
+        supportedFeatures.PipelineStatistics = deviceFeatures.pipelineStatisticsQuery;
+        supportedFeatures.PreciseOcclusionQueries = deviceFeatures.occlusionQueryPrecise;
 
         if (!supportedFeatures.DynamicRendering)
         {
@@ -250,6 +412,8 @@ namespace R2::VK
         features.features.samplerAnisotropy = true;
         features.features.multiDrawIndirect = true;
         features.features.fragmentStoresAndAtomics = true;
+        features.features.pipelineStatisticsQuery = supportedFeatures.PipelineStatistics;
+        features.features.occlusionQueryPrecise = supportedFeatures.PreciseOcclusionQueries;
         features11.multiview = true;
         features11.shaderDrawParameters = true;
         features12.descriptorIndexing = true;
@@ -305,11 +469,46 @@ namespace R2::VK
             chainEnd = (ChainHeader*)&vrsFeatures;
         }
 
+#ifdef VK_EXT_shader_object
+        VkPhysicalDeviceShaderObjectFeaturesEXT shaderObjectFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT};
+        if (supportedFeatures.ShaderObject)
+        {
+            chainEnd->pNext = &shaderObjectFeatures;
+            shaderObjectFeatures.shaderObject = VK_TRUE;
+            chainEnd = (ChainHeader*)&shaderObjectFeatures;
+        }
+#endif
+
+#ifdef VK_KHR_dynamic_rendering_local_read
+        VkPhysicalDeviceDynamicRenderingLocalReadFeaturesKHR localReadFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_LOCAL_READ_FEATURES_KHR};
+        if (supportedFeatures.DynamicRenderingLocalRead)
+        {
+            chainEnd->pNext = &localReadFeatures;
+            localReadFeatures.dynamicRenderingLocalRead = VK_TRUE;
+            chainEnd = (ChainHeader*)&localReadFeatures;
+        }
+#endif
+
         // Extensions
         // ==========
         std::vector<const char*> extensions;
-        extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
-        extensions.push_back(VK_AMD_SHADER_EXPLICIT_VERTEX_PARAMETER_EXTENSION_NAME);
+
+        if (headless)
+        {
+            supportedFeatures.HeadlessSurface = supportedFeatures.HeadlessSurface &&
+                checkExtensionSupport(handles.PhysicalDevice, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        }
+
+        if (!headless || supportedFeatures.HeadlessSurface)
+        {
+            extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        }
+
+        // Not available on software implementations like lavapipe
+        if (checkExtensionSupport(handles.PhysicalDevice, VK_AMD_SHADER_EXPLICIT_VERTEX_PARAMETER_EXTENSION_NAME))
+        {
+            extensions.push_back(VK_AMD_SHADER_EXPLICIT_VERTEX_PARAMETER_EXTENSION_NAME);
+        }
 
         if (supportedFeatures.RayTracing)
         {
@@ -323,6 +522,25 @@ namespace R2::VK
             extensions.push_back(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
         }
 
+#ifdef VK_EXT_shader_object
+        if (supportedFeatures.ShaderObject)
+        {
+            extensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+        }
+#endif
+
+#ifdef VK_KHR_dynamic_rendering_local_read
+        if (supportedFeatures.DynamicRenderingLocalRead)
+        {
+            extensions.push_back(VK_KHR_DYNAMIC_RENDERING_LOCAL_READ_EXTENSION_NAME);
+        }
+#endif
+
+        if (supportedFeatures.CalibratedTimestamps)
+        {
+            extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+        }
+
 #ifdef __ANDROID__
         extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
         extensions.push_back(VK_KHR_IMAGELESS_FRAMEBUFFER_EXTENSION_NAME);
@@ -372,6 +590,7 @@ namespace R2::VK
         VKCHECK(vkCreateDevice(handles.PhysicalDevice, &dci, handles.AllocCallbacks, &handles.Device));
 
         volkLoadDevice(handles.Device);
+        loadExtensionFunctions(handles.Device);
 
         vkGetDeviceQueue(handles.Device, handles.Queues.GraphicsFamilyIndex, 0, &handles.Queues.Graphics);
 
@@ -437,6 +656,8 @@ namespace R2::VK
         dpci.maxSets = 1000;
         VkDescriptorPoolSize poolSizes[] = {
             {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5000},
+            {VK_DESCRIPTOR_TYPE_SAMPLER, 500},
+            {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 5000},
             {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 500},
             {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 500},
             {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 500}
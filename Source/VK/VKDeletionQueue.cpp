@@ -3,6 +3,8 @@
 #include <volk.h>
 #include <vk_mem_alloc.h>
 #include <assert.h>
+#include <VKExtensionFunctions.hpp>
+#include <AllocationRegistry.hpp>
 
 namespace R2::VK
 {
@@ -14,47 +16,63 @@ namespace R2::VK
 #ifdef DQ_TRACK_SOURCE
     void DeletionQueue::QueueObjectDeletion(void* object, uint32_t type, int line, const char* file)
     {
+        std::unique_lock lock{mutex};
         objectDeletions.push_back({ object, type, line, file });
     }
 
     void DeletionQueue::QueueMemoryFree(VmaAllocation allocation, int line, const char* file)
     {
+        std::unique_lock lock{mutex};
         memoryFrees.push_back({ allocation, line, file });
     }
     
     void DeletionQueue::QueuePoolDeletion(VmaPool pool, int line, const char* file)
     {
+        std::unique_lock lock{mutex};
         poolDeletions.push_back({ pool, line, file });
     }
 
     void DeletionQueue::QueueDescriptorSetFree(VkDescriptorPool pool, VkDescriptorSet set, int line, const char* file)
     {
+        std::unique_lock lock{mutex};
         dsFrees.push_back({ pool, set, line, file });
     }
 #else
     void DeletionQueue::QueueObjectDeletion(void* object, uint32_t type)
     {
+        std::unique_lock lock{mutex};
         objectDeletions.push_back({ object, type });
     }
 
     void DeletionQueue::QueueMemoryFree(VmaAllocation allocation)
     {
+        std::unique_lock lock{mutex};
         memoryFrees.push_back({ allocation });
     }
 
     void DeletionQueue::QueuePoolDeletion(VmaPool pool)
     {
+        std::unique_lock lock{mutex};
         poolDeletions.push_back({ pool });
     }
 
     void DeletionQueue::QueueDescriptorSetFree(VkDescriptorPool pool, VkDescriptorSet set)
     {
+        std::unique_lock lock{mutex};
         dsFrees.push_back({ pool, set });
     }
 #endif
 
+    size_t DeletionQueue::GetNumQueued() const
+    {
+        std::unique_lock lock{mutex};
+        return objectDeletions.size() + memoryFrees.size() + poolDeletions.size() + dsFrees.size();
+    }
+
     void DeletionQueue::Cleanup()
     {
+        std::unique_lock lock{mutex};
+
         for (const ObjectDeletion& od : objectDeletions)
         {
             processObjectDeletion(od);
@@ -77,6 +95,7 @@ namespace R2::VK
 
         objectDeletions.clear();
         memoryFrees.clear();
+        poolDeletions.clear();
         dsFrees.clear();
     }
 
@@ -121,6 +140,17 @@ namespace R2::VK
         case VK_OBJECT_TYPE_IMAGE_VIEW:
             vkDestroyImageView(handles->Device, (VkImageView)object, handles->AllocCallbacks);
             break;
+        case VK_OBJECT_TYPE_COMMAND_POOL:
+            vkDestroyCommandPool(handles->Device, (VkCommandPool)object, handles->AllocCallbacks);
+            break;
+        case VK_OBJECT_TYPE_QUERY_POOL:
+            vkDestroyQueryPool(handles->Device, (VkQueryPool)object, handles->AllocCallbacks);
+            break;
+#ifdef VK_EXT_shader_object
+        case VK_OBJECT_TYPE_SHADER_EXT:
+            g_extFuncs.DestroyShaderEXT(handles->Device, (VkShaderEXT)object, handles->AllocCallbacks);
+            break;
+#endif
         default:
             assert(false && "Unhandled Vulkan object deletion! This is a bug.");
             break;
@@ -129,6 +159,7 @@ namespace R2::VK
 
     void DeletionQueue::processMemoryFree(const MemoryFree& mf)
     {
+        unregisterAllocation(mf.allocation);
         vmaFreeMemory(handles->Allocator, mf.allocation);
     }
 
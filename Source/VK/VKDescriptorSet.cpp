@@ -5,16 +5,16 @@
 #include <R2/VKSampler.hpp>
 #include <R2/VKDeletionQueue.hpp>
 #include <volk.h>
+#include <LayoutCache.hpp>
+#include <RuntimeMetrics.hpp>
 
 namespace R2::VK
 {
-    int allocatedDescriptorSets = 0;
-
     DescriptorSet::DescriptorSet(Core* core, VkDescriptorSet set)
         : core(core)
         , set(set)
     {
-        allocatedDescriptorSets++;
+        countMetric(Metric::DescriptorSetsAllocated);
     }
 
     VkDescriptorSet DescriptorSet::GetNativeHandle()
@@ -26,7 +26,7 @@ namespace R2::VK
     {
         DeletionQueue* dq = core->perFrameResources[core->frameIndex].DeletionQueue;
         DQ_QueueDescriptorSetFree(dq, core->GetHandles()->DescriptorPool, set);
-        allocatedDescriptorSets--;
+        countMetric(Metric::DescriptorSetsFreed);
     }
 
     DescriptorSetLayout::DescriptorSetLayout(Core* core, VkDescriptorSetLayout layout)
@@ -42,8 +42,7 @@ namespace R2::VK
 
     DescriptorSetLayout::~DescriptorSetLayout()
     {
-        const Handles* handles = core->GetHandles();
-        vkDestroyDescriptorSetLayout(handles->Device, layout, handles->AllocCallbacks);
+        g_layoutCache->Release(layout);
     }
 
     DescriptorSetLayoutBuilder::DescriptorSetLayoutBuilder(Core* core)
@@ -139,10 +138,7 @@ namespace R2::VK
 
         dslci.pNext = &bindFlagsCreateInfo;
 
-        const Handles* handles = core->GetHandles();
-
-        VkDescriptorSetLayout dsl;
-        VKCHECK(vkCreateDescriptorSetLayout(handles->Device, &dslci, handles->AllocCallbacks, &dsl));
+        VkDescriptorSetLayout dsl = g_layoutCache->AcquireDescriptorSetLayout(dslci);
 
         return new DescriptorSetLayout(core, dsl);
     }
@@ -331,5 +327,6 @@ namespace R2::VK
         }
 
         vkUpdateDescriptorSets(handles->Device, writes.size(), writes.data(), 0, nullptr);
+        countMetric(Metric::DescriptorWrites, writes.size());
     }
 }
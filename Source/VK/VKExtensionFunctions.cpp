@@ -0,0 +1,30 @@
+#include <VKExtensionFunctions.hpp>
+
+namespace R2::VK
+{
+    ExtensionFunctions g_extFuncs{};
+
+#define LOAD_DEVICE_FUNC(name) g_extFuncs.name = (PFN_vk##name)vkGetDeviceProcAddr(device, "vk" #name)
+
+    void loadExtensionFunctions(VkDevice device)
+    {
+#ifdef VK_EXT_shader_object
+        LOAD_DEVICE_FUNC(CreateShadersEXT);
+        LOAD_DEVICE_FUNC(DestroyShaderEXT);
+        LOAD_DEVICE_FUNC(CmdBindShadersEXT);
+        LOAD_DEVICE_FUNC(CmdSetPolygonModeEXT);
+        LOAD_DEVICE_FUNC(CmdSetRasterizationSamplesEXT);
+        LOAD_DEVICE_FUNC(CmdSetSampleMaskEXT);
+        LOAD_DEVICE_FUNC(CmdSetAlphaToCoverageEnableEXT);
+        LOAD_DEVICE_FUNC(CmdSetColorBlendEnableEXT);
+        LOAD_DEVICE_FUNC(CmdSetColorBlendEquationEXT);
+        LOAD_DEVICE_FUNC(CmdSetColorWriteMaskEXT);
+#endif
+#ifdef VK_KHR_dynamic_rendering_local_read
+        LOAD_DEVICE_FUNC(CmdSetRenderingAttachmentLocationsKHR);
+        LOAD_DEVICE_FUNC(CmdSetRenderingInputAttachmentIndicesKHR);
+#endif
+    }
+
+#undef LOAD_DEVICE_FUNC
+}
@@ -0,0 +1,169 @@
+#include <R2/VKGPUProfiler.hpp>
+#include <R2/VKCore.hpp>
+#include <R2/VKTimestampPool.hpp>
+#include <assert.h>
+
+namespace R2::VK
+{
+    const uint32_t NO_ZONE = ~0u;
+
+    GPUProfiler::GPUProfiler(Core* core, uint32_t maxZonesPerFrame)
+        : core(core)
+        , maxZonesPerFrame(maxZonesPerFrame)
+    {
+        uint32_t numFrames = core->GetNumFramesInFlight();
+
+        // Each zone has a begin and end timestamp
+        timestampPool = new TimestampPool(core->GetHandles(), (int)(numFrames * maxZonesPerFrame * 2));
+        frames.resize(numFrames);
+
+        for (FrameQueries& frame : frames)
+        {
+            frame.Zones.reserve(maxZonesPerFrame);
+            frame.FrameNumber = 0;
+        }
+
+        zoneStack.reserve(32);
+        timestampScratch.resize(maxZonesPerFrame * 2);
+        results.reserve(maxZonesPerFrame);
+    }
+
+    GPUProfiler::~GPUProfiler()
+    {
+        delete timestampPool;
+    }
+
+    void GPUProfiler::BeginFrame(CommandBuffer cb)
+    {
+        assert(zoneStack.empty() && "Zones must be ended in the frame they began");
+
+        uint32_t frameIndex = core->GetFrameIndex();
+        uint32_t queryOffset = frameIndex * maxZonesPerFrame * 2;
+        FrameQueries& frame = frames[frameIndex];
+
+        // The frame's fence has been waited on by Core::BeginFrame, so
+        // reading the queries back won't stall
+        if (!frame.Zones.empty())
+        {
+            readResults(frame, queryOffset);
+            frame.Zones.clear();
+        }
+
+        frame.FrameNumber = core->GetFrameNumber();
+        timestampPool->Reset(cb, (int)queryOffset, (int)(maxZonesPerFrame * 2));
+    }
+
+    void GPUProfiler::BeginZone(CommandBuffer cb, const char* name)
+    {
+        cb.BeginDebugLabel(name, 0.5f, 0.5f, 0.5f);
+
+        FrameQueries& frame = frames[core->GetFrameIndex()];
+        if (!enabled || frame.Zones.size() == maxZonesPerFrame)
+        {
+            zoneStack.push_back(NO_ZONE);
+            return;
+        }
+
+        // Dropped zones don't appear in the results, so skip past them to
+        // find the real parent
+        uint32_t parent = NO_ZONE;
+        uint32_t depth = 0;
+        for (size_t i = zoneStack.size(); i > 0; i--)
+        {
+            if (zoneStack[i - 1] != NO_ZONE)
+            {
+                parent = zoneStack[i - 1];
+                depth = frame.Zones[parent].Depth + 1;
+                break;
+            }
+        }
+
+        uint32_t zoneIndex = (uint32_t)frame.Zones.size();
+        frame.Zones.push_back(PendingZone{ name, parent, depth });
+        zoneStack.push_back(zoneIndex);
+
+        uint32_t queryOffset = core->GetFrameIndex() * maxZonesPerFrame * 2;
+        timestampPool->WriteTimestamp(cb, (int)(queryOffset + zoneIndex * 2));
+    }
+
+    void GPUProfiler::EndZone(CommandBuffer cb)
+    {
+        assert(!zoneStack.empty());
+        uint32_t zoneIndex = zoneStack.back();
+        zoneStack.pop_back();
+
+        if (zoneIndex != NO_ZONE)
+        {
+            uint32_t queryOffset = core->GetFrameIndex() * maxZonesPerFrame * 2;
+            timestampPool->WriteTimestamp(cb, (int)(queryOffset + zoneIndex * 2 + 1));
+        }
+
+        cb.EndDebugLabel();
+    }
+
+    void GPUProfiler::SetEnabled(bool enabled)
+    {
+        this->enabled = enabled;
+    }
+
+    bool GPUProfiler::IsEnabled() const
+    {
+        return enabled;
+    }
+
+    const std::vector<GPUProfiler::Zone>& GPUProfiler::GetResults() const
+    {
+        return results;
+    }
+
+    uint64_t GPUProfiler::GetResultsFrameNumber() const
+    {
+        return resultsFrameNumber;
+    }
+
+    uint64_t GPUProfiler::GetResultsStartTimestamp() const
+    {
+        return resultsStartTimestamp;
+    }
+
+    void GPUProfiler::readResults(FrameQueries& frame, uint32_t queryOffset)
+    {
+        uint32_t numQueries = (uint32_t)frame.Zones.size() * 2;
+        if (!timestampPool->GetTimestamps((int)queryOffset, (int)numQueries, timestampScratch.data()))
+            return;
+
+        double msPerTick = core->GetDeviceInfo().TimestampPeriod / 1000000.0;
+        uint64_t frameStart = timestampScratch[0];
+
+        results.clear();
+        for (size_t i = 0; i < frame.Zones.size(); i++)
+        {
+            const PendingZone& pz = frame.Zones[i];
+            uint64_t begin = timestampScratch[i * 2];
+            uint64_t end = timestampScratch[i * 2 + 1];
+
+            Zone zone{};
+            zone.Name = pz.Name;
+            zone.Parent = pz.Parent;
+            zone.Depth = pz.Depth;
+            zone.StartMs = begin > frameStart ? (double)(begin - frameStart) * msPerTick : 0.0;
+            zone.DurationMs = end > begin ? (double)(end - begin) * msPerTick : 0.0;
+            results.push_back(zone);
+        }
+
+        resultsFrameNumber = frame.FrameNumber;
+        resultsStartTimestamp = frameStart;
+    }
+
+    ProfileScope::ProfileScope(GPUProfiler* profiler, CommandBuffer cb, const char* name)
+        : profiler(profiler)
+        , cb(cb)
+    {
+        profiler->BeginZone(cb, name);
+    }
+
+    ProfileScope::~ProfileScope()
+    {
+        profiler->EndZone(cb);
+    }
+}
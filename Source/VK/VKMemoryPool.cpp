@@ -2,6 +2,8 @@
 #include <volk.h>
 #include <vk_mem_alloc.h>
 #include <R2/VK.hpp>
+#include <AllocationRegistry.hpp>
+#include <assert.h>
 
 #include "R2/VKDeletionQueue.hpp"
 
@@ -42,4 +44,45 @@ namespace R2::VK
         dq = core->perFrameResources[core->GetFrameIndex()].DeletionQueue;
         DQ_QueuePoolDeletion(dq, pool);
     }
+
+    AliasedMemory::AliasedMemory(Core* core, MemoryPool* pool, const MemoryRequirements& requirements)
+        : core(core)
+        , size(requirements.Size)
+    {
+        VkMemoryRequirements memReq{};
+        memReq.size = requirements.Size;
+        memReq.alignment = requirements.Alignment;
+        memReq.memoryTypeBits = requirements.MemoryTypeBits;
+
+        VmaAllocationCreateInfo vaci{};
+        if (pool)
+        {
+            vaci.pool = pool->GetNativeHandle();
+        }
+        else
+        {
+            vaci.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        }
+
+        VKCHECK(vmaAllocateMemory(core->GetHandles()->Allocator, &memReq, &vaci, &allocation, nullptr));
+        registerAllocation(allocation, MemoryCategory::Pool);
+    }
+
+    void AliasedMemory::Bind(Texture* tex, uint64_t offset)
+    {
+        assert(offset + tex->GetMemoryRequirements().Size <= size);
+        tex->bindMemory(allocation, offset);
+    }
+
+    void AliasedMemory::Bind(Buffer* buf, uint64_t offset)
+    {
+        assert(offset + buf->GetMemoryRequirements().Size <= size);
+        buf->bindMemory(allocation, offset);
+    }
+
+    AliasedMemory::~AliasedMemory()
+    {
+        DeletionQueue* dq = core->perFrameResources[core->GetFrameIndex()].DeletionQueue;
+        DQ_QueueMemoryFree(dq, allocation);
+    }
 }
@@ -0,0 +1,114 @@
+#include <R2/VKMemoryReport.hpp>
+#include <R2/VKCore.hpp>
+#include <AllocationRegistry.hpp>
+#include <volk.h>
+#include <vk_mem_alloc.h>
+#include <algorithm>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+
+namespace R2::VK
+{
+    std::mutex g_allocationRegistryMutex;
+    std::unordered_map<VmaAllocation, MemoryCategory> g_allocationRegistry;
+
+    void registerAllocation(VmaAllocation allocation, MemoryCategory category)
+    {
+        std::lock_guard lock{g_allocationRegistryMutex};
+        g_allocationRegistry[allocation] = category;
+    }
+
+    void unregisterAllocation(VmaAllocation allocation)
+    {
+        std::lock_guard lock{g_allocationRegistryMutex};
+        g_allocationRegistry.erase(allocation);
+    }
+
+    const char* GetMemoryCategoryName(MemoryCategory category)
+    {
+        switch (category)
+        {
+        case MemoryCategory::Texture:
+            return "Texture";
+        case MemoryCategory::Buffer:
+            return "Buffer";
+        case MemoryCategory::Staging:
+            return "Staging";
+        case MemoryCategory::Pool:
+            return "Pool";
+        default:
+            return "Unknown";
+        }
+    }
+
+    MemoryReport BuildMemoryReport(Core* core, char prefixSeparator)
+    {
+        VmaAllocator allocator = core->GetHandles()->Allocator;
+        MemoryReport report{};
+        std::unordered_map<std::string, size_t> entryIndices[(uint32_t)MemoryCategory::Count];
+
+        std::lock_guard lock{g_allocationRegistryMutex};
+        for (const auto& pair : g_allocationRegistry)
+        {
+            VmaAllocationInfo allocInfo;
+            vmaGetAllocationInfo(allocator, pair.first, &allocInfo);
+
+            std::string prefix;
+            if (allocInfo.pName != nullptr && allocInfo.pName[0] != '\0')
+            {
+                const char* separator = strchr(allocInfo.pName, prefixSeparator);
+                prefix = separator ? std::string(allocInfo.pName, separator) : std::string(allocInfo.pName);
+            }
+            else
+            {
+                prefix = "<unnamed>";
+            }
+
+            uint32_t categoryIndex = (uint32_t)pair.second;
+            auto& indices = entryIndices[categoryIndex];
+            auto it = indices.find(prefix);
+
+            if (it == indices.end())
+            {
+                it = indices.insert({ prefix, report.Entries.size() }).first;
+                report.Entries.push_back(MemoryReportEntry{ prefix, pair.second, 0, 0, 0 });
+            }
+
+            MemoryReportEntry& entry = report.Entries[it->second];
+            entry.Bytes += allocInfo.size;
+            entry.NumAllocations++;
+
+            if (isDedicatedAllocation(pair.first))
+                entry.NumDedicated++;
+
+            report.CategoryBytes[categoryIndex] += allocInfo.size;
+            report.TotalBytes += allocInfo.size;
+        }
+
+        std::sort(report.Entries.begin(), report.Entries.end(), [](const MemoryReportEntry& a, const MemoryReportEntry& b)
+        {
+            return a.Bytes > b.Bytes;
+        });
+
+        return report;
+    }
+
+    bool WriteMemoryStatsJSON(Core* core, const char* path, bool detailed)
+    {
+        FILE* file = fopen(path, "wb");
+        if (!file)
+            return false;
+
+        VmaAllocator allocator = core->GetHandles()->Allocator;
+        char* statsString;
+        vmaBuildStatsString(allocator, &statsString, detailed ? VK_TRUE : VK_FALSE);
+
+        size_t length = strlen(statsString);
+        bool written = fwrite(statsString, 1, length, file) == length;
+
+        vmaFreeStatsString(allocator, statsString);
+        return fclose(file) == 0 && written;
+    }
+}
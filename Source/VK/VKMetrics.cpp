@@ -0,0 +1,43 @@
+#include <R2/VKMetrics.hpp>
+#include <RuntimeMetrics.hpp>
+
+namespace R2::VK
+{
+    std::atomic<uint64_t> g_metricTotals[(uint32_t)Metric::Count];
+
+    const char* metricNames[] =
+    {
+        "bytes_staged",
+        "uploads",
+        "staging_flushes",
+        "oversized_uploads",
+        "readbacks",
+        "bytes_read_back",
+        "idle_waits",
+        "barriers",
+        "barrier_commands",
+        "descriptor_writes",
+        "descriptor_sets_allocated",
+        "descriptor_sets_freed",
+        "pipelines_created",
+        "shader_objects_created",
+        "render_pass_cache_hits",
+        "render_pass_cache_misses",
+        "framebuffer_cache_hits",
+        "framebuffer_cache_misses",
+        "live_descriptor_sets",
+        "deletion_queue_depth"
+    };
+
+    static_assert(sizeof(metricNames) / sizeof(metricNames[0]) == (size_t)Metric::Count);
+
+    const char* MetricsSnapshot::GetName(Metric metric)
+    {
+        return metricNames[(uint32_t)metric];
+    }
+
+    bool MetricsSnapshot::IsGauge(Metric metric)
+    {
+        return metric >= Metric::LiveDescriptorSets;
+    }
+}
@@ -3,11 +3,64 @@
 #include <R2/VKDeletionQueue.hpp>
 #include <R2/VKDescriptorSet.hpp>
 #include <R2/VKTexture.hpp>
+#include <R2/VKTraceRecorder.hpp>
 #include <volk.h>
 #include <RenderPassCache.hpp>
+#include <LayoutCache.hpp>
+#include <RuntimeMetrics.hpp>
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
 
 namespace R2::VK
 {
+    void SpecializationConstants::SetRaw(uint32_t constantId, const void* value, size_t size)
+    {
+        for (Entry& e : entries)
+        {
+            if (e.ConstantID != constantId)
+                continue;
+
+            if (e.Size != size)
+            {
+                // Take the old value out of the data and move this entry to the end
+                data.erase(data.begin() + e.Offset, data.begin() + e.Offset + e.Size);
+
+                for (Entry& other : entries)
+                {
+                    if (other.Offset > e.Offset)
+                        other.Offset -= (uint32_t)e.Size;
+                }
+
+                e.Offset = (uint32_t)data.size();
+                e.Size = size;
+                data.resize(data.size() + size);
+            }
+
+            memcpy(data.data() + e.Offset, value, size);
+            return;
+        }
+
+        Entry e{ constantId, (uint32_t)data.size(), size };
+        data.resize(data.size() + size);
+        memcpy(data.data() + e.Offset, value, size);
+        entries.push_back(e);
+    }
+
+    bool SpecializationConstants::IsEmpty() const
+    {
+        return entries.empty();
+    }
+
+    void SpecializationConstants::GetNativeInfo(VkSpecializationInfo& info) const
+    {
+        static_assert(sizeof(VkSpecializationMapEntry) == sizeof(Entry));
+        info.mapEntryCount = (uint32_t)entries.size();
+        info.pMapEntries = reinterpret_cast<const VkSpecializationMapEntry*>(entries.data());
+        info.dataSize = data.size();
+        info.pData = data.data();
+    }
+
     ShaderModule::ShaderModule(const Handles* handles, const uint32_t* data, size_t dataLength)
         : handles(handles)
     {
@@ -15,6 +68,8 @@ namespace R2::VK
         smci.codeSize = dataLength;
         smci.pCode = data;
         VKCHECK(vkCreateShaderModule(handles->Device, &smci, handles->AllocCallbacks, &mod));
+
+        ReflectSpirv(data, dataLength, reflection);
     }
 
     ShaderModule::~ShaderModule()
@@ -27,6 +82,11 @@ namespace R2::VK
         return mod;
     }
 
+    const ShaderReflection& ShaderModule::GetReflection() const
+    {
+        return reflection;
+    }
+
     PipelineLayout::PipelineLayout(const Handles* handles, VkPipelineLayout layout)
         : handles(handles)
         , layout(layout)
@@ -34,7 +94,7 @@ namespace R2::VK
 
     PipelineLayout::~PipelineLayout()
     {
-        vkDestroyPipelineLayout(handles->Device, layout, handles->AllocCallbacks);
+        g_layoutCache->Release(layout);
     }
 
     VkPipelineLayout PipelineLayout::GetNativeHandle()
@@ -73,12 +133,138 @@ namespace R2::VK
         plci.setLayoutCount = (uint32_t)descriptorSetLayouts.size();
         plci.pSetLayouts = descriptorSetLayouts.data();
         
-        VkPipelineLayout pipelineLayout;
-        VKCHECK(vkCreatePipelineLayout(handles->Device, &plci, handles->AllocCallbacks, &pipelineLayout));
+        VkPipelineLayout pipelineLayout = g_layoutCache->AcquirePipelineLayout(plci);
 
         return new PipelineLayout(handles, pipelineLayout);
     }
 
+    ReflectedLayout::~ReflectedLayout()
+    {
+        delete pipelineLayout;
+
+        for (DescriptorSetLayout* dsl : setLayouts)
+        {
+            delete dsl;
+        }
+    }
+
+    PipelineLayout* ReflectedLayout::GetPipelineLayout()
+    {
+        return pipelineLayout;
+    }
+
+    DescriptorSetLayout* ReflectedLayout::GetDescriptorSetLayout(uint32_t set)
+    {
+        if (set >= setLayouts.size())
+            return nullptr;
+
+        return setLayouts[set];
+    }
+
+    uint32_t ReflectedLayout::GetNumDescriptorSetLayouts() const
+    {
+        return (uint32_t)setLayouts.size();
+    }
+
+    ShaderStage ReflectedLayout::GetPushConstantStages() const
+    {
+        return pushConstantStages;
+    }
+
+    ReflectedLayoutBuilder::ReflectedLayoutBuilder(Core* core)
+        : core(core)
+    {}
+
+    ReflectedLayoutBuilder& ReflectedLayoutBuilder::AddModule(const ShaderModule& mod)
+    {
+        const ShaderReflection& reflection = mod.GetReflection();
+        assert(reflection.Valid && "Tried to build a layout from a shader that couldn't be reflected");
+
+        for (const ShaderBinding& sb : reflection.Bindings)
+        {
+            bool merged = false;
+
+            for (MergedBinding& mb : bindings)
+            {
+                if (mb.Binding.Set == sb.Set && mb.Binding.Binding == sb.Binding)
+                {
+                    assert(mb.Binding.Type == sb.Type && "Shader stages disagree on the type of a binding");
+                    mb.Stages = mb.Stages | reflection.Stage;
+                    mb.Binding.Count = std::max(mb.Binding.Count, sb.Count);
+                    merged = true;
+                    break;
+                }
+            }
+
+            if (!merged)
+            {
+                bindings.push_back(MergedBinding{ sb, reflection.Stage });
+            }
+        }
+
+        // Stages share one range covering all of their push constants
+        if (reflection.PushConstantSize > 0)
+        {
+            pushConstantStart = std::min(pushConstantStart, reflection.PushConstantOffset);
+            pushConstantEnd = std::max(pushConstantEnd, reflection.PushConstantOffset + reflection.PushConstantSize);
+            pushConstantStages |= (uint32_t)reflection.Stage;
+        }
+
+        return *this;
+    }
+
+    ReflectedLayoutBuilder& ReflectedLayoutBuilder::RuntimeArraySize(uint32_t count)
+    {
+        runtimeArraySize = count;
+        return *this;
+    }
+
+    ReflectedLayout* ReflectedLayoutBuilder::Build()
+    {
+        std::sort(bindings.begin(), bindings.end(),
+            [](const MergedBinding& a, const MergedBinding& b)
+            {
+                return a.Binding.Set != b.Binding.Set ? a.Binding.Set < b.Binding.Set : a.Binding.Binding < b.Binding.Binding;
+            });
+
+        uint32_t numSets = bindings.empty() ? 0 : bindings.back().Binding.Set + 1;
+
+        ReflectedLayout* layout = new ReflectedLayout();
+        PipelineLayoutBuilder plb{core};
+
+        size_t bindingIdx = 0;
+        for (uint32_t set = 0; set < numSets; set++)
+        {
+            // Unused sets still need a (empty) layout so the pipeline layout is contiguous
+            DescriptorSetLayoutBuilder dslb{core};
+
+            for (; bindingIdx < bindings.size() && bindings[bindingIdx].Binding.Set == set; bindingIdx++)
+            {
+                const MergedBinding& mb = bindings[bindingIdx];
+                bool runtimeSized = mb.Binding.Count == 0;
+                dslb.Binding(mb.Binding.Binding, mb.Binding.Type,
+                    runtimeSized ? runtimeArraySize : mb.Binding.Count, mb.Stages);
+
+                if (runtimeSized)
+                    dslb.PartiallyBound();
+            }
+
+            DescriptorSetLayout* dsl = dslb.Build();
+            layout->setLayouts.push_back(dsl);
+            plb.DescriptorSet(dsl);
+        }
+
+        if (pushConstantStart != ~0u)
+        {
+            layout->pushConstantStages = static_cast<ShaderStage>(pushConstantStages);
+            plb.PushConstants(layout->pushConstantStages, pushConstantStart, pushConstantEnd - pushConstantStart);
+        }
+
+        layout->pipelineLayout = plb.Build();
+
+        return layout;
+    }
+
     Pipeline::Pipeline(Core* core, VkPipeline pipeline)
         : core(core)
         , pipeline(pipeline)
@@ -203,6 +389,19 @@ namespace R2::VK
         return *this;
     }
 
+    PipelineBuilder& PipelineBuilder::Subpass(uint32_t colorAttachmentMask, uint32_t inputAttachmentMask)
+    {
+        assert(subpasses.size() < MAX_SUBPASSES);
+        subpasses.push_back(SubpassInfo{ colorAttachmentMask, inputAttachmentMask });
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::SubpassIndex(uint32_t index)
+    {
+        subpassIndex = index;
+        return *this;
+    }
+
     PipelineBuilder& PipelineBuilder::DepthBias(bool enable)
     {
         depthBias = enable;
@@ -223,6 +422,7 @@ namespace R2::VK
 
     Pipeline* PipelineBuilder::Build()
     {
+        TraceScope traceScope{ "PipelineBuilder::Build" };
 
         // Convert vertex bindings
         std::vector<VkVertexInputBindingDescription> bindingDescs;
@@ -343,6 +543,9 @@ namespace R2::VK
         viewportStateCI.pViewports = &viewport;
         viewportStateCI.viewportCount = 1;
 
+        VkSpecializationInfo specInfo{};
+        specConstants.GetNativeInfo(specInfo);
+
         std::vector<VkPipelineShaderStageCreateInfo> vkShaderStages;
         vkShaderStages.reserve(shaderStages.size());
 
@@ -352,6 +555,8 @@ namespace R2::VK
             vkStage.stage = convertShaderStage(stage.stage);
             vkStage.module = stage.module.GetNativeHandle();
             vkStage.pName = "main";
+            if (!specConstants.IsEmpty())
+                vkStage.pSpecializationInfo = &specInfo;
             vkShaderStages.push_back(vkStage);
         }
 
@@ -371,6 +576,15 @@ namespace R2::VK
         pci.flags = VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
 
         VkPipelineRenderingCreateInfo renderingCI{ VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
+#ifdef VK_KHR_dynamic_rendering_local_read
+        VkRenderingAttachmentLocationInfoKHR locationInfo{ VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_LOCATION_INFO_KHR };
+        VkRenderingInputAttachmentIndexInfoKHR inputIndexInfo{ VK_STRUCTURE_TYPE_RENDERING_INPUT_ATTACHMENT_INDEX_INFO_KHR };
+        uint32_t locations[MAX_RENDER_PASS_COLOR_ATTACHMENTS];
+        uint32_t inputIndices[MAX_RENDER_PASS_COLOR_ATTACHMENTS];
+#endif
+        // Blend states of the attachments a real subpass writes, in location order
+        std::vector<VkPipelineColorBlendAttachmentState> subpassBlendStates;
+
         if (g_renderPassCache == nullptr)
         {
             // Rendering state
@@ -380,13 +594,39 @@ namespace R2::VK
             renderingCI.depthAttachmentFormat = static_cast<VkFormat>(depthFormat);
             renderingCI.viewMask = viewMask;
             pci.pNext = &renderingCI;
+
+#ifdef VK_KHR_dynamic_rendering_local_read
+            if (!subpasses.empty())
+            {
+                assert(subpassIndex < subpasses.size());
+                assert(attachmentFormats.size() <= MAX_RENDER_PASS_COLOR_ATTACHMENTS);
+                const SubpassInfo& subpass = subpasses[subpassIndex];
+
+                uint32_t nextLocation = 0;
+                uint32_t nextInputIndex = 0;
+                for (size_t i = 0; i < attachmentFormats.size(); i++)
+                {
+                    uint32_t bit = 1u << i;
+                    locations[i] = (subpass.ColorAttachmentMask & bit) ? nextLocation++ : VK_ATTACHMENT_UNUSED;
+                    inputIndices[i] = (subpass.InputAttachmentMask & bit) ? nextInputIndex++ : VK_ATTACHMENT_UNUSED;
+                }
+
+                locationInfo.colorAttachmentCount = (uint32_t)attachmentFormats.size();
+                locationInfo.pColorAttachmentLocations = locations;
+                inputIndexInfo.colorAttachmentCount = (uint32_t)attachmentFormats.size();
+                inputIndexInfo.pColorAttachmentInputIndices = inputIndices;
+
+                renderingCI.pNext = &locationInfo;
+                locationInfo.pNext = &inputIndexInfo;
+            }
+#else
+            assert(subpasses.empty() && "R2 was built against Vulkan headers without VK_KHR_dynamic_rendering_local_read");
+#endif
         }
         else
         {
-            RenderPassKey rpKey
-            {
-                .viewMask = viewMask
-            };
+            RenderPassKey rpKey{};
+            rpKey.viewMask = viewMask;
 
             if (depthFormat != TextureFormat::UNDEFINED)
             {
@@ -400,23 +640,49 @@ namespace R2::VK
                 rpKey.useDepth = true;
             }
 
-            if (!attachmentFormats.empty())
+            assert(attachmentFormats.size() <= MAX_RENDER_PASS_COLOR_ATTACHMENTS);
+            rpKey.numColorAttachments = (uint32_t)attachmentFormats.size();
+
+            for (size_t i = 0; i < attachmentFormats.size(); i++)
             {
-                rpKey.colorAttachment = RenderPassAttachment
+                rpKey.colorAttachments[i] = RenderPassAttachment
                 {
-                    .format = (VkFormat)attachmentFormats[0],
+                    .format = (VkFormat)attachmentFormats[i],
                     .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
                     .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
                     .samples = (VkSampleCountFlagBits)numSamples
                 };
-                rpKey.useColor = true;
+            }
+
+            rpKey.numSubpasses = (uint32_t)subpasses.size();
+            for (size_t i = 0; i < subpasses.size(); i++)
+            {
+                rpKey.subpassColorMasks[i] = subpasses[i].ColorAttachmentMask;
+                rpKey.subpassInputMasks[i] = subpasses[i].InputAttachmentMask;
+            }
+
+            // A real subpass only has the attachments it writes, in location order
+            if (!subpasses.empty())
+            {
+                assert(subpassIndex < subpasses.size());
+                uint32_t colorMask = subpasses[subpassIndex].ColorAttachmentMask;
+                for (size_t i = 0; i < attachmentFormats.size(); i++)
+                {
+                    if (colorMask & (1u << i))
+                        subpassBlendStates.push_back(attachmentBlendStates[i]);
+                }
+
+                colorBlendStateCI.attachmentCount = (uint32_t)subpassBlendStates.size();
+                colorBlendStateCI.pAttachments = subpassBlendStates.data();
             }
 
             pci.renderPass = g_renderPassCache->GetPass(rpKey);
+            pci.subpass = subpassIndex;
         }
 
         VkPipeline pipeline;
         VKCHECK(vkCreateGraphicsPipelines(core->GetHandles()->Device, nullptr, 1, &pci, core->GetHandles()->AllocCallbacks, &pipeline));
+        countMetric(Metric::PipelinesCreated);
 
         return new Pipeline(core, pipeline);
     }
@@ -440,16 +706,26 @@ namespace R2::VK
 
     Pipeline* ComputePipelineBuilder::Build()
     {
+        TraceScope traceScope{ "ComputePipelineBuilder::Build" };
         VkPipelineShaderStageCreateInfo sci{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
         sci.pName = "main";
         sci.module = shaderModule->GetNativeHandle();
         sci.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkSpecializationInfo specInfo{};
+        if (!specConstants.IsEmpty())
+        {
+            specConstants.GetNativeInfo(specInfo);
+            sci.pSpecializationInfo = &specInfo;
+        }
+
         VkComputePipelineCreateInfo cpci{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
         cpci.stage = sci;
         cpci.layout = pipelineLayout;
 
         VkPipeline pipeline;
         VKCHECK(vkCreateComputePipelines(core->GetHandles()->Device, nullptr, 1, &cpci, core->GetHandles()->AllocCallbacks, &pipeline));
+        countMetric(Metric::PipelinesCreated);
 
         return new Pipeline(core, pipeline);
     }
@@ -0,0 +1,136 @@
+#include <R2/VKQueryPool.hpp>
+#include <R2/VKCore.hpp>
+#include <R2/VKDeletionQueue.hpp>
+#include <volk.h>
+#include <bit>
+#include <assert.h>
+
+namespace R2::VK
+{
+    QueryPool::QueryPool(Core* core, QueryType type, uint32_t queriesPerFrame, PipelineStatistic statistics)
+        : core(core)
+        , type(type)
+        , statistics(statistics)
+        , queriesPerFrame(queriesPerFrame)
+    {
+        const Handles* handles = core->GetHandles();
+        uint32_t numFrames = core->GetNumFramesInFlight();
+
+        VkQueryPoolCreateInfo qpci{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+        qpci.queryCount = queriesPerFrame * numFrames;
+
+        if (type == QueryType::PipelineStatistics)
+        {
+            assert(core->GetSupportedFeatures().PipelineStatistics && "Pipeline statistics queries aren't supported on this device");
+            assert(statistics != PipelineStatistic::None);
+            qpci.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            // R2's flags match VkQueryPipelineStatisticFlagBits
+            qpci.pipelineStatistics = (VkQueryPipelineStatisticFlags)statistics;
+            valuesPerQuery = std::popcount((uint32_t)statistics) + 1;
+        }
+        else
+        {
+            qpci.queryType = VK_QUERY_TYPE_OCCLUSION;
+            valuesPerQuery = 2;
+        }
+
+        VKCHECK(vkCreateQueryPool(handles->Device, &qpci, handles->AllocCallbacks, &queryPool));
+
+        frameNumbers.resize(numFrames);
+        frameUsed.resize(numFrames);
+        results.resize(queriesPerFrame * valuesPerQuery);
+    }
+
+    QueryPool::~QueryPool()
+    {
+        DQ_QueueObjectDeletion(core->perFrameResources[core->frameIndex].DeletionQueue, queryPool, VK_OBJECT_TYPE_QUERY_POOL);
+    }
+
+    void QueryPool::BeginFrame(CommandBuffer cb)
+    {
+        const Handles* handles = core->GetHandles();
+        uint32_t frameIndex = core->GetFrameIndex();
+        uint32_t firstQuery = frameIndex * queriesPerFrame;
+
+        // The availability value written after each query's results lets
+        // unused queries be skipped instead of failing the whole read
+        if (frameUsed[frameIndex])
+        {
+            VkResult res = vkGetQueryPoolResults(handles->Device, queryPool, firstQuery, queriesPerFrame,
+                results.size() * sizeof(uint64_t), results.data(), valuesPerQuery * sizeof(uint64_t),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+            if (res == VK_SUCCESS || res == VK_NOT_READY)
+                resultsFrameNumber = frameNumbers[frameIndex];
+            else
+                VKCHECK(res);
+        }
+
+        vkCmdResetQueryPool(cb.GetNativeHandle(), queryPool, firstQuery, queriesPerFrame);
+        frameNumbers[frameIndex] = core->GetFrameNumber();
+        frameUsed[frameIndex] = true;
+    }
+
+    void QueryPool::Begin(CommandBuffer cb, uint32_t query, bool precise)
+    {
+        assert(query < queriesPerFrame);
+        assert(!precise || type == QueryType::Occlusion);
+
+        VkQueryControlFlags flags = precise ? VK_QUERY_CONTROL_PRECISE_BIT : 0;
+        vkCmdBeginQuery(cb.GetNativeHandle(), queryPool, core->GetFrameIndex() * queriesPerFrame + query, flags);
+    }
+
+    void QueryPool::End(CommandBuffer cb, uint32_t query)
+    {
+        assert(query < queriesPerFrame);
+        vkCmdEndQuery(cb.GetNativeHandle(), queryPool, core->GetFrameIndex() * queriesPerFrame + query);
+    }
+
+    bool QueryPool::IsResultAvailable(uint32_t query) const
+    {
+        assert(query < queriesPerFrame);
+        return results[query * valuesPerQuery + valuesPerQuery - 1] != 0;
+    }
+
+    uint64_t QueryPool::GetOcclusionResult(uint32_t query) const
+    {
+        assert(type == QueryType::Occlusion);
+        return IsResultAvailable(query) ? results[query * valuesPerQuery] : 0;
+    }
+
+    uint64_t QueryPool::GetStatistic(uint32_t query, PipelineStatistic statistic) const
+    {
+        assert(type == QueryType::PipelineStatistics);
+        assert(((uint32_t)statistics & (uint32_t)statistic) != 0 && std::has_single_bit((uint32_t)statistic));
+
+        if (!IsResultAvailable(query))
+            return 0;
+
+        // Enabled statistics are written in bit order
+        uint32_t lowerBits = (uint32_t)statistics & ((uint32_t)statistic - 1);
+        return results[query * valuesPerQuery + std::popcount(lowerBits)];
+    }
+
+    uint64_t QueryPool::GetResultsFrameNumber() const
+    {
+        return resultsFrameNumber;
+    }
+
+    VkQueryPool QueryPool::GetNativeHandle()
+    {
+        return queryPool;
+    }
+
+    QueryScope::QueryScope(QueryPool* pool, CommandBuffer cb, uint32_t query, bool precise)
+        : pool(pool)
+        , cb(cb)
+        , query(query)
+    {
+        pool->Begin(cb, query, precise);
+    }
+
+    QueryScope::~QueryScope()
+    {
+        pool->End(cb, query);
+    }
+}
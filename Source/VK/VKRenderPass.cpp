@@ -6,6 +6,8 @@
 #include <volk.h>
 #include <malloc.h>
 #include <RenderPassCache.hpp>
+#include <VKExtensionFunctions.hpp>
+#include <RuntimeMetrics.hpp>
 #ifdef __linux__
 #include <alloca.h>
 #endif
@@ -42,8 +44,11 @@ namespace R2::VK
         : numColorAttachments(0)
         , viewMask(0)
         , useFragmentShadingRateAttachment(false)
+        , numSubpasses(0)
+        , currentSubpass(0)
     {
         depthAttachment.Texture = nullptr;
+        depthAttachment.ResolveTexture = nullptr;
     }
 
     RenderPass& RenderPass::RenderArea(uint32_t width, uint32_t height)
@@ -56,6 +61,7 @@ namespace R2::VK
 
     RenderPass& RenderPass::ColorAttachment(Texture* tex, LoadOp loadOp, StoreOp storeOp)
     {
+        assert(numColorAttachments < 4);
         AttachmentInfo ai{};
         ai.Texture = tex;
         ai.LoadOp = loadOp;
@@ -74,6 +80,17 @@ namespace R2::VK
         return *this;
     }
 
+    RenderPass& RenderPass::ResolveAttachment(Texture* tex, ResolveMode mode)
+    {
+        assert(numColorAttachments > 0);
+        assert(mode != ResolveMode::None);
+        AttachmentInfo& ai = colorAttachments[numColorAttachments - 1];
+        ai.ResolveTexture = tex;
+        ai.ResolveMode = mode;
+
+        return *this;
+    }
+
     RenderPass& RenderPass::DepthAttachment(Texture* tex, LoadOp loadOp, StoreOp storeOp)
     {
         AttachmentInfo ai{};
@@ -92,6 +109,16 @@ namespace R2::VK
         return *this;
     }
 
+    RenderPass& RenderPass::DepthResolveAttachment(Texture* tex, ResolveMode mode)
+    {
+        assert(depthAttachment.Texture != nullptr);
+        assert(mode != ResolveMode::None);
+        depthAttachment.ResolveTexture = tex;
+        depthAttachment.ResolveMode = mode;
+
+        return *this;
+    }
+
     RenderPass& RenderPass::FragmentShadingRateAttachment(Texture* tex, uint32_t texelWidth, uint32_t texelHeight)
     {
         useFragmentShadingRateAttachment = true;
@@ -110,16 +137,97 @@ namespace R2::VK
         return *this;
     }
 
+    RenderPass& RenderPass::Subpass(uint32_t colorAttachmentMask, uint32_t inputAttachmentMask)
+    {
+        assert(numSubpasses < MAX_SUBPASSES);
+        subpasses[numSubpasses++] = SubpassInfo{ colorAttachmentMask, inputAttachmentMask };
+
+        return *this;
+    }
+
+    uint32_t RenderPass::getInputAttachmentMask() const
+    {
+        uint32_t mask = 0;
+
+        for (uint32_t i = 0; i < numSubpasses; i++)
+        {
+            mask |= subpasses[i].InputAttachmentMask;
+        }
+
+        return mask;
+    }
+
+    void RenderPass::setLocalReadState(CommandBuffer cb)
+    {
+#ifdef VK_KHR_dynamic_rendering_local_read
+        assert(g_extFuncs.CmdSetRenderingAttachmentLocationsKHR != nullptr &&
+            "Subpasses need VK_KHR_dynamic_rendering_local_read when using dynamic rendering");
+
+        const SubpassInfo& subpass = subpasses[currentSubpass];
+        uint32_t locations[MAX_RENDER_PASS_COLOR_ATTACHMENTS];
+        uint32_t inputIndices[MAX_RENDER_PASS_COLOR_ATTACHMENTS];
+        uint32_t nextLocation = 0;
+        uint32_t nextInputIndex = 0;
+
+        for (uint32_t i = 0; i < numColorAttachments; i++)
+        {
+            uint32_t bit = 1u << i;
+            locations[i] = (subpass.ColorAttachmentMask & bit) ? nextLocation++ : VK_ATTACHMENT_UNUSED;
+            inputIndices[i] = (subpass.InputAttachmentMask & bit) ? nextInputIndex++ : VK_ATTACHMENT_UNUSED;
+        }
+
+        VkRenderingAttachmentLocationInfoKHR locationInfo{ VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_LOCATION_INFO_KHR };
+        locationInfo.colorAttachmentCount = numColorAttachments;
+        locationInfo.pColorAttachmentLocations = locations;
+        g_extFuncs.CmdSetRenderingAttachmentLocationsKHR(cb.GetNativeHandle(), &locationInfo);
+
+        VkRenderingInputAttachmentIndexInfoKHR inputIndexInfo{ VK_STRUCTURE_TYPE_RENDERING_INPUT_ATTACHMENT_INDEX_INFO_KHR };
+        inputIndexInfo.colorAttachmentCount = numColorAttachments;
+        inputIndexInfo.pColorAttachmentInputIndices = inputIndices;
+        g_extFuncs.CmdSetRenderingInputAttachmentIndicesKHR(cb.GetNativeHandle(), &inputIndexInfo);
+#else
+        assert(false && "R2 was built against Vulkan headers without VK_KHR_dynamic_rendering_local_read");
+#endif
+    }
+
     void RenderPass::Begin(CommandBuffer cb)
     {
+        uint32_t inputAttachmentMask = getInputAttachmentMask();
+        currentSubpass = 0;
+
         for (int i = 0; i < numColorAttachments; i++)
         {
+            if (inputAttachmentMask & (1u << i))
+            {
+                assert((colorAttachments[i].Texture->GetUsageFlags() & VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT) &&
+                    "Attachments read by a subpass need TextureCreateInfo::CanUseAsInputAttachment");
+
+                // Local reads need their own layout; real subpasses transition by themselves
+                ImageLayout layout = g_renderPassCache == nullptr ? ImageLayout::RenderingLocalRead : ImageLayout::AttachmentOptimal;
+                colorAttachments[i].Texture->Acquire(cb, layout,
+                    AccessFlags::ColorAttachmentReadWrite | AccessFlags::InputAttachmentRead,
+                    PipelineStageFlags::ColorAttachmentOutput | PipelineStageFlags::FragmentShader);
+                continue;
+            }
+
             colorAttachments[i].Texture->Acquire(cb, ImageLayout::AttachmentOptimal, AccessFlags::ColorAttachmentReadWrite, PipelineStageFlags::ColorAttachmentOutput);
         }
 
         if (depthAttachment.Texture)
             depthAttachment.Texture->Acquire(cb, ImageLayout::AttachmentOptimal, AccessFlags::DepthStencilAttachmentReadWrite, PipelineStageFlags::LateFragmentTests);
 
+        // Resolves count as color attachment writes, even for depth
+        for (int i = 0; i < numColorAttachments; i++)
+        {
+            if (colorAttachments[i].ResolveTexture)
+                colorAttachments[i].ResolveTexture->Acquire(cb, ImageLayout::AttachmentOptimal, AccessFlags::ColorAttachmentWrite, PipelineStageFlags::ColorAttachmentOutput);
+        }
+
+        if (depthAttachment.Texture && depthAttachment.ResolveTexture)
+            depthAttachment.ResolveTexture->Acquire(cb, ImageLayout::AttachmentOptimal,
+                AccessFlags::ColorAttachmentWrite | AccessFlags::DepthStencilAttachmentWrite,
+                PipelineStageFlags::ColorAttachmentOutput | PipelineStageFlags::LateFragmentTests);
+
         if (g_renderPassCache == nullptr)
         {
             VkRenderingInfo renderInfo{ VK_STRUCTURE_TYPE_RENDERING_INFO };
@@ -136,6 +244,14 @@ namespace R2::VK
                 depthAttachmentInfo.storeOp = convertStoreOp(depthAttachment.StoreOp);
                 depthAttachmentInfo.loadOp = convertLoadOp(depthAttachment.LoadOp);
                 depthAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
+
+                if (depthAttachment.ResolveTexture)
+                {
+                    depthAttachmentInfo.resolveMode = (VkResolveModeFlagBits)depthAttachment.ResolveMode;
+                    depthAttachmentInfo.resolveImageView = depthAttachment.ResolveTexture->GetView();
+                    depthAttachmentInfo.resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
+                }
+
                 renderInfo.pDepthAttachment = &depthAttachmentInfo;
             }
 
@@ -155,7 +271,16 @@ namespace R2::VK
                 colorAttachmentInfo.imageView = colorAttachment.Texture->GetView();
                 colorAttachmentInfo.storeOp = convertStoreOp(colorAttachment.StoreOp);
                 colorAttachmentInfo.loadOp = convertLoadOp(colorAttachment.LoadOp);
-                colorAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
+                colorAttachmentInfo.imageLayout = (inputAttachmentMask & (1u << i))
+                    ? (VkImageLayout)ImageLayout::RenderingLocalRead
+                    : VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
+
+                if (colorAttachment.ResolveTexture)
+                {
+                    colorAttachmentInfo.resolveMode = (VkResolveModeFlagBits)colorAttachment.ResolveMode;
+                    colorAttachmentInfo.resolveImageView = colorAttachment.ResolveTexture->GetView();
+                    colorAttachmentInfo.resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
+                }
             }
 
             renderInfo.pColorAttachments = colorAttachmentInfos;
@@ -175,18 +300,23 @@ namespace R2::VK
             }
 
             vkCmdBeginRendering(cb.GetNativeHandle(), &renderInfo);
+
+            if (numSubpasses > 0)
+                setLocalReadState(cb);
         }
         else
         {
-            // For now we only support a max of 1 color attachment
-            assert(numColorAttachments <= 1);
+            assert(numColorAttachments <= MAX_RENDER_PASS_COLOR_ATTACHMENTS);
 
-            const AttachmentInfo& colorAttachment = colorAttachments[0];
+            RenderPassKey key{};
+            key.viewMask = viewMask;
+            key.numSubpasses = numSubpasses;
 
-            RenderPassKey key
+            for (uint32_t i = 0; i < numSubpasses; i++)
             {
-                .viewMask = viewMask
-            };
+                key.subpassColorMasks[i] = subpasses[i].ColorAttachmentMask;
+                key.subpassInputMasks[i] = subpasses[i].InputAttachmentMask;
+            }
 
             if (depthAttachment.Texture)
             {
@@ -198,68 +328,78 @@ namespace R2::VK
                     .samples = (VkSampleCountFlagBits)depthAttachment.Texture->GetSamples()
                 };
                 key.useDepth = true;
+
+                if (depthAttachment.ResolveTexture)
+                    key.depthResolveMode = (VkResolveModeFlagBits)depthAttachment.ResolveMode;
             }
 
-            if (numColorAttachments > 0)
+            key.numColorAttachments = numColorAttachments;
+            for (uint32_t i = 0; i < numColorAttachments; i++)
             {
-                key.colorAttachment = RenderPassAttachment
+                const AttachmentInfo& colorAttachment = colorAttachments[i];
+                key.colorAttachments[i] = RenderPassAttachment
                 {
                     .format = (VkFormat)colorAttachment.Texture->GetFormat(),
                     .loadOp = convertLoadOp(colorAttachment.LoadOp),
                     .storeOp = convertStoreOp(colorAttachment.StoreOp),
                     .samples = (VkSampleCountFlagBits)colorAttachment.Texture->GetSamples()
                 };
-                key.useColor = true;
+
+                if (colorAttachment.ResolveTexture)
+                {
+                    // Render pass subpasses can only average color attachments
+                    assert(colorAttachment.ResolveMode == ResolveMode::Average);
+                    key.colorResolveMask |= 1u << i;
+                }
             }
 
             VkRenderPass renderPass = g_renderPassCache->GetPass(key);
-            FramebufferKey framebufferKey
+            FramebufferKey framebufferKey{};
+            framebufferKey.renderPass = renderPass;
+            // The framebuffer matches the attachments rather than the render
+            // area, so rendering to part of a target doesn't need a new one
+            Texture* sizeSource = depthAttachment.Texture ? depthAttachment.Texture : colorAttachments[0].Texture;
+            framebufferKey.width = (uint32_t)sizeSource->GetWidth();
+            framebufferKey.height = (uint32_t)sizeSource->GetHeight();
+            framebufferKey.layerCount = 1;
+
+            VkImageView attachmentViews[MAX_FRAMEBUFFER_ATTACHMENTS];
+            VkClearValue clearVals[MAX_FRAMEBUFFER_ATTACHMENTS];
+
+            auto addAttachment = [&](Texture* tex)
             {
-                .width = width,
-                .height = height,
-                .renderPass = renderPass,
-                .numTextures = 0,
-                .layerCount = 1
+                uint32_t idx = framebufferKey.numTextures++;
+                framebufferKey.textureFormats[idx] = (VkFormat)tex->GetFormat();
+                framebufferKey.textureUsages[idx] = tex->GetUsageFlags();
+                framebufferKey.textureFlags[idx] = tex->GetImageFlags();
+                framebufferKey.layerCount = tex->GetLayerCount();
+                attachmentViews[idx] = tex->GetView();
+                return idx;
             };
-            VkImageView attachmentViews[2];
-            VkClearValue clearVals[2];
 
             if (depthAttachment.Texture)
             {
-                framebufferKey.textureFormats[framebufferKey.numTextures] =
-                    (VkFormat)depthAttachment.Texture->GetFormat();
-
-                framebufferKey.textureUsages[framebufferKey.numTextures] =
-                    depthAttachment.Texture->GetUsageFlags();
-
-                framebufferKey.textureFlags[framebufferKey.numTextures] =
-                    depthAttachment.Texture->GetImageFlags();
-
-                attachmentViews[framebufferKey.numTextures] = depthAttachment.Texture->GetView();
-                framebufferKey.layerCount = depthAttachment.Texture->GetLayerCount();
-                clearVals[framebufferKey.numTextures].depthStencil.depth = depthAttachment.ClearValue.DepthStencil.Depth;
-                framebufferKey.numTextures++;
+                uint32_t idx = addAttachment(depthAttachment.Texture);
+                clearVals[idx].depthStencil.depth = depthAttachment.ClearValue.DepthStencil.Depth;
             }
 
-            if (numColorAttachments > 0)
+            for (uint32_t i = 0; i < numColorAttachments; i++)
             {
-                framebufferKey.textureFormats[framebufferKey.numTextures] =
-                    (VkFormat)colorAttachment.Texture->GetFormat();
-
-                framebufferKey.textureUsages[framebufferKey.numTextures] =
-                    colorAttachment.Texture->GetUsageFlags();
-
-                framebufferKey.textureFlags[framebufferKey.numTextures] =
-                    colorAttachment.Texture->GetImageFlags();
-
-                attachmentViews[framebufferKey.numTextures] = colorAttachment.Texture->GetView();
-                framebufferKey.layerCount = colorAttachment.Texture->GetLayerCount();
+                uint32_t idx = addAttachment(colorAttachments[i].Texture);
                 for (int j = 0; j < 4; j++)
-                    clearVals[framebufferKey.numTextures].color.uint32[j] = colorAttachment.ClearValue.Color.Uint32[j];
+                    clearVals[idx].color.uint32[j] = colorAttachments[i].ClearValue.Color.Uint32[j];
+            }
 
-                framebufferKey.numTextures++;
+            // Resolve attachments follow in the same order as in RenderPassCache::GetPass
+            for (uint32_t i = 0; i < numColorAttachments; i++)
+            {
+                if (colorAttachments[i].ResolveTexture)
+                    addAttachment(colorAttachments[i].ResolveTexture);
             }
 
+            if (depthAttachment.Texture && depthAttachment.ResolveTexture)
+                addAttachment(depthAttachment.ResolveTexture);
+
             VkFramebuffer framebuffer = g_renderPassCache->GetFramebuffer(framebufferKey);
 
             VkRenderPassAttachmentBeginInfo attachBeginInfo
@@ -284,6 +424,36 @@ namespace R2::VK
         }
     }
 
+    void RenderPass::NextSubpass(CommandBuffer cb)
+    {
+        assert(currentSubpass + 1 < numSubpasses);
+        currentSubpass++;
+
+        if (g_renderPassCache != nullptr)
+        {
+            vkCmdNextSubpass(cb.GetNativeHandle(), VK_SUBPASS_CONTENTS_INLINE);
+            return;
+        }
+
+        // Same dependency as the one between real subpasses in RenderPassCache.
+        // Barriers inside dynamic rendering have to be by region.
+        const VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        const VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        const VkAccessFlags srcAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        const VkAccessFlags dstAccess = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+        memoryBarrier.srcAccessMask = srcAccess;
+        memoryBarrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(cb.GetNativeHandle(), srcStages, dstStages, VK_DEPENDENCY_BY_REGION_BIT, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        countBarriers(1);
+
+        setLocalReadState(cb);
+    }
+
     void RenderPass::End(CommandBuffer cb)
     {
         if (g_renderPassCache == nullptr)
@@ -0,0 +1,148 @@
+#include <R2/VKRenderTargetPool.hpp>
+#include <R2/VKCore.hpp>
+#include <assert.h>
+
+namespace R2::VK
+{
+    RenderTargetPool::Key::Key(const TextureCreateInfo& createInfo)
+        : Width(createInfo.Width)
+        , Height(createInfo.Height)
+        , Depth(createInfo.Depth)
+        , Layers(createInfo.Layers)
+        , NumMips(createInfo.NumMips)
+        , Format(createInfo.Format)
+        , Dimension(createInfo.Dimension)
+        , Samples(createInfo.Samples)
+        , Pool(createInfo.Pool)
+    {
+        UsageBits =
+            (createInfo.IsRenderTarget ? 1u : 0u) |
+            (createInfo.CanUseAsStorage ? 2u : 0u) |
+            (createInfo.IsTransient ? 4u : 0u) |
+            (createInfo.CanSample ? 8u : 0u) |
+            (createInfo.CanTransfer ? 16u : 0u) |
+            (createInfo.CanUseAsShadingRateAttachment ? 32u : 0u);
+    }
+
+    bool RenderTargetPool::Key::operator==(const Key& other) const
+    {
+        return Width == other.Width && Height == other.Height && Depth == other.Depth &&
+            Layers == other.Layers && NumMips == other.NumMips && Format == other.Format &&
+            Dimension == other.Dimension && Samples == other.Samples &&
+            UsageBits == other.UsageBits && Pool == other.Pool;
+    }
+
+    size_t RenderTargetPool::KeyHash::operator()(const Key& key) const
+    {
+        size_t hash = std::hash<uint64_t>{}(((uint64_t)(uint32_t)key.Width << 32) | (uint32_t)key.Height);
+        auto combine = [&](size_t v)
+        {
+            hash ^= v + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        };
+
+        combine((size_t)key.Format);
+        combine(((size_t)key.Depth << 16) ^ (size_t)key.Layers);
+        combine(((size_t)key.NumMips << 8) ^ (size_t)key.Dimension);
+        combine(((size_t)key.Samples << 8) ^ key.UsageBits);
+        combine(std::hash<MemoryPool*>{}(key.Pool));
+
+        return hash;
+    }
+
+    RenderTargetPool::RenderTargetPool(Core* core, uint32_t maxUnusedFrames)
+        : core(core)
+        , maxUnusedFrames(maxUnusedFrames)
+    {
+    }
+
+    RenderTargetPool::~RenderTargetPool()
+    {
+        // Textures still acquired belong to the caller until released, but
+        // the pool owns them so they go too
+        for (auto& pair : acquiredTextures)
+        {
+            core->DestroyTexture(pair.first);
+        }
+
+        for (auto& pair : freeTextures)
+        {
+            for (FreeTexture& ft : pair.second)
+            {
+                core->DestroyTexture(ft.Texture);
+            }
+        }
+    }
+
+    Texture* RenderTargetPool::Acquire(const TextureCreateInfo& createInfo)
+    {
+        assert(!createInfo.DeferMemoryBinding && "Textures without memory can't be pooled");
+        Key key{ createInfo };
+
+        Texture* tex;
+        auto it = freeTextures.find(key);
+        if (it != freeTextures.end() && !it->second.empty())
+        {
+            tex = it->second.back().Texture;
+            it->second.pop_back();
+            numFree--;
+        }
+        else
+        {
+            tex = core->CreateTexture(createInfo);
+        }
+
+        acquiredTextures.insert({ tex, key });
+        return tex;
+    }
+
+    void RenderTargetPool::Release(Texture* tex)
+    {
+        auto it = acquiredTextures.find(tex);
+        assert(it != acquiredTextures.end() && "Texture wasn't acquired from this pool");
+
+        freeTextures[it->second].push_back(FreeTexture{ tex, core->GetFrameNumber() });
+        acquiredTextures.erase(it);
+        numFree++;
+    }
+
+    void RenderTargetPool::Evict()
+    {
+        uint64_t frameNumber = core->GetFrameNumber();
+
+        for (auto it = freeTextures.begin(); it != freeTextures.end();)
+        {
+            std::vector<FreeTexture>& list = it->second;
+
+            for (size_t i = 0; i < list.size();)
+            {
+                if (frameNumber - list[i].LastUsedFrame > maxUnusedFrames)
+                {
+                    // Deletion is deferred until the GPU is done with the texture
+                    core->DestroyTexture(list[i].Texture);
+                    list[i] = list.back();
+                    list.pop_back();
+                    numFree--;
+                }
+                else
+                {
+                    i++;
+                }
+            }
+
+            if (list.empty())
+                it = freeTextures.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    uint32_t RenderTargetPool::GetNumFreeTextures()
+    {
+        return numFree;
+    }
+
+    uint32_t RenderTargetPool::GetNumAcquiredTextures()
+    {
+        return (uint32_t)acquiredTextures.size();
+    }
+}
@@ -1,11 +1,15 @@
 #include <R2/VKSampler.hpp>
 #include <string.h>
+#include <stddef.h>
 #include <volk.h>
 #include <R2/VKCore.hpp>
 #include <R2/VKDeletionQueue.hpp>
+#include <SamplerCache.hpp>
 
 namespace R2::VK
 {
+    RefCountedCache<VkSampler>* g_samplerCache;
+
     Sampler::Sampler(Core* core, VkSampler sampler)
         : sampler(sampler)
         , core(core)
@@ -16,16 +20,30 @@ namespace R2::VK
         return sampler;
     }
 
+    Sampler* Sampler::Share()
+    {
+        g_samplerCache->AddRef(sampler);
+        return new Sampler(core, sampler);
+    }
+
     Sampler::~Sampler()
     {
-        DeletionQueue* dq = core->perFrameResources[core->frameIndex].DeletionQueue;
-        DQ_QueueObjectDeletion(dq, sampler, VK_OBJECT_TYPE_SAMPLER);
+        if (g_samplerCache->Release(sampler))
+        {
+            DeletionQueue* dq = core->perFrameResources[core->frameIndex].DeletionQueue;
+            DQ_QueueObjectDeletion(dq, sampler, VK_OBJECT_TYPE_SAMPLER);
+        }
     }
 
     SamplerBuilder::SamplerBuilder(Core* core)
         : core(core)
         , ci{}
-    {}
+    {
+        ci.anisotropyEnable = true;
+        ci.maxAnisotropy = 8.0f;
+        ci.minLod = 0.0f;
+        ci.maxLod = VK_LOD_CLAMP_NONE;
+    }
 
     SamplerBuilder& SamplerBuilder::MagFilter(Filter filt)
     {
@@ -57,6 +75,15 @@ namespace R2::VK
         return *this;
     }
 
+    SamplerBuilder& SamplerBuilder::AddressMode(SamplerAddressMode u, SamplerAddressMode v, SamplerAddressMode w)
+    {
+        ci.addressModeU = u;
+        ci.addressModeV = v;
+        ci.addressModeW = w;
+
+        return *this;
+    }
+
     SamplerBuilder& SamplerBuilder::EnableCompare(bool enableCompare)
     {
         ci.compareEnable = enableCompare;
@@ -69,18 +96,49 @@ namespace R2::VK
         return *this;
     }
 
+    SamplerBuilder& SamplerBuilder::Anisotropy(bool enable, float maxAnisotropy)
+    {
+        ci.anisotropyEnable = enable;
+        ci.maxAnisotropy = enable ? maxAnisotropy : 1.0f;
+        return *this;
+    }
+
+    SamplerBuilder& SamplerBuilder::MipLodBias(float bias)
+    {
+        ci.mipLodBias = bias;
+        return *this;
+    }
+
+    SamplerBuilder& SamplerBuilder::LodRange(float minLod, float maxLod)
+    {
+        ci.minLod = minLod;
+        ci.maxLod = maxLod;
+        return *this;
+    }
+
+    SamplerBuilder& SamplerBuilder::BorderColor(VK::BorderColor color)
+    {
+        ci.borderColor = color;
+        return *this;
+    }
+
     Sampler* SamplerBuilder::Build()
     {
-        VkSamplerCreateInfo sci{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
-        memcpy(&sci.magFilter, &ci, sizeof(SamplerCreateInfo));
+        static_assert(sizeof(SamplerCreateInfo) == sizeof(VkSamplerCreateInfo) - offsetof(VkSamplerCreateInfo, magFilter));
+
+        // Every member is 4 bytes wide so there's no padding to worry about
+        std::string key;
+        key.append(reinterpret_cast<const char*>(&ci), sizeof(SamplerCreateInfo));
 
-        sci.minLod = 0.0f;
-        sci.maxLod = VK_LOD_CLAMP_NONE;
-        sci.anisotropyEnable = true;
-        sci.maxAnisotropy = 8.0f;
+        VkSampler vsamp = g_samplerCache->Acquire(key, [&]()
+        {
+            VkSamplerCreateInfo sci{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+            memcpy(&sci.magFilter, &ci, sizeof(SamplerCreateInfo));
 
-        VkSampler vsamp;
-        VKCHECK(vkCreateSampler(core->GetHandles()->Device, &sci, core->GetHandles()->AllocCallbacks, &vsamp));
+            VkSampler s;
+            VKCHECK(vkCreateSampler(core->GetHandles()->Device, &sci, core->GetHandles()->AllocCallbacks, &s));
+            return s;
+        });
 
         return new Sampler(core, vsamp);
     }
@@ -0,0 +1,107 @@
+#include <R2/VKShaderObject.hpp>
+#include <R2/VKCore.hpp>
+#include <R2/VKDeletionQueue.hpp>
+#include <R2/VKDescriptorSet.hpp>
+#include <R2/VKTraceRecorder.hpp>
+#include <volk.h>
+#include <VKExtensionFunctions.hpp>
+#include <RuntimeMetrics.hpp>
+#include <assert.h>
+
+namespace R2::VK
+{
+    ShaderObject::ShaderObject(Core* core, VkShaderEXT shader, ShaderStage stage)
+        : core(core)
+        , shader(shader)
+        , stage(stage)
+    {}
+
+    ShaderObject::~ShaderObject()
+    {
+#ifdef VK_EXT_shader_object
+        DeletionQueue* dq = core->perFrameResources[core->frameIndex].DeletionQueue;
+        DQ_QueueObjectDeletion(dq, shader, VK_OBJECT_TYPE_SHADER_EXT);
+#endif
+    }
+
+    VkShaderEXT ShaderObject::GetNativeHandle()
+    {
+        return shader;
+    }
+
+    ShaderStage ShaderObject::GetStage()
+    {
+        return stage;
+    }
+
+    ShaderObjectBuilder::ShaderObjectBuilder(Core* core)
+        : core(core)
+        , stage(ShaderStage::Vertex)
+    {}
+
+    ShaderObjectBuilder& ShaderObjectBuilder::Code(ShaderStage stage, const uint32_t* data, size_t dataLength)
+    {
+        this->stage = stage;
+        code = data;
+        codeLength = dataLength;
+        return *this;
+    }
+
+    ShaderObjectBuilder& ShaderObjectBuilder::NextStage(ShaderStage stage)
+    {
+        nextStage |= (uint32_t)stage;
+        return *this;
+    }
+
+    ShaderObjectBuilder& ShaderObjectBuilder::PushConstants(ShaderStage stages, uint32_t offset, uint32_t size)
+    {
+        pushConstants.push_back(PushConstantRange{ stages, offset, size });
+        return *this;
+    }
+
+    ShaderObjectBuilder& ShaderObjectBuilder::DescriptorSet(DescriptorSetLayout* dsl)
+    {
+        descriptorSetLayouts.push_back(dsl->GetNativeHandle());
+        return *this;
+    }
+
+    ShaderObject* ShaderObjectBuilder::Build()
+    {
+        TraceScope traceScope{ "ShaderObjectBuilder::Build" };
+#ifdef VK_EXT_shader_object
+        assert(core->GetSupportedFeatures().ShaderObject && "Shader objects aren't supported on this device!");
+        assert(code != nullptr);
+
+        static_assert(sizeof(VkPushConstantRange) == sizeof(PushConstantRange));
+        VkShaderCreateInfoEXT sci{ VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT };
+        sci.stage = (VkShaderStageFlagBits)stage;
+        sci.nextStage = (VkShaderStageFlags)nextStage;
+        sci.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+        sci.codeSize = codeLength;
+        sci.pCode = code;
+        sci.pName = "main";
+
+        VkSpecializationInfo specInfo{};
+        if (!specConstants.IsEmpty())
+        {
+            specConstants.GetNativeInfo(specInfo);
+            sci.pSpecializationInfo = &specInfo;
+        }
+
+        sci.setLayoutCount = (uint32_t)descriptorSetLayouts.size();
+        sci.pSetLayouts = descriptorSetLayouts.data();
+        sci.pushConstantRangeCount = (uint32_t)pushConstants.size();
+        sci.pPushConstantRanges = reinterpret_cast<VkPushConstantRange*>(pushConstants.data());
+
+        const Handles* handles = core->GetHandles();
+        VkShaderEXT shader;
+        VKCHECK(g_extFuncs.CreateShadersEXT(handles->Device, 1, &sci, handles->AllocCallbacks, &shader));
+        countMetric(Metric::ShaderObjectsCreated);
+
+        return new ShaderObject(core, shader, stage);
+#else
+        assert(false && "R2 was built against Vulkan headers without VK_EXT_shader_object");
+        return nullptr;
+#endif
+    }
+}
@@ -0,0 +1,515 @@
+#include <R2/VKPipeline.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace R2::VK
+{
+    // Only the parts of the SPIR-V spec needed to find a module's resource interface
+    namespace Spv
+    {
+        const uint32_t MagicNumber = 0x07230203;
+
+        enum Op : uint32_t
+        {
+            OpEntryPoint = 15,
+            OpExecutionMode = 16,
+            OpTypeBool = 20,
+            OpTypeInt = 21,
+            OpTypeFloat = 22,
+            OpTypeVector = 23,
+            OpTypeMatrix = 24,
+            OpTypeImage = 25,
+            OpTypeSampler = 26,
+            OpTypeSampledImage = 27,
+            OpTypeArray = 28,
+            OpTypeRuntimeArray = 29,
+            OpTypeStruct = 30,
+            OpTypePointer = 32,
+            OpConstant = 43,
+            OpConstantComposite = 44,
+            OpSpecConstant = 50,
+            OpSpecConstantComposite = 51,
+            OpFunction = 54,
+            OpVariable = 59,
+            OpDecorate = 71,
+            OpMemberDecorate = 72,
+            OpExecutionModeId = 331,
+            OpTypeAccelerationStructureKHR = 5341
+        };
+
+        enum Decoration : uint32_t
+        {
+            Block = 2,
+            BufferBlock = 3,
+            ArrayStride = 6,
+            MatrixStride = 7,
+            BuiltIn = 11,
+            Binding = 33,
+            DescriptorSet = 34,
+            Offset = 35
+        };
+
+        enum StorageClass : uint32_t
+        {
+            UniformConstant = 0,
+            Uniform = 2,
+            PushConstant = 9,
+            StorageBuffer = 12,
+            PhysicalStorageBuffer = 5349
+        };
+
+        enum ExecutionModel : uint32_t
+        {
+            Vertex = 0,
+            TessellationControl = 1,
+            TessellationEvaluation = 2,
+            Geometry = 3,
+            Fragment = 4,
+            GLCompute = 5
+        };
+
+        const uint32_t ExecutionModeLocalSize = 17;
+        const uint32_t ExecutionModeLocalSizeId = 38;
+        const uint32_t BuiltInWorkgroupSize = 25;
+        const uint32_t DimBuffer = 5;
+        const uint32_t DimSubpassData = 6;
+    }
+
+    struct SpirvId
+    {
+        uint32_t Opcode = 0;
+        // Result type for constants and variables, component/element/pointee type for types
+        uint32_t TypeId = 0;
+        // Bit width for scalars, component count for vectors and matrices, length ID for
+        // arrays, dimensionality for images and the low word for constants
+        uint32_t Value = 0;
+        uint32_t StorageClass = 0;
+        uint32_t ImageSampled = 0;
+        uint32_t Set = ~0u;
+        uint32_t Binding = ~0u;
+        uint32_t ArrayStride = 0;
+        bool BufferBlock = false;
+        bool WorkgroupSizeBuiltIn = false;
+        std::vector<uint32_t> Members;
+        std::vector<uint32_t> MemberOffsets;
+        std::vector<uint32_t> MemberMatrixStrides;
+    };
+
+    class SpirvParser
+    {
+    public:
+        SpirvParser(const uint32_t* code, size_t wordCount)
+            : code(code)
+            , wordCount(wordCount)
+        {}
+
+        bool Parse(ShaderReflection& reflection);
+    private:
+        void parseInstruction(uint32_t opcode, const uint32_t* ops, uint32_t numOps);
+        void setMemberDecoration(std::vector<uint32_t>& values, uint32_t member, uint32_t value);
+        uint32_t getConstant(uint32_t id, uint32_t defaultValue);
+        uint32_t getTypeSize(uint32_t id, uint32_t matrixStride, int depth);
+        bool getDescriptorType(const SpirvId& var, const SpirvId& type, DescriptorType& out);
+
+        const uint32_t* code;
+        size_t wordCount;
+        std::vector<SpirvId> ids;
+        uint32_t executionModel = ~0u;
+        uint32_t localSize[3] = { 1, 1, 1 };
+        uint32_t localSizeIds[3] = { 0, 0, 0 };
+    };
+
+    bool SpirvParser::Parse(ShaderReflection& reflection)
+    {
+        if (wordCount < 5 || code[0] != Spv::MagicNumber)
+            return false;
+
+        ids.resize(code[3]);
+
+        size_t offset = 5;
+        while (offset < wordCount)
+        {
+            uint32_t instructionWords = code[offset] >> 16;
+            uint32_t opcode = code[offset] & 0xFFFF;
+
+            if (instructionWords == 0 || offset + instructionWords > wordCount)
+                return false;
+
+            // Everything we care about is declared before the first function
+            if (opcode == Spv::OpFunction)
+                break;
+
+            parseInstruction(opcode, code + offset + 1, instructionWords - 1);
+            offset += instructionWords;
+        }
+
+        switch (executionModel)
+        {
+        case Spv::Vertex:
+            reflection.Stage = ShaderStage::Vertex;
+            break;
+        case Spv::TessellationControl:
+            reflection.Stage = ShaderStage::TessellationControl;
+            break;
+        case Spv::TessellationEvaluation:
+            reflection.Stage = ShaderStage::TessellationEvaluation;
+            break;
+        case Spv::Geometry:
+            reflection.Stage = ShaderStage::Geometry;
+            break;
+        case Spv::Fragment:
+            reflection.Stage = ShaderStage::Fragment;
+            break;
+        case Spv::GLCompute:
+            reflection.Stage = ShaderStage::Compute;
+            break;
+        default:
+            return false;
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            reflection.WorkgroupSize[i] = localSizeIds[i] ? getConstant(localSizeIds[i], 1) : localSize[i];
+        }
+
+        uint32_t pushConstantStart = ~0u;
+        uint32_t pushConstantEnd = 0;
+
+        for (const SpirvId& id : ids)
+        {
+            // The WorkgroupSize built-in takes precedence over the execution mode
+            if (id.WorkgroupSizeBuiltIn && id.Members.size() == 3)
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    reflection.WorkgroupSize[i] = getConstant(id.Members[i], 1);
+                }
+            }
+
+            if (id.Opcode != Spv::OpVariable || id.TypeId >= ids.size())
+                continue;
+
+            const SpirvId& pointerType = ids[id.TypeId];
+            if (pointerType.TypeId >= ids.size())
+                continue;
+
+            uint32_t typeId = pointerType.TypeId;
+
+            if (id.StorageClass == Spv::PushConstant)
+            {
+                const SpirvId& block = ids[typeId];
+                for (size_t m = 0; m < block.Members.size() && m < block.MemberOffsets.size(); m++)
+                {
+                    uint32_t matrixStride = m < block.MemberMatrixStrides.size() ? block.MemberMatrixStrides[m] : 0;
+                    uint32_t memberEnd = block.MemberOffsets[m] + getTypeSize(block.Members[m], matrixStride, 0);
+                    pushConstantStart = std::min(pushConstantStart, block.MemberOffsets[m]);
+                    pushConstantEnd = std::max(pushConstantEnd, memberEnd);
+                }
+                continue;
+            }
+
+            if (id.StorageClass != Spv::UniformConstant && id.StorageClass != Spv::Uniform &&
+                id.StorageClass != Spv::StorageBuffer)
+                continue;
+
+            if (id.Set == ~0u || id.Binding == ~0u)
+                continue;
+
+            ShaderBinding binding{};
+            binding.Set = id.Set;
+            binding.Binding = id.Binding;
+            binding.Count = 1;
+
+            const SpirvId* type = &ids[typeId];
+            if (type->Opcode == Spv::OpTypeArray || type->Opcode == Spv::OpTypeRuntimeArray)
+            {
+                // Malformed module, the element type is out of range
+                if (type->TypeId >= ids.size())
+                    return false;
+
+                binding.Count = type->Opcode == Spv::OpTypeArray ? getConstant(type->Value, 1) : 0;
+                type = &ids[type->TypeId];
+            }
+
+            if (getDescriptorType(id, *type, binding.Type))
+            {
+                reflection.Bindings.push_back(binding);
+            }
+        }
+
+        if (pushConstantStart != ~0u)
+        {
+            reflection.PushConstantOffset = pushConstantStart;
+            // Push constant ranges have to be a multiple of 4 bytes
+            reflection.PushConstantSize = ((pushConstantEnd - pushConstantStart) + 3) & ~3u;
+        }
+
+        std::sort(reflection.Bindings.begin(), reflection.Bindings.end(),
+            [](const ShaderBinding& a, const ShaderBinding& b)
+            {
+                return a.Set != b.Set ? a.Set < b.Set : a.Binding < b.Binding;
+            });
+
+        reflection.Valid = true;
+        return true;
+    }
+
+    void SpirvParser::setMemberDecoration(std::vector<uint32_t>& values, uint32_t member, uint32_t value)
+    {
+        if (values.size() <= member)
+            values.resize(member + 1);
+        values[member] = value;
+    }
+
+    void SpirvParser::parseInstruction(uint32_t opcode, const uint32_t* ops, uint32_t numOps)
+    {
+        // Every instruction below has its result ID as the first operand, except
+        // for the ones that produce a result type first.
+        auto getId = [&](uint32_t index) -> SpirvId*
+        {
+            if (index >= numOps || ops[index] >= ids.size())
+                return nullptr;
+            return &ids[ops[index]];
+        };
+
+        switch (opcode)
+        {
+        case Spv::OpEntryPoint:
+            // Only the first entry point is reflected
+            if (numOps >= 1 && executionModel == ~0u)
+                executionModel = ops[0];
+            break;
+        case Spv::OpExecutionMode:
+        case Spv::OpExecutionModeId:
+            if (numOps >= 5 && ops[1] == Spv::ExecutionModeLocalSize)
+            {
+                localSize[0] = ops[2];
+                localSize[1] = ops[3];
+                localSize[2] = ops[4];
+            }
+            else if (numOps >= 5 && ops[1] == Spv::ExecutionModeLocalSizeId)
+            {
+                localSizeIds[0] = ops[2];
+                localSizeIds[1] = ops[3];
+                localSizeIds[2] = ops[4];
+            }
+            break;
+        case Spv::OpTypeBool:
+        case Spv::OpTypeSampler:
+        case Spv::OpTypeAccelerationStructureKHR:
+            if (SpirvId* id = getId(0))
+            {
+                id->Opcode = opcode;
+                id->Value = 32;
+            }
+            break;
+        case Spv::OpTypeInt:
+        case Spv::OpTypeFloat:
+            if (SpirvId* id = getId(0); id && numOps >= 2)
+            {
+                id->Opcode = opcode;
+                id->Value = ops[1];
+            }
+            break;
+        case Spv::OpTypeVector:
+        case Spv::OpTypeMatrix:
+        case Spv::OpTypeArray:
+            if (SpirvId* id = getId(0); id && numOps >= 3)
+            {
+                id->Opcode = opcode;
+                id->TypeId = ops[1];
+                id->Value = ops[2];
+            }
+            break;
+        case Spv::OpTypeRuntimeArray:
+        case Spv::OpTypeSampledImage:
+            if (SpirvId* id = getId(0); id && numOps >= 2)
+            {
+                id->Opcode = opcode;
+                id->TypeId = ops[1];
+            }
+            break;
+        case Spv::OpTypeImage:
+            if (SpirvId* id = getId(0); id && numOps >= 7)
+            {
+                id->Opcode = opcode;
+                id->TypeId = ops[1];
+                id->Value = ops[2];
+                id->ImageSampled = ops[6];
+            }
+            break;
+        case Spv::OpTypeStruct:
+            if (SpirvId* id = getId(0))
+            {
+                id->Opcode = opcode;
+                id->Members.assign(ops + 1, ops + numOps);
+            }
+            break;
+        case Spv::OpTypePointer:
+            if (SpirvId* id = getId(0); id && numOps >= 3)
+            {
+                id->Opcode = opcode;
+                id->StorageClass = ops[1];
+                id->TypeId = ops[2];
+            }
+            break;
+        case Spv::OpConstant:
+        case Spv::OpSpecConstant:
+            if (SpirvId* id = getId(1); id && numOps >= 3)
+            {
+                id->Opcode = opcode;
+                id->TypeId = ops[0];
+                id->Value = ops[2];
+            }
+            break;
+        case Spv::OpConstantComposite:
+        case Spv::OpSpecConstantComposite:
+            if (SpirvId* id = getId(1); id && numOps >= 2)
+            {
+                id->Opcode = opcode;
+                id->TypeId = ops[0];
+                id->Members.assign(ops + 2, ops + numOps);
+            }
+            break;
+        case Spv::OpVariable:
+            if (SpirvId* id = getId(1); id && numOps >= 3)
+            {
+                id->Opcode = opcode;
+                id->TypeId = ops[0];
+                id->StorageClass = ops[2];
+            }
+            break;
+        case Spv::OpDecorate:
+            if (SpirvId* id = getId(0); id && numOps >= 2)
+            {
+                uint32_t value = numOps >= 3 ? ops[2] : 0;
+                switch (ops[1])
+                {
+                case Spv::DescriptorSet:
+                    id->Set = value;
+                    break;
+                case Spv::Binding:
+                    id->Binding = value;
+                    break;
+                case Spv::BufferBlock:
+                    id->BufferBlock = true;
+                    break;
+                case Spv::ArrayStride:
+                    id->ArrayStride = value;
+                    break;
+                case Spv::BuiltIn:
+                    id->WorkgroupSizeBuiltIn = value == Spv::BuiltInWorkgroupSize;
+                    break;
+                }
+            }
+            break;
+        case Spv::OpMemberDecorate:
+            if (SpirvId* id = getId(0); id && numOps >= 4)
+            {
+                if (ops[2] == Spv::Offset)
+                    setMemberDecoration(id->MemberOffsets, ops[1], ops[3]);
+                else if (ops[2] == Spv::MatrixStride)
+                    setMemberDecoration(id->MemberMatrixStrides, ops[1], ops[3]);
+            }
+            break;
+        }
+    }
+
+    uint32_t SpirvParser::getConstant(uint32_t id, uint32_t defaultValue)
+    {
+        if (id >= ids.size())
+            return defaultValue;
+
+        const SpirvId& c = ids[id];
+        if (c.Opcode != Spv::OpConstant && c.Opcode != Spv::OpSpecConstant)
+            return defaultValue;
+
+        return c.Value;
+    }
+
+    uint32_t SpirvParser::getTypeSize(uint32_t id, uint32_t matrixStride, int depth)
+    {
+        // Guard against malformed modules with cyclic types
+        if (id >= ids.size() || depth > 32)
+            return 0;
+
+        const SpirvId& type = ids[id];
+        switch (type.Opcode)
+        {
+        case Spv::OpTypeBool:
+        case Spv::OpTypeInt:
+        case Spv::OpTypeFloat:
+            return type.Value / 8;
+        case Spv::OpTypeVector:
+            return type.Value * getTypeSize(type.TypeId, 0, depth + 1);
+        case Spv::OpTypeMatrix:
+            if (matrixStride != 0)
+                return type.Value * matrixStride;
+            return type.Value * getTypeSize(type.TypeId, 0, depth + 1);
+        case Spv::OpTypeArray:
+        {
+            uint32_t length = getConstant(type.Value, 1);
+            if (type.ArrayStride != 0)
+                return length * type.ArrayStride;
+            return length * getTypeSize(type.TypeId, matrixStride, depth + 1);
+        }
+        case Spv::OpTypeStruct:
+        {
+            uint32_t size = 0;
+            for (size_t m = 0; m < type.Members.size(); m++)
+            {
+                uint32_t memberOffset = m < type.MemberOffsets.size() ? type.MemberOffsets[m] : size;
+                uint32_t memberMatrixStride = m < type.MemberMatrixStrides.size() ? type.MemberMatrixStrides[m] : 0;
+                size = std::max(size, memberOffset + getTypeSize(type.Members[m], memberMatrixStride, depth + 1));
+            }
+            return size;
+        }
+        case Spv::OpTypePointer:
+            // Buffer device addresses
+            return 8;
+        default:
+            return 0;
+        }
+    }
+
+    bool SpirvParser::getDescriptorType(const SpirvId& var, const SpirvId& type, DescriptorType& out)
+    {
+        switch (type.Opcode)
+        {
+        case Spv::OpTypeSampler:
+            out = DescriptorType::Sampler;
+            return true;
+        case Spv::OpTypeSampledImage:
+            out = DescriptorType::CombinedImageSampler;
+            return true;
+        case Spv::OpTypeAccelerationStructureKHR:
+            out = DescriptorType::AccelerationStructure;
+            return true;
+        case Spv::OpTypeImage:
+            // Sampled == 2 means the image is used without a sampler, i.e. as a storage image
+            if (type.Value == Spv::DimBuffer)
+                out = type.ImageSampled == 2 ? DescriptorType::StorageTexelBuffer : DescriptorType::UniformTexelBuffer;
+            else if (type.Value == Spv::DimSubpassData)
+                out = DescriptorType::InputAttachment;
+            else
+                out = type.ImageSampled == 2 ? DescriptorType::StorageImage : DescriptorType::SampledImage;
+            return true;
+        case Spv::OpTypeStruct:
+            // Older SPIR-V marks storage buffers as Uniform + BufferBlock
+            if (var.StorageClass == Spv::StorageBuffer || type.BufferBlock)
+                out = DescriptorType::StorageBuffer;
+            else
+                out = DescriptorType::UniformBuffer;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool ReflectSpirv(const uint32_t* data, size_t dataLength, ShaderReflection& reflection)
+    {
+        reflection = ShaderReflection{};
+        SpirvParser parser{ data, dataLength / sizeof(uint32_t) };
+        return parser.Parse(reflection);
+    }
+}
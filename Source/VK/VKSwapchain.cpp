@@ -4,8 +4,10 @@
 #include <R2/VKEnums.hpp>
 #include <R2/VKSyncPrims.hpp>
 #include <R2/VKTexture.hpp>
+#include <R2/VKTraceRecorder.hpp>
 #include <R2/VKUtil.hpp>
 #include <volk.h>
+#include <assert.h>
 #include <vector>
 
 namespace R2::VK
@@ -58,8 +60,11 @@ namespace R2::VK
         , swapchain(VK_NULL_HANDLE)
         , previousSwapchain(VK_NULL_HANDLE)
     {
+        assert(!renderer->IsHeadless() || renderer->GetSupportedFeatures().HeadlessSurface);
         surface = createInfo.surface;
         vsyncEnabled = true;
+        width = createInfo.Width;
+        height = createInfo.Height;
 
         recreate();
     }
@@ -82,6 +87,7 @@ namespace R2::VK
 
     void Swapchain::Present()
     {
+        TraceScope traceScope{ "Swapchain::Present" };
         VkPresentInfoKHR presentInfo{ VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
         presentInfo.pSwapchains = &swapchain;
         presentInfo.swapchainCount = 1;
@@ -122,6 +128,7 @@ namespace R2::VK
 
     Texture* Swapchain::Acquire(Fence* fence)
     {
+        TraceScope traceScope{ "Swapchain::Acquire" };
         uint32_t imageIndex = ~0u;
         VkResult res = vkAcquireNextImageKHR(handles->Device, swapchain, UINT64_MAX, VK_NULL_HANDLE, fence->GetNativeHandle(), &imageIndex);
         if (res != VK_SUBOPTIMAL_KHR && res != VK_ERROR_OUT_OF_DATE_KHR)
@@ -142,6 +149,14 @@ namespace R2::VK
     {
         VkSurfaceCapabilitiesKHR surfaceCaps;
         VKCHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(handles->PhysicalDevice, surface, &surfaceCaps));
+
+        // The swapchain determines the size of the surface, so keep the current one
+        if (surfaceCaps.currentExtent.width == ~0u)
+        {
+            recreate(width, height);
+            return;
+        }
+
         recreate(surfaceCaps.currentExtent.width, surfaceCaps.currentExtent.height);
     }
 
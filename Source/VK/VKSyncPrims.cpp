@@ -1,6 +1,7 @@
 #include <R2/VKSyncPrims.hpp>
 #include <R2/VKCore.hpp>
 #include <R2/VKDeletionQueue.hpp>
+#include <R2/VKTraceRecorder.hpp>
 #include <volk.h>
 
 namespace R2::VK
@@ -18,6 +19,7 @@ namespace R2::VK
 
     void Fence::WaitFor()
     {
+        TraceScope traceScope{ "Fence::WaitFor" };
         VKCHECK(vkWaitForFences(handles->Device, 1, &fence, VK_TRUE, UINT64_MAX));
     }
 
@@ -71,4 +73,34 @@ namespace R2::VK
     {
         DQ_QueueObjectDeletion(core->getCurrentDq(), event, VK_OBJECT_TYPE_EVENT);
     }
-}
\ No newline at end of file
+
+    SplitBarrier::SplitBarrier(Event* evt)
+        : event(evt)
+    {}
+
+    SplitBarrier& SplitBarrier::AddMemoryBarrier(PipelineStageFlags srcStage, AccessFlags srcAccess,
+        PipelineStageFlags dstStage, AccessFlags dstAccess)
+    {
+        memoryBarriers.push_back({ srcStage, srcAccess, dstStage, dstAccess });
+        return *this;
+    }
+
+    SplitBarrier& SplitBarrier::AddTextureBarrier(Texture* tex, ImageLayout oldLayout, ImageLayout newLayout,
+        PipelineStageFlags srcStage, AccessFlags srcAccess, PipelineStageFlags dstStage, AccessFlags dstAccess)
+    {
+        textureBarriers.push_back({ tex, oldLayout, newLayout, { srcStage, srcAccess, dstStage, dstAccess } });
+        return *this;
+    }
+
+    SplitBarrier& SplitBarrier::AddBufferBarrier(Buffer* buf, PipelineStageFlags srcStage, AccessFlags srcAccess,
+        PipelineStageFlags dstStage, AccessFlags dstAccess)
+    {
+        bufferBarriers.push_back({ buf, { srcStage, srcAccess, dstStage, dstAccess } });
+        return *this;
+    }
+
+    Event* SplitBarrier::GetEvent() const
+    {
+        return event;
+    }
+}
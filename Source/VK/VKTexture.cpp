@@ -5,6 +5,8 @@
 #include <R2/VKEnums.hpp>
 #include <R2/VKUtil.hpp>
 #include <VKSyncLegacyHelpers.hpp>
+#include <AllocationRegistry.hpp>
+#include <RuntimeMetrics.hpp>
 #include <volk.h>
 #include <vk_mem_alloc.h>
 #include <assert.h>
@@ -164,16 +166,26 @@ namespace R2::VK
             ici.usage |= VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
         }
 
-        if (createInfo.IsTransient)
+        if (createInfo.CanUseAsInputAttachment)
         {
-            ici.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+            assert(createInfo.IsRenderTarget && "Input attachments must be render targets");
+            ici.usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
         }
 
-        if (supportsStorage(core->GetHandles()->PhysicalDevice, createInfo.Format) && createInfo.CanUseAsStorage)
+        if (createInfo.IsTransient)
+        {
+            // Transient attachments can only be used as attachments, and their
+            // contents never leave the render pass that uses them
+            assert(createInfo.IsRenderTarget && "Transient textures must be render targets");
+            ici.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+        }
+        else if (supportsStorage(core->GetHandles()->PhysicalDevice, createInfo.Format) && createInfo.CanUseAsStorage)
+        {
             ici.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+        }
 
         bool forceSRGBView = false;
-        if (createInfo.Format == TextureFormat::R8G8B8A8_SRGB && createInfo.CanUseAsStorage)
+        if (createInfo.Format == TextureFormat::R8G8B8A8_SRGB && createInfo.CanUseAsStorage && !createInfo.IsTransient)
         {
             ici.flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
             ici.flags |= VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
@@ -197,22 +209,15 @@ namespace R2::VK
         usageFlags = ici.usage;
         imageFlags = ici.flags;
 
+        if (forceSRGBView)
+        {
+            usageFlags &= ~VK_IMAGE_USAGE_STORAGE_BIT;
+        }
+
         ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
         const Handles* handles = core->GetHandles();
 
-        VmaAllocationCreateInfo vaci{};
-        if (createInfo.Pool)
-        {
-            vaci.pool = createInfo.Pool->GetNativeHandle();
-        }
-#ifdef __ANDROID__
-        vaci.usage = createInfo.IsTransient ? VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED : VMA_MEMORY_USAGE_AUTO;
-#else
-        vaci.usage = VMA_MEMORY_USAGE_AUTO;
-#endif
-        VKCHECK(vmaCreateImage(handles->Allocator, &ici, &vaci, &image, &allocation, nullptr));
-
         // Now copy everything...
         width = createInfo.Width;
         height = createInfo.Height;
@@ -223,10 +228,42 @@ namespace R2::VK
         dimension = createInfo.Dimension;
         samples = createInfo.Samples;
 
+        if (createInfo.DeferMemoryBinding)
+        {
+            // The view is created once the image is bound (see AliasedMemory)
+            allocation = nullptr;
+            imageView = VK_NULL_HANDLE;
+            VKCHECK(vkCreateImage(handles->Device, &ici, handles->AllocCallbacks, &image));
+            return;
+        }
+
+        VmaAllocationCreateInfo vaci{};
+        if (createInfo.Pool)
+        {
+            vaci.pool = createInfo.Pool->GetNativeHandle();
+        }
+        vaci.usage = VMA_MEMORY_USAGE_AUTO;
+
+        // Tilers can keep transient attachments entirely in tile memory. Desktop
+        // GPUs generally don't have lazily allocated memory and get device local memory instead.
+        if (createInfo.IsTransient)
+        {
+            vaci.preferredFlags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        }
+        VKCHECK(vmaCreateImage(handles->Allocator, &ici, &vaci, &image, &allocation, nullptr));
+        registerAllocation(allocation, MemoryCategory::Texture);
+
+        createView();
+    }
+
+    void Texture::createView()
+    {
+        const Handles* handles = core->GetHandles();
+
         VkImageViewCreateInfo ivci{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
         ivci.image = image;
-        ivci.viewType = convertViewType(createInfo.Dimension);
-        ivci.format = static_cast<VkFormat>(createInfo.Format);
+        ivci.viewType = convertViewType(dimension);
+        ivci.format = static_cast<VkFormat>(format);
         ivci.subresourceRange.aspectMask = getAspectFlags();
         ivci.subresourceRange.baseArrayLayer = 0;
         ivci.subresourceRange.baseMipLevel = 0;
@@ -234,21 +271,29 @@ namespace R2::VK
         ivci.subresourceRange.levelCount = numMips;
 
         VkImageViewUsageCreateInfo usageCI{ VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO };
-        usageCI.usage = ici.usage & ~VK_IMAGE_USAGE_STORAGE_BIT;
-        if (!supportsStorage(core->GetHandles()->PhysicalDevice, createInfo.Format))
+        usageCI.usage = usageFlags & ~VK_IMAGE_USAGE_STORAGE_BIT;
+        if (!supportsStorage(handles->PhysicalDevice, format))
         {
             ivci.pNext = &usageCI;
         }
 
-        if (forceSRGBView)
-        {
-            ivci.format = VK_FORMAT_R8G8B8A8_SRGB;
-            usageFlags = usageCI.usage;
-        }
-
         VKCHECK(vkCreateImageView(handles->Device, &ivci, handles->AllocCallbacks, &imageView));
     }
 
+    void Texture::bindMemory(VmaAllocation memory, uint64_t offset)
+    {
+        assert(allocation == nullptr && imageView == VK_NULL_HANDLE);
+        VKCHECK(vmaBindImageMemory2(core->GetHandles()->Allocator, memory, offset, image, nullptr));
+        createView();
+    }
+
+    MemoryRequirements Texture::GetMemoryRequirements()
+    {
+        VkMemoryRequirements memReq;
+        vkGetImageMemoryRequirements(core->GetHandles()->Device, image, &memReq);
+        return MemoryRequirements{ memReq.size, memReq.alignment, memReq.memoryTypeBits };
+    }
+
     Texture::Texture(Core* core, VkImage image, ImageLayout layout, const TextureCreateInfo& createInfo, uint32_t usageFlags)
         : image(image)
         , allocation(nullptr)
@@ -358,6 +403,11 @@ namespace R2::VK
 
     void Texture::Acquire(CommandBuffer cb, ImageLayout layout, AccessFlags access, PipelineStageFlags stage)
     {
+        if (externallySynchronized)
+            return;
+
+        countBarriers(1);
+
         if (vkCmdPipelineBarrier2 != NULL)
         {
             VkImageMemoryBarrier2 imb{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
@@ -425,6 +475,8 @@ namespace R2::VK
 
     void Texture::WriteLayoutTransition(CommandBuffer cb, ImageLayout layout)
     {
+        countBarriers(1);
+
         if (vkCmdPipelineBarrier2 != NULL)
         {
             VkImageMemoryBarrier2 imb{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
@@ -470,6 +522,8 @@ namespace R2::VK
 
     void Texture::WriteLayoutTransition(CommandBuffer cb, ImageLayout oldLayout, ImageLayout newLayout)
     {
+        countBarriers(1);
+
         if (vkCmdPipelineBarrier2 != NULL)
         {
             VkImageMemoryBarrier2 imb{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
@@ -0,0 +1,302 @@
+#include <R2/VKTraceRecorder.hpp>
+#include <R2/VKCore.hpp>
+#include <R2/VKGPUProfiler.hpp>
+#include <R2/VKTimestampPool.hpp>
+#include <R2/VKCommandBuffer.hpp>
+#include <R2/VKUtil.hpp>
+#include <volk.h>
+#include <atomic>
+#include <assert.h>
+#include <thread>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace R2::VK
+{
+    std::atomic<TraceRecorder*> g_activeTraceRecorder = nullptr;
+    // Scopes currently adding a zone to the active recorder. The recorder's
+    // destructor waits for this to reach zero after deactivating itself.
+    std::atomic<uint32_t> g_activeTraceReaders = 0;
+    std::atomic<uint32_t> g_nextTraceThreadID = 1;
+    thread_local uint32_t t_traceThreadID = 0;
+
+    // GPU zones go on their own track
+    const uint32_t GPU_THREAD_ID = 0;
+
+    uint32_t getTraceThreadID()
+    {
+        if (t_traceThreadID == 0)
+            t_traceThreadID = g_nextTraceThreadID++;
+
+        return t_traceThreadID;
+    }
+
+    uint64_t TraceRecorder::GetCPUTimestamp()
+    {
+#ifdef _WIN32
+        static LARGE_INTEGER frequency{};
+        if (frequency.QuadPart == 0)
+            QueryPerformanceFrequency(&frequency);
+
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+
+        uint64_t ticks = (uint64_t)counter.QuadPart;
+        uint64_t freq = (uint64_t)frequency.QuadPart;
+        return (ticks / freq) * 1000000000ULL + ((ticks % freq) * 1000000000ULL) / freq;
+#else
+        // Matches VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_EXT
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+    }
+
+    TraceRecorder* TraceRecorder::GetActive()
+    {
+        return g_activeTraceRecorder.load(std::memory_order_relaxed);
+    }
+
+    TraceRecorder::TraceRecorder(Core* core, const char* path, uint32_t maxBufferedEvents)
+        : core(core)
+        , maxBufferedEvents(maxBufferedEvents)
+    {
+        events.reserve(maxBufferedEvents);
+        file = fopen(path, "wb");
+        if (!file)
+            return;
+
+        fputs("[\n", file);
+        fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}},\n", file);
+        fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}", file);
+
+#ifdef _WIN32
+        VkTimeDomainEXT hostDomain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+        VkTimeDomainEXT hostDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_RAW_EXT;
+#endif
+        hostTimeDomain = (uint32_t)hostDomain;
+
+        if (core->GetSupportedFeatures().CalibratedTimestamps)
+        {
+            const Handles* handles = core->GetHandles();
+            uint32_t numDomains = 0;
+            VKCHECK(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(handles->PhysicalDevice, &numDomains, nullptr));
+            std::vector<VkTimeDomainEXT> domains(numDomains);
+            VKCHECK(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(handles->PhysicalDevice, &numDomains, domains.data()));
+
+            bool hasDevice = false;
+            bool hasHost = false;
+            for (VkTimeDomainEXT domain : domains)
+            {
+                hasDevice |= domain == VK_TIME_DOMAIN_DEVICE_EXT;
+                hasHost |= domain == hostDomain;
+            }
+
+            hasCalibratedTimestamps = hasDevice && hasHost;
+        }
+
+        calibrate();
+
+        TraceRecorder* expected = nullptr;
+        bool wasActivated = g_activeTraceRecorder.compare_exchange_strong(expected, this);
+        assert(wasActivated && "Only one TraceRecorder can exist at a time");
+        (void)wasActivated;
+    }
+
+    TraceRecorder::~TraceRecorder()
+    {
+        TraceRecorder* expected = this;
+        g_activeTraceRecorder.compare_exchange_strong(expected, nullptr);
+
+        // A scope closing on another thread may have picked up this recorder
+        // just before it was deactivated
+        while (g_activeTraceReaders.load() != 0)
+        {
+            std::this_thread::yield();
+        }
+
+        if (!file)
+            return;
+
+        Flush();
+        fputs("\n]\n", file);
+        fclose(file);
+    }
+
+    bool TraceRecorder::IsOpen() const
+    {
+        return file != nullptr;
+    }
+
+    bool TraceRecorder::HasCalibratedTimestamps() const
+    {
+        return hasCalibratedTimestamps;
+    }
+
+    void TraceRecorder::AddCPUZone(const char* name, uint64_t startNs, uint64_t endNs)
+    {
+        if (!file)
+            return;
+
+        std::unique_lock lock{mutex};
+        events.push_back(Event{ name, startNs, endNs - startNs, getTraceThreadID() });
+
+        if (events.size() >= maxBufferedEvents)
+            flushLocked();
+    }
+
+    void TraceRecorder::AddGPUZones(const GPUProfiler& profiler)
+    {
+        if (!file || profiler.GetResultsFrameNumber() == lastGPUFrameNumber)
+            return;
+
+        lastGPUFrameNumber = profiler.GetResultsFrameNumber();
+
+        // Recalibrating every frame keeps clock drift out of long traces, and
+        // only costs one call with the extension
+        if (hasCalibratedTimestamps)
+            calibrate();
+
+        if (!calibrated)
+            return;
+
+        uint64_t frameStart = gpuToCPUTime(profiler.GetResultsStartTimestamp());
+
+        std::unique_lock lock{mutex};
+        for (const GPUProfiler::Zone& zone : profiler.GetResults())
+        {
+            Event evt{};
+            evt.Name = zone.Name;
+            evt.StartNs = frameStart + (uint64_t)(zone.StartMs * 1000000.0);
+            evt.DurationNs = (uint64_t)(zone.DurationMs * 1000000.0);
+            evt.ThreadID = GPU_THREAD_ID;
+            events.push_back(evt);
+
+            if (events.size() >= maxBufferedEvents)
+                flushLocked();
+        }
+    }
+
+    void TraceRecorder::Flush()
+    {
+        if (!file)
+            return;
+
+        std::unique_lock lock{mutex};
+        flushLocked();
+        fflush(file);
+    }
+
+    void TraceRecorder::calibrate()
+    {
+        const Handles* handles = core->GetHandles();
+
+        if (hasCalibratedTimestamps)
+        {
+            VkCalibratedTimestampInfoEXT infos[2]
+            {
+                { VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, nullptr, VK_TIME_DOMAIN_DEVICE_EXT },
+                { VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, nullptr, (VkTimeDomainEXT)hostTimeDomain }
+            };
+            uint64_t timestamps[2];
+            uint64_t maxDeviation;
+            VKCHECK(vkGetCalibratedTimestampsEXT(handles->Device, 2, infos, timestamps, &maxDeviation));
+
+            calibrationGPUTimestamp = timestamps[0];
+#ifdef _WIN32
+            LARGE_INTEGER frequency;
+            QueryPerformanceFrequency(&frequency);
+            uint64_t freq = (uint64_t)frequency.QuadPart;
+            calibrationCPUTime = (timestamps[1] / freq) * 1000000000ULL + ((timestamps[1] % freq) * 1000000000ULL) / freq;
+#else
+            calibrationCPUTime = timestamps[1];
+#endif
+            calibrated = true;
+            return;
+        }
+
+        // Without the extension, write a timestamp and take the midpoint of
+        // the CPU times around the submission. Accurate to the submission latency.
+        TimestampPool pool{ handles, 1 };
+        CommandBuffer cb{ Utils::AcquireImmediateCommandBuffer() };
+        pool.Reset(cb);
+        pool.WriteTimestamp(cb, 0);
+
+        uint64_t before = GetCPUTimestamp();
+        Utils::ExecuteImmediateCommandBuffer();
+        uint64_t after = GetCPUTimestamp();
+
+        uint64_t gpuTimestamp;
+        if (pool.GetTimestamps(0, 1, &gpuTimestamp))
+        {
+            calibrationGPUTimestamp = gpuTimestamp;
+            calibrationCPUTime = before + (after - before) / 2;
+            calibrated = true;
+        }
+    }
+
+    uint64_t TraceRecorder::gpuToCPUTime(uint64_t gpuTimestamp) const
+    {
+        double period = core->GetDeviceInfo().TimestampPeriod;
+        double deltaNs = ((double)gpuTimestamp - (double)calibrationGPUTimestamp) * period;
+        return (uint64_t)((double)calibrationCPUTime + deltaNs);
+    }
+
+    void TraceRecorder::writeEvent(const Event& evt)
+    {
+        fputs(",\n{\"name\":\"", file);
+
+        // Escape anything that would break the JSON string
+        for (const char* c = evt.Name; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+                fputc('\\', file);
+
+            if ((unsigned char)*c >= 0x20)
+                fputc(*c, file);
+        }
+
+        bool gpu = evt.ThreadID == GPU_THREAD_ID;
+        fprintf(file, "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            gpu ? "gpu" : "cpu", gpu ? 1 : 0, evt.ThreadID,
+            (double)evt.StartNs / 1000.0, (double)evt.DurationNs / 1000.0);
+    }
+
+    void TraceRecorder::flushLocked()
+    {
+        for (const Event& evt : events)
+        {
+            writeEvent(evt);
+        }
+
+        events.clear();
+    }
+
+    TraceScope::TraceScope(const char* name)
+        : name(name)
+        , start(0)
+    {
+        if (g_activeTraceRecorder.load(std::memory_order_relaxed))
+            start = TraceRecorder::GetCPUTimestamp();
+    }
+
+    TraceScope::~TraceScope()
+    {
+        if (start == 0)
+            return;
+
+        // Registering as a reader before loading the recorder means its
+        // destructor can't finish while the zone is being added
+        g_activeTraceReaders.fetch_add(1);
+        TraceRecorder* recorder = g_activeTraceRecorder.load();
+        if (recorder)
+            recorder->AddCPUZone(name, start, TraceRecorder::GetCPUTimestamp());
+        g_activeTraceReaders.fetch_sub(1);
+    }
+}
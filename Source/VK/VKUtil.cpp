@@ -2,6 +2,7 @@
 #include <R2/VKCore.hpp>
 #include <R2/VKEnums.hpp>
 #include <volk.h>
+#include <RuntimeMetrics.hpp>
 
 namespace R2::VK
 {
@@ -38,6 +39,7 @@ namespace R2::VK
 
         VKCHECK(vkQueueSubmit(handles->Queues.Graphics, 1, &submitInfo, VK_NULL_HANDLE));
         VKCHECK(vkDeviceWaitIdle(handles->Device));
+        countMetric(Metric::IdleWaits);
     }
 
     bool hasAF(AccessFlags access, AccessFlags test)
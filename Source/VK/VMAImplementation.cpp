@@ -8,4 +8,13 @@ R2::VK::IDebugOutputReceiver* vmaDebugOutputRecv;
 //    vmaDebugOutputRecv->DebugMessage(buf); \
 //} while(false)
 #define VMA_IMPLEMENTATION
-#include <vk_mem_alloc.h>
\ No newline at end of file
+#include <vk_mem_alloc.h>
+#include <AllocationRegistry.hpp>
+
+namespace R2::VK
+{
+    bool isDedicatedAllocation(VmaAllocation allocation)
+    {
+        return allocation->GetType() == VmaAllocation_T::ALLOCATION_TYPE_DEDICATED;
+    }
+}